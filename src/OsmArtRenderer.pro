@@ -1,6 +1,6 @@
 QT       += core gui
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 CONFIG += c++11
 
@@ -17,17 +17,28 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     canvas.cpp \
     canvaspietmondrien.cpp \
+    coastlinerasterizer.cpp \
+    cpukernels.cpp \
+    cpupostprocess.cpp \
     effect.cpp \
+    landpolygons.cpp \
     main.cpp \
     mainwindow.cpp \
     mapdata.cpp \
+    noisecache.cpp \
     objects.cpp \
     objectsconfiguration.cpp \
     objectsrepository.cpp \
     oceanlandmassfactory.cpp \
+    polygonobjects.cpp \
     parser.cpp \
+    planarimage.cpp \
     qnoise.cpp \
     renderpass.cpp \
+    rendersnapshot.cpp \
+    scanlinerasterizer.cpp \
+    texturecache.cpp \
+    triangulator.cpp \
     utils.cpp \
     watercoloreffect.cpp \
     watercolorpass.cpp
@@ -35,17 +46,28 @@ SOURCES += \
 HEADERS += \
     canvas.h \
     canvaspietmondrien.h \
+    coastlinerasterizer.h \
     constants.h \
+    cpukernels.h \
+    cpupostprocess.h \
     effect.h \
+    landpolygons.h \
     mainwindow.h \
     mapdata.h \
+    noisecache.h \
     objects.h \
     objectsconfiguration.h \
     objectsrepository.h \
     oceanlandmassfactory.h \
+    polygonobjects.h \
     parser.h \
+    planarimage.h \
     qnoise.h \
     renderpass.h \
+    rendersnapshot.h \
+    scanlinerasterizer.h \
+    texturecache.h \
+    triangulator.h \
     types.h \
     utils.h \
     watercoloreffect.h \
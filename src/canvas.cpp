@@ -1,5 +1,9 @@
 #include "canvas.h"
+#include "coastlinerasterizer.h"
+#include "cpukernels.h"
 #include "objects.h"
+#include "polygonobjects.h"
+#include "scanlinerasterizer.h"
 #include "utils.h"
 
 #include <QDebug>
@@ -15,7 +19,13 @@
 #include <QPointF>
 
 #include <QPainter>
+#include <QPainterPath>
 #include <QRect>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <functional>
 
 namespace osm {
 
@@ -91,91 +101,256 @@ void Canvas::paintEvent(QPaintEvent * /*e*/)
     if (show_image_) {
         painter.drawImage(QPointF(0, 0), image_);
     } else {
-        paint(painter);
+        paint(painter, objects_repository_->Snapshot(), rect());
     }
 
     painter.end();
     repaint_ = false;
 }
 
-void Canvas::paint(QPainter& painter)
+void Canvas::paint(QPainter& painter, const RenderSnapshot& snapshot, const QRectF& area)
+{
+    paint(painter, snapshot, Project(snapshot, {area}), 0);
+}
+
+void Canvas::paint(QPainter& painter, const RenderSnapshot& snapshot, const ProjectedLayers& projected, int band)
 {
-    QVector<Objects*> paint_this_;
-    for (auto it = objects_repository_->OrderedObjectsNames()->begin(); it != objects_repository_->OrderedObjectsNames()->end(); ++it) {
-        //try {
-        auto config = objects_repository_->ObjectsConfiguration(*it);
-        if (config) {
-            if (objects_repository_->ObjectsConfiguration(*it)->Enabled()) {
-                Objects* obj = objects_repository_->Objects(*it);
-                paint_this_.push_back(obj);
+    painter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing);
+    painter.fillRect(0, 0, width(), height(), QColor(Qt::white));
+
+    // The painter state is only changed once per layer: first all fills, then all outlines.
+    for (auto it = snapshot.Layers().begin(); it != snapshot.Layers().end(); ++it) {
+        const LayerStyle& style = it->style;
+        if (!style.enabled || it->objects == nullptr) {
+            continue;
+        }
+        if (it->objects->ObjectsType() == ObjectsTypes::OCEAN && it->objects->Size() > 0) {
+            painter.fillRect(0, 0, width(), height(), style.fill_brush);
+        }
+        auto it_projected = projected.layers.find(it->name);
+        if (it_projected == projected.layers.end()) {
+            continue;
+        }
+        PolygonObjects* polygon_objects = dynamic_cast<PolygonObjects*>(it->objects);
+        if (polygon_objects) {
+            PaintPolygons(painter, polygon_objects, style, *it_projected, projected.bands[band], band);
+            continue;
+        }
+
+        const QVector<QPolygonF>& polygons = it_projected->polygons;
+        const QVector<int>& ways_of_band = it_projected->bands[band];
+        std::vector<Way*>* ways = it->objects->Ways();
+        if (style.filled) {
+            painter.setPen(Qt::NoPen);
+            painter.setBrush(style.fill_brush);
+            for (int i : ways_of_band) {
+                if ((*ways)[i]->is_closed) {
+                    painter.drawPolygon(polygons[i], Qt::FillRule::WindingFill);
+                }
+            }
+        }
+        if (style.outlined) {
+            painter.setPen(style.outline_pen);
+            painter.setBrush(Qt::NoBrush);
+            for (int i : ways_of_band) {
+                painter.drawPolyline(polygons[i]);
             }
-        } else {
-            qDebug() << "Could not find the objects configuration for" << *it;
         }
-        //} catch(const ObjectsConfigurationNotFound& e) {
-        //    qDebug() << "Could not find the objects configuration for" << e.Message();
-        //}
     }
+}
 
-    painter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing);
-    painter.fillRect(0, 0, width(), height(), QColor(Qt::white));
+QHash<QString, qreal> Canvas::PaintedLayers(const RenderSnapshot& snapshot) const
+{
+    QHash<QString, qreal> pen_widths;
+    for (auto it = snapshot.Layers().begin(); it != snapshot.Layers().end(); ++it) {
+        const LayerStyle& style = it->style;
+        if (!style.enabled || it->objects == nullptr) {
+            continue;
+        }
+        // The generated polygons of the ocean are cut out of it, whatever its style.
+        if (dynamic_cast<PolygonObjects*>(it->objects) == nullptr && !style.filled && !style.outlined) {
+            continue;
+        }
+        pen_widths.insert(it->name, style.outlined ? style.line_width : 0);
+    }
+    return pen_widths;
+}
 
-    for (auto it = paint_this_.begin(); it != paint_this_.end(); ++it) {
-        ObjectsConfiguration* config = objects_repository_->ObjectsConfiguration(QString::fromStdString((*it)->Name()));
-        if ((*it)->ObjectsType() == ObjectsTypes::OCEAN && (*it)->Size() > 0 && config->Enabled()) {
-            painter.fillRect(0, 0, width(), height(), config->FillColor());
+ProjectedLayers Canvas::Project(const RenderSnapshot& snapshot, const QVector<QRectF>& bands)
+{
+    ProjectedLayers projected;
+    projected.bands = bands;
+    QHash<const PolygonRings*, QVector<QPolygonF>> projected_rings;
+    const QHash<QString, qreal> pen_widths = PaintedLayers(snapshot);
+    for (auto it = pen_widths.begin(); it != pen_widths.end(); ++it) {
+        const RenderLayer* layer = snapshot.Layer(it.key());
+        if (layer == nullptr || layer->objects == nullptr) {
+            continue;
         }
-        for (auto it_ways = (*it)->Ways()->begin(); it_ways != (*it)->Ways()->end(); ++it_ways) {
-            QVector<QPointF> points = CreatePoints(*it_ways, width(), height(), map_data_, (*it)->ObjectsType()==ObjectsTypes::ANY);
-            QPolygonF polygon(points);
-            Way* way = *it_ways;
-            if (way->is_closed && config->Enabled()) {
-                if ((*it)->ObjectsType() == ObjectsTypes::OCEAN) {
-                    painter.setBrush(Qt::white);
-                    painter.setPen(Qt::white);
-                    painter.drawPolygon(polygon, Qt::FillRule::WindingFill);
-
-                    // DEBUG
-                    /*painter.setBrush(QColor(255,192,203));
-                    QPen p_tmp(QColor(255,192,203));
-                    p_tmp.setWidth(4);
-                    painter.setPen(p_tmp);
-                    painter.drawPolyline(polygon);
-
-                    for (auto it_tmp = way->nodes.begin(); it_tmp != way->nodes.end(); ++it_tmp) {
-                        if (it_tmp < way->nodes.begin()+20) {
-                            painter.setPen(Qt::green);
-                            painter.setBrush(Qt::green);
-                            painter.drawEllipse((*it_tmp)->x, height() - (*it_tmp)->y, 15, 15);
-                        } else if (it_tmp > way->nodes.end()-20) {
-                            painter.setPen(Qt::red);
-                            painter.setBrush(Qt::red);
-                            painter.drawEllipse((*it_tmp)->x, height() - (*it_tmp)->y, 15, 15);
-                        } else {
-                            painter.setPen(Qt::yellow);
-                            painter.setBrush(Qt::yellow);
-                            painter.drawEllipse((*it_tmp)->x, height() - (*it_tmp)->y, 5, 5);
-                        }
-                    }*/
-                } else if (config->Filled()) {
-                    painter.setBrush(config->FillColor());
-                    //painter.setPen(config->FillColor());
-                    painter.setPen(Qt::transparent);
-                    painter.drawPolygon(polygon, Qt::FillRule::WindingFill);
+        PolygonObjects* polygon_objects = dynamic_cast<PolygonObjects*>(layer->objects);
+        if (polygon_objects != nullptr) {
+            ProjectPolygons(*polygon_objects, layer->style, it.value(), bands, projected_rings,
+                            projected.layers[it.key()]);
+            continue;
+        }
+        std::vector<Way*>* ways = layer->objects->Ways();
+        ProjectedLayers::Layer& projected_layer = projected.layers[it.key()];
+        QVector<QPolygonF>& polygons = projected_layer.polygons;
+        polygons.resize(static_cast<int>(ways->size()));
+        QPolygonF* polygons_data = polygons.data();
+        effects::cpu::ParallelFor(polygons.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                polygons_data[i] = QPolygonF(CreatePoints((*ways)[i], width(), height(), map_data_));
+            }
+        }, 256);
+
+        // Each way is only visited by the bands which its bounding rect reaches into, grown by
+        // half the pen on both sides of the lines and a pixel for the antialiasing.
+        const qreal margin = it.value() / 2 + 1;
+        projected_layer.bands.resize(bands.size());
+        for (int i = 0; i < polygons.size(); ++i) {
+            if (polygons[i].isEmpty()) {
+                continue;
+            }
+            const QRectF bounds = polygons[i].boundingRect().adjusted(-margin, -margin, margin, margin);
+            for (int band = 0; band < bands.size(); ++band) {
+                if (bounds.intersects(bands[band])) {
+                    projected_layer.bands[band].append(i);
                 }
             }
-            if (config->Outlined()) {
-                painter.setBrush(Qt::transparent);
-                //painter.setBrush(config->OutlineColor());
-                QPen p(config->OutlineColor());
-                p.setWidth(config->LineWidth());
-                painter.setPen(p);
-                painter.drawPolyline(polygon);
+        }
+    }
+    return projected;
+}
+
+void Canvas::ProjectPolygons(const PolygonObjects& objects, const LayerStyle& style, qreal pen_width,
+                             const QVector<QRectF>& bands, QHash<const PolygonRings*, QVector<QPolygonF>>& projected_rings,
+                             ProjectedLayers::Layer& projected)
+{
+    const bool ocean = objects.ObjectsType() == ObjectsTypes::OCEAN;
+    std::shared_ptr<const CoastlineRasterizer> land_mask = objects.LandMask();
+    if (land_mask) {
+        // The land is classified per pixel; there are no outlines. The mask is colored and
+        // converted once, instead of by every band.
+        if (ocean || style.filled) {
+            QImage mask = land_mask->LandMask(width(), height());
+            mask.setColorTable({qRgba(0, 0, 0, 0), (ocean ? QColor(Qt::white) : style.fill_color).rgba()});
+            projected.land_mask = mask.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        }
+        return;
+    }
+
+    std::shared_ptr<const PolygonRings> rings = objects.Rings();
+    if (!rings) {
+        return;
+    }
+    auto it_rings = projected_rings.find(rings.get());
+    if (it_rings == projected_rings.end()) {
+        // The rings were generated for a certain size (the coastlines for the unit square) - scale them to this canvas.
+        const qreal scale_x = width() / rings->width;
+        const qreal scale_y = height() / rings->height;
+        QVector<QPolygonF> polygons(static_cast<int>(rings->RingsCount()));
+        QPolygonF* polygons_data = polygons.data();
+        effects::cpu::ParallelFor(polygons.size(), [&](int begin, int end) {
+            for (int ring = begin; ring < end; ++ring) {
+                QPolygonF& polygon = polygons_data[ring];
+                polygon.reserve(rings->ring_offsets[ring + 1] - rings->ring_offsets[ring]);
+                for (uint32_t i = rings->ring_offsets[ring]; i < rings->ring_offsets[ring + 1]; ++i) {
+                    polygon.append(QPointF(rings->points[i].x * scale_x, rings->points[i].y * scale_y));
+                }
+            }
+        }, 64);
+        it_rings = projected_rings.insert(rings.get(), polygons);
+    }
+    projected.polygons = *it_rings;
+    const QVector<QPolygonF>& polygons = projected.polygons;
+    QVector<QRectF> bounds(polygons.size());
+    for (int ring = 0; ring < polygons.size(); ++ring) {
+        bounds[ring] = polygons[ring].boundingRect();
+    }
+
+    // The bounding rects are grown like those of the ways (see Project()).
+    projected.fill_bands.resize(bands.size());
+    if (ocean || style.filled) {
+        const qreal margin = (ocean ? 1 : 0) / 2.0 + 1;
+        for (size_t polygon = 0; polygon < rings->PolygonsCount(); ++polygon) {
+            for (uint32_t ring = rings->polygon_offsets[polygon]; ring < rings->polygon_offsets[polygon + 1]; ++ring) {
+                if (polygons[ring].isEmpty()) {
+                    continue;
+                }
+                const QRectF ring_bounds = bounds[ring].adjusted(-margin, -margin, margin, margin);
+                for (int band = 0; band < bands.size(); ++band) {
+                    QVector<int>& fill_band = projected.fill_bands[band];
+                    if (ring_bounds.intersects(bands[band]) &&
+                        (fill_band.isEmpty() || fill_band.last() != static_cast<int>(polygon))) {
+                        fill_band.append(static_cast<int>(polygon));
+                    }
+                }
+            }
+        }
+    }
+    projected.bands.resize(bands.size());
+    if (style.outlined) {
+        const qreal margin = pen_width / 2 + 1;
+        for (int ring = 0; ring < polygons.size(); ++ring) {
+            if (polygons[ring].isEmpty()) {
+                continue;
+            }
+            const QRectF ring_bounds = bounds[ring].adjusted(-margin, -margin, margin, margin);
+            for (int band = 0; band < bands.size(); ++band) {
+                if (ring_bounds.intersects(bands[band])) {
+                    projected.bands[band].append(ring);
+                }
             }
         }
     }
 }
 
+void Canvas::PaintPolygons(QPainter& painter, PolygonObjects* objects, const LayerStyle& style,
+                           const ProjectedLayers::Layer& projected, const QRectF& area, int band)
+{
+    if (!projected.land_mask.isNull()) {
+        painter.drawImage(area, projected.land_mask, area);
+        return;
+    }
+    std::shared_ptr<const PolygonRings> rings = objects->Rings();
+    if (!rings || projected.polygons.isEmpty()) {
+        return;
+    }
+    const QVector<QPolygonF>& polygons = projected.polygons;
+
+    if (objects->ObjectsType() == ObjectsTypes::OCEAN) {
+        // The ocean is the background, and the rings are cut out of it.
+        painter.setPen(Qt::white);
+        painter.setBrush(Qt::white);
+    } else if (style.filled) {
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(style.fill_brush);
+    }
+    for (int polygon : projected.fill_bands[band]) {
+        uint32_t first_ring = rings->polygon_offsets[polygon];
+        uint32_t last_ring = rings->polygon_offsets[polygon + 1];
+        if (last_ring - first_ring == 1) {
+            painter.drawPolygon(polygons[first_ring], Qt::FillRule::WindingFill);
+            continue;
+        }
+        // A polygon with holes (i.e. the precomputed land polygons).
+        QPainterPath path;
+        path.setFillRule(Qt::FillRule::OddEvenFill);
+        for (uint32_t ring = first_ring; ring < last_ring; ++ring) {
+            path.addPolygon(polygons[ring]);
+        }
+        painter.drawPath(path);
+    }
+    if (style.outlined) {
+        painter.setPen(style.outline_pen);
+        painter.setBrush(Qt::NoBrush);
+        for (int ring : projected.bands[band]) {
+            painter.drawPolyline(polygons[ring]);
+        }
+    }
+}
+
 void Canvas::Update()
 {
     ShowImage(RenderToImage());
@@ -192,6 +367,11 @@ QImage Canvas::RenderToImage()
 }
 
 QImage Canvas::RenderToImage(int width, int height, bool offscreen)
+{
+    return RenderToImage(objects_repository_->Snapshot(), width, height, offscreen);
+}
+
+QImage Canvas::RenderToImage(const RenderSnapshot& snapshot, int width, int height, bool offscreen)
 {
     QOpenGLContext* ctx;
     QOffscreenSurface* surface;
@@ -218,7 +398,7 @@ QImage Canvas::RenderToImage(int width, int height, bool offscreen)
 
     QPainter painter(&fboPaintDev);
 
-    paint(painter);
+    paint(painter, snapshot, rect());
 
     painter.end();
 
@@ -240,6 +420,183 @@ QImage Canvas::RenderToImage(int width, int height, bool offscreen)
     return image;
 }
 
+QImage Canvas::RenderToRaster(const RenderSnapshot& snapshot, int bands)
+{
+    QImage image(width(), height(), QImage::Format_RGB32);
+    if (image.isNull()) {
+        return image;
+    }
+    if (bands <= 0) {
+        bands = QThread::idealThreadCount();
+    }
+    bands = std::max(1, std::min(bands, height()));
+    QVector<QRectF> areas;
+    QVector<int> band_indices;
+    for (int band = 0; band < bands; ++band) {
+        const int top = height() * band / bands;
+        areas.append(QRectF(0, top, width(), height() * (band + 1) / bands - top));
+        band_indices.append(band);
+    }
+    // The ways are projected once, and each band only visits those which reach into it.
+    const ProjectedLayers projected = Project(snapshot, areas);
+
+    uchar* bits = image.bits();
+    const int bytes_per_line = image.bytesPerLine();
+    std::function<void(const int&)> paint_band = [&](const int& band) {
+        // The band paints into its rows of the image, so the bands needn't be copied together.
+        const QRect area = areas[band].toRect();
+        QImage band_image(bits + static_cast<size_t>(area.top()) * bytes_per_line, area.width(), area.height(),
+                          bytes_per_line, QImage::Format_RGB32);
+        QPainter painter(&band_image);
+        painter.translate(0, -area.top());
+        painter.setClipRect(area);
+        paint(painter, snapshot, projected, band);
+        painter.end();
+    };
+    QtConcurrent::blockingMap(band_indices, paint_band);
+    return image;
+}
+
+QImage Canvas::RenderToMask(const RenderSnapshot& snapshot, int width, int height)
+{
+    ScanlineRasterizer rasterizer;
+    if (RasterizeMask(snapshot, rasterizer)) {
+        return rasterizer.Mask(QRect(0, 0, width, height));
+    }
+    QImage mask(width, height, QImage::Format_Grayscale8);
+    QPainter painter(&mask);
+    paint(painter, snapshot, rect());
+    painter.end();
+    return mask;
+}
+
+QImage Canvas::RenderToMask(const RenderSnapshot& snapshot, const QRect& region)
+{
+    return RenderToMask(snapshot, region, MaskRasterizer(snapshot).get());
+}
+
+std::shared_ptr<const ScanlineRasterizer> Canvas::MaskRasterizer(const RenderSnapshot& snapshot)
+{
+    std::shared_ptr<ScanlineRasterizer> rasterizer = std::make_shared<ScanlineRasterizer>();
+    if (!RasterizeMask(snapshot, *rasterizer)) {
+        return nullptr;
+    }
+    return rasterizer;
+}
+
+QImage Canvas::RenderToMask(const RenderSnapshot& snapshot, const QRect& region, const ScanlineRasterizer* rasterizer)
+{
+    QImage mask(region.size(), QImage::Format_Grayscale8);
+    if (rasterizer != nullptr) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                const QRect copy = rect().translated(dx * width(), dy * height());
+                const QRect part = copy & region;
+                if (part.isEmpty()) {
+                    continue;
+                }
+                const QImage part_mask = rasterizer->Mask(part.translated(-copy.topLeft()));
+                for (int y = 0; y < part.height(); ++y) {
+                    std::copy(part_mask.constScanLine(y), part_mask.constScanLine(y) + part.width(),
+                              mask.scanLine(part.y() - region.y() + y) + part.x() - region.x());
+                }
+            }
+        }
+        return mask;
+    }
+
+    // The copies which the region reaches into, and their parts of the canvas as the bands of
+    // the projected ways.
+    QVector<QPoint> copies;
+    QVector<QRectF> areas;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            const QRect copy = rect().translated(dx * width(), dy * height());
+            if (copy.intersects(region)) {
+                copies.append(copy.topLeft());
+                areas.append(region.translated(-copy.topLeft()) & rect());
+            }
+        }
+    }
+    const ProjectedLayers projected = Project(snapshot, areas);
+    QPainter painter(&mask);
+    for (int i = 0; i < copies.size(); ++i) {
+        // Each copy is clipped to the canvas, like the image of the whole canvas.
+        painter.save();
+        painter.translate(copies[i] - region.topLeft());
+        painter.setClipRect(rect());
+        paint(painter, snapshot, projected, i);
+        painter.restore();
+    }
+    painter.end();
+    return mask;
+}
+
+bool Canvas::RasterizeMask(const RenderSnapshot& snapshot, ScanlineRasterizer& rasterizer)
+{
+    for (auto it = snapshot.Layers().begin(); it != snapshot.Layers().end(); ++it) {
+        const LayerStyle& style = it->style;
+        if (!style.enabled || it->objects == nullptr) {
+            continue;
+        }
+        // The ocean is the background with the land cut out, and the land mask is a raster.
+        PolygonObjects* polygon_objects = dynamic_cast<PolygonObjects*>(it->objects);
+        const bool triangulated = polygon_objects == nullptr ||
+                (polygon_objects->Rings() && !polygon_objects->Rings()->triangle_offsets.empty());
+        if (!triangulated || it->objects->ObjectsType() == ObjectsTypes::OCEAN ||
+            (style.filled && style.fill_color != QColor(Qt::black)) ||
+            (style.outlined && style.outline_color != QColor(Qt::black))) {
+            return false;
+        }
+        if (!style.filled && !style.outlined) {
+            continue;
+        }
+        if (polygon_objects != nullptr) {
+            RasterizePolygons(*polygon_objects->Rings(), style, rasterizer);
+            continue;
+        }
+        // Like paint(): the closed ways are filled, and all ways are outlined with the pen
+        // (a width of 0 is a cosmetic pen of 1 pixel).
+        std::vector<Way*>* ways = it->objects->Ways();
+        for (auto it_ways = ways->begin(); it_ways != ways->end(); ++it_ways) {
+            const QPolygonF polygon(CreatePoints(*it_ways, width(), height(), map_data_));
+            if (style.filled && (*it_ways)->is_closed) {
+                rasterizer.AddPolygon(polygon);
+            }
+            if (style.outlined) {
+                rasterizer.AddPolyline(polygon, std::max(1, style.line_width));
+            }
+        }
+    }
+    return true;
+}
+
+void Canvas::RasterizePolygons(const PolygonRings& rings, const LayerStyle& style, ScanlineRasterizer& rasterizer)
+{
+    // Scaled to this canvas like in ProjectPolygons().
+    const qreal scale_x = width() / rings.width;
+    const qreal scale_y = height() / rings.height;
+    std::vector<QPointF> points;
+    points.reserve(rings.points.size());
+    for (const Point<float>& point : rings.points) {
+        points.push_back(QPointF(point.x * scale_x, point.y * scale_y));
+    }
+    if (style.filled) {
+        // The cached triangles include the holes, which the rasterizer would fill if it got the rings.
+        rasterizer.AddTriangles(points, rings.triangles.data(), rings.triangles.size());
+    }
+    if (style.outlined) {
+        for (size_t ring = 0; ring < rings.RingsCount(); ++ring) {
+            QPolygonF polyline;
+            polyline.reserve(rings.ring_offsets[ring + 1] - rings.ring_offsets[ring]);
+            for (uint32_t i = rings.ring_offsets[ring]; i < rings.ring_offsets[ring + 1]; ++i) {
+                polyline.append(points[i]);
+            }
+            rasterizer.AddPolyline(polyline, std::max(1, style.line_width));
+        }
+    }
+}
+
 void Canvas::ShowImage(QImage image)
 {
     image_ = image;
@@ -298,35 +655,24 @@ void Canvas::keyReleaseEvent(QKeyEvent* ke)
     }
 }
 
-QVector<QPointF> Canvas::CreatePoints(Way* way, int width, int height, osm::MapData* map_data, bool map_coords)
+QVector<QPointF> Canvas::CreatePoints(Way* way, int width, int height, osm::MapData* map_data)
 {
     QVector<QPointF> points;
-    auto it_nodes = way->nodes.begin();
-    while (it_nodes != way->nodes.end()) {
+    points.reserve(way->nodes.size());
+    float min_lat = map_data->MinLat();
+    float max_lat = map_data->MaxLat();
+    float min_lon = map_data->MinLon();
+    float max_lon = map_data->MaxLon();
+    for (auto it_nodes = way->nodes.begin(); it_nodes != way->nodes.end(); ++it_nodes) {
         float x;
         float y;
-
-        if (map_coords) {
-            float lat = (*it_nodes)->lat;
-            float lon = (*it_nodes)->lon;
-            float min_lat = map_data->MinLat();
-            float max_lat = map_data->MaxLat();
-            float min_lon = map_data->MinLon();
-            float max_lon = map_data->MaxLon();
-
-            osm::utils::MapLatLonToXy(
-                        lat, lon,
-                        min_lat, max_lat,
-                        min_lon, max_lon,
-                        width, height,
-                        x, y);
-        } else {
-            x = (*it_nodes)->x;
-            y = (*it_nodes)->y;
-        }
-
+        osm::utils::MapLatLonToXy(
+                    (*it_nodes)->lat, (*it_nodes)->lon,
+                    min_lat, max_lat,
+                    min_lon, max_lon,
+                    width, height,
+                    x, y);
         points.append(QPointF(x, height - y));
-        ++it_nodes;
     }
     return points;
 }
@@ -3,16 +3,50 @@
 
 #include "objectsrepository.h"
 #include "mapdata.h"
+#include "rendersnapshot.h"
 
 #include <map>
+#include <memory>
+#include <QHash>
+#include <QImage>
 #include <QOpenGLFunctions>
 #include <QOpenGLWidget>
+#include <QPolygonF>
+#include <QVector>
 #include <QWidget>
 #include <set>
 #include <string>
 
 namespace osm {
 
+class PolygonObjects;
+struct PolygonRings;
+class ScanlineRasterizer;
+
+// The ways of the layers of a snapshot in canvas coordinates, projected once for all the bands
+// of a render, and for every band the ways which reach into it (see Canvas::Project()).
+struct ProjectedLayers
+{
+    struct Layer
+    {
+        // In the order of the ways of the layer, or of the rings of generated polygons.
+        QVector<QPolygonF> polygons;
+        // The indices of the ways (or rings) whose bounding rects, grown by the pen, reach into
+        // each band.
+        QVector<QVector<int>> bands;
+        // Generated polygons: the indices of the polygons (with all their rings) whose fills
+        // reach into each band.
+        QVector<QVector<int>> fill_bands;
+        // The land as a raster (see CoastlineRasterizer) in the color of the layer, which each
+        // band draws its part of.
+        QImage land_mask;
+    };
+
+    // The areas of the bands in canvas coordinates.
+    QVector<QRectF> bands;
+    QHash<QString, Layer> layers;
+};
+
 class Canvas : public QOpenGLWidget, protected QOpenGLFunctions
 {
     Q_OBJECT
@@ -30,6 +64,26 @@ public:
 
     QImage RenderToImage();
     QImage RenderToImage(int width, int height, bool offscreen = false);
+    // Renders the given snapshot instead of the current state of the objects repository.
+    QImage RenderToImage(const RenderSnapshot& snapshot, int width, int height, bool offscreen = false);
+    // Renders the snapshot with the raster engine instead of GL into an RGB32 image of the size
+    // of the canvas. The image is split into horizontal bands (0: one per hardware thread),
+    // which are painted concurrently, each by its own QPainter, which is clipped to the band.
+    // The ways are projected once, and each band only draws those which reach into it.
+    QImage RenderToRaster(const RenderSnapshot& snapshot, int bands = 0);
+    // Renders the snapshot into a Grayscale8 image without GL, i.e. the 8 bit coverage mask of
+    // a black and white layer. Layers of ways and of generated polygons (from their triangles)
+    // are rendered by the ScanlineRasterizer, the others by the raster engine of QPainter.
+    QImage RenderToMask(const RenderSnapshot& snapshot, int width, int height);
+    // The mask of the region of the canvas. The canvas is repeated around its edges, so that
+    // the region may reach beyond them (by up to the size of the canvas).
+    QImage RenderToMask(const RenderSnapshot& snapshot, const QRect& region);
+    // The same from the shapes of MaskRasterizer(snapshot), or with QPainter if it is nullptr.
+    QImage RenderToMask(const RenderSnapshot& snapshot, const QRect& region, const ScanlineRasterizer* rasterizer);
+    // The shapes of the snapshot for RenderToMask(), or nullptr if it needs QPainter (see
+    // RasterizeMask()). The ways are projected once, and the masks of several regions (e.g. the
+    // tiles of a layer) can share the rasterizer, which only visits the shapes near each region.
+    std::shared_ptr<const ScanlineRasterizer> MaskRasterizer(const RenderSnapshot& snapshot);
     void ShowImage(QImage image);
 
     void ResetTransformation();
@@ -39,11 +93,37 @@ public slots:
 
 protected:
     void paintEvent(QPaintEvent *e) override;
-    virtual void paint(QPainter& painter);
+    // Paints the snapshot in canvas coordinates. The ways which don't reach into the area (in
+    // canvas coordinates) are skipped, so the painter should be clipped to it.
+    void paint(QPainter& painter, const RenderSnapshot& snapshot, const QRectF& area);
+    // Paints the snapshot in the area of a band of the projected layers, with the ways of the
+    // band. This may be called from several threads at once, with their own painters.
+    virtual void paint(QPainter& painter, const RenderSnapshot& snapshot, const ProjectedLayers& projected, int band);
+    // The layers which paint() draws, with the widths of the pens of their outlines.
+    virtual QHash<QString, qreal> PaintedLayers(const RenderSnapshot& snapshot) const;
+    // Projects the ways and generated polygons of PaintedLayers() to the canvas, and sorts them
+    // into the bands.
+    ProjectedLayers Project(const RenderSnapshot& snapshot, const QVector<QRectF>& bands);
 
     void Update();
 
-    QVector<QPointF> CreatePoints(Way* way, int width, int height, osm::MapData* map_data, bool map_coords = true);
+    // Adds the fills and outlines of the enabled layers to the rasterizer. Returns false if a
+    // layer is not in black or is not made of shapes (e.g. the ocean, or the land as a raster),
+    // so QPainter is needed.
+    bool RasterizeMask(const RenderSnapshot& snapshot, ScanlineRasterizer& rasterizer);
+    // Adds the generated polygons from their triangles, and their outlines, to the rasterizer.
+    void RasterizePolygons(const PolygonRings& rings, const LayerStyle& style, ScanlineRasterizer& rasterizer);
+
+    // Projects generated polygons like Project(). The rings which several layers share (i.e. the
+    // ocean and the landmass) are only projected by the first of them.
+    void ProjectPolygons(const PolygonObjects& objects, const LayerStyle& style, qreal pen_width,
+                         const QVector<QRectF>& bands, QHash<const PolygonRings*, QVector<QPolygonF>>& projected_rings,
+                         ProjectedLayers::Layer& projected);
+    // Draws the generated polygons of a band of the projected layers.
+    void PaintPolygons(QPainter& painter, PolygonObjects* objects, const LayerStyle& style,
+                       const ProjectedLayers::Layer& projected, const QRectF& area, int band);
+
+    QVector<QPointF> CreatePoints(Way* way, int width, int height, osm::MapData* map_data);
 
     osm::ObjectsRepository* objects_repository_;
     osm::MapData* map_data_;
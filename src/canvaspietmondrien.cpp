@@ -1,6 +1,8 @@
 #include "canvaspietmondrien.h"
 #include "constants.h"
 
+#include <QHash>
+
 namespace osm {
 
 CanvasPietMondrien::CanvasPietMondrien(int width, int height, osm::ObjectsRepository *repository, QWidget *parent)
@@ -14,17 +16,23 @@ CanvasPietMondrien::~CanvasPietMondrien()
 
 }
 
-void CanvasPietMondrien::paint(QPainter& painter)
+void CanvasPietMondrien::paint(QPainter& painter, const RenderSnapshot& snapshot, const ProjectedLayers& projected, int band)
 {
-    if (objects_repository_->Objects(kBuildingsName) == nullptr) {
+    const RenderLayer* buildings = snapshot.Layer(kBuildingsName);
+    const RenderLayer* highways = snapshot.Layer(kHighwaysName);
+    const RenderLayer* highways_ext = snapshot.Layer(kHighwaysExtName);
+    if (buildings == nullptr || buildings->objects == nullptr) {
         throw ObjectsNotFound("Could not find the objects with name " + QString(kBuildingsName));
     }
-    if (objects_repository_->Objects(kHighwaysName) == nullptr) {
+    if (highways == nullptr || highways->objects == nullptr) {
         throw ObjectsNotFound("Could not find the objects with name " + QString(kHighwaysName));
     }
-    if (objects_repository_->Objects(kHighwaysExtName) == nullptr) {
-        throw ObjectsNotFound("Could not find the objects with name " + QString(kHighwaysName));
+    if (highways_ext == nullptr || highways_ext->objects == nullptr) {
+        throw ObjectsNotFound("Could not find the objects with name " + QString(kHighwaysExtName));
     }
+    const ProjectedLayers::Layer projected_buildings = projected.layers.value(kBuildingsName);
+    const ProjectedLayers::Layer projected_highways = projected.layers.value(kHighwaysName);
+    const ProjectedLayers::Layer projected_highways_ext = projected.layers.value(kHighwaysExtName);
 
     painter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing | QPainter::HighQualityAntialiasing);
     painter.fillRect(0, 0, width(), height(), QColor(Qt::white));
@@ -32,11 +40,16 @@ void CanvasPietMondrien::paint(QPainter& painter)
     QColor col;
 
     //ObjectsConfiguration* config = objects_repository_->ObjectsConfiguration(kBuildingsName);
-    for (auto it_ways = objects_repository_->Objects(kBuildingsName)->Ways()->begin();
-         it_ways != objects_repository_->Objects(kBuildingsName)->Ways()->end(); ++it_ways) {
-        QVector<QPointF> points = CreatePoints(*it_ways, width(), height(), map_data_, true);
+    std::vector<Way*>* building_ways = buildings->objects->Ways();
+    for (int i : projected_buildings.bands[band]) {
+        Way* way = (*building_ways)[i];
+        // Ignore whether it's enabled or not.
+        if (!way->is_closed) {
+            continue;
+        }
 
-        int r = random() % 3;
+        // The color follows from the id, so that it's the same in every band and render.
+        int r = qHash(QString::fromStdString(way->id)) % 3;
         if (r == 0) {
             col.setRgb(255, 0, 0);
         } else if (r == 1) {
@@ -45,39 +58,37 @@ void CanvasPietMondrien::paint(QPainter& painter)
             col.setRgb(0, 0, 255);
         }
 
-        QPolygonF polygon(points);
-        Way* way = *it_ways;
-        // Ignore whether it's enabled or not.
-        if (way->is_closed) {
-            painter.setBrush(col);
-            painter.setPen(col);
-            painter.drawPolygon(polygon, Qt::FillRule::WindingFill);
-        }
+        painter.setBrush(col);
+        painter.setPen(col);
+        painter.drawPolygon(projected_buildings.polygons[i], Qt::FillRule::WindingFill);
     }
 
-    for (auto it_ways = objects_repository_->Objects(kHighwaysName)->Ways()->begin();
-         it_ways != objects_repository_->Objects(kHighwaysName)->Ways()->end(); ++it_ways) {
-        QVector<QPointF> points = CreatePoints(*it_ways, width(), height(), map_data_, true);
-        QPolygonF polygon(points);
-        // Ignore whether it's enabled or not.
-        painter.setBrush(QColor(50, 50, 50));
-        QPen p(QColor(50, 50, 50));
-        p.setWidth(2);
-        painter.setPen(p);
-        painter.drawPolyline(polygon);
+    // Ignore whether it's enabled or not.
+    QPen highways_pen(QColor(50, 50, 50));
+    highways_pen.setWidth(kHighwaysPenWidth);
+    painter.setBrush(Qt::NoBrush);
+    painter.setPen(highways_pen);
+    for (int i : projected_highways.bands[band]) {
+        painter.drawPolyline(projected_highways.polygons[i]);
     }
 
-    for (auto it_ways = objects_repository_->Objects(kHighwaysExtName)->Ways()->begin();
-         it_ways != objects_repository_->Objects(kHighwaysExtName)->Ways()->end(); ++it_ways) {
-        QVector<QPointF> points = CreatePoints(*it_ways, width(), height(), map_data_, true);
-        QPolygonF polygon(points);
-        // Ignore whether it's enabled or not.
-        painter.setBrush(Qt::black);
-        QPen p(Qt::black);
-        p.setWidth(5);
-        painter.setPen(p);
-        painter.drawPolyline(polygon);
+    // Ignore whether it's enabled or not.
+    QPen highways_ext_pen(Qt::black);
+    highways_ext_pen.setWidth(kHighwaysExtPenWidth);
+    painter.setPen(highways_ext_pen);
+    for (int i : projected_highways_ext.bands[band]) {
+        painter.drawPolyline(projected_highways_ext.polygons[i]);
     }
 }
 
+QHash<QString, qreal> CanvasPietMondrien::PaintedLayers(const RenderSnapshot& /*snapshot*/) const
+{
+    // The buildings are outlined with a pen of their color, 1 pixel wide.
+    QHash<QString, qreal> pen_widths;
+    pen_widths.insert(kBuildingsName, 1);
+    pen_widths.insert(kHighwaysName, kHighwaysPenWidth);
+    pen_widths.insert(kHighwaysExtName, kHighwaysExtPenWidth);
+    return pen_widths;
+}
+
 }  // namespace osm
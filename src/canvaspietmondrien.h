@@ -17,7 +17,13 @@ public:
     virtual ~CanvasPietMondrien();
 
 protected:
-    virtual void paint(QPainter& painter) override;
+    virtual void paint(QPainter& painter, const RenderSnapshot& snapshot, const ProjectedLayers& projected, int band) override;
+    // The buildings and the highways, whether they're enabled or not.
+    virtual QHash<QString, qreal> PaintedLayers(const RenderSnapshot& snapshot) const override;
+
+private:
+    static const int kHighwaysPenWidth = 2;
+    static const int kHighwaysExtPenWidth = 5;
 };
 
 }  // namespace osm
@@ -0,0 +1,250 @@
+#include "coastlinerasterizer.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace osm {
+
+namespace {
+
+const int32_t kUnlabeled = 0;
+const int32_t kBarrier = -1;
+
+const uchar kWater = 0;
+const uchar kLand = 1;
+
+// Clips the segment to the rectangle [0, width] x [0, height] (Liang-Barsky).
+// Returns false if it is completely outside.
+bool ClipSegment(double& ax, double& ay, double& bx, double& by, double width, double height)
+{
+    double dx = bx - ax;
+    double dy = by - ay;
+    const double p[4] = {-dx, dx, -dy, dy};
+    const double q[4] = {ax, width - ax, ay, height - ay};
+    double t_enter = 0;
+    double t_leave = 1;
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0) {
+            if (q[k] < 0) {
+                return false;
+            }
+        } else if (p[k] < 0) {
+            t_enter = std::max(t_enter, q[k] / p[k]);
+        } else {
+            t_leave = std::min(t_leave, q[k] / p[k]);
+        }
+    }
+    if (t_enter > t_leave) {
+        return false;
+    }
+    bx = ax + t_leave * dx;
+    by = ay + t_leave * dy;
+    ax = ax + t_enter * dx;
+    ay = ay + t_enter * dy;
+    return true;
+}
+
+}  // namespace
+
+CoastlineRasterizer::CoastlineRasterizer(const std::vector<Way*>& coastlines, const BoundingBox& bbox)
+{
+    line_offsets_.push_back(0);
+    if (bbox.max_lat <= bbox.min_lat || bbox.max_lon <= bbox.min_lon) {
+        return;
+    }
+    // The same mapping as in the OceanLandmassFactory.
+    const double scale_x = 1.0 / (static_cast<double>(bbox.max_lon) - bbox.min_lon);
+    const double scale_y = 1.0 / (static_cast<double>(bbox.max_lat) - bbox.min_lat);
+    for (auto it = coastlines.begin(); it != coastlines.end(); ++it) {
+        if ((*it)->nodes.size() < 2) {
+            continue;
+        }
+        for (auto it_nodes = (*it)->nodes.begin(); it_nodes != (*it)->nodes.end(); ++it_nodes) {
+            Point<float> p;
+            p.x = ((*it_nodes)->lon - bbox.min_lon) * scale_x;
+            p.y = 1.0 - ((*it_nodes)->lat - bbox.min_lat) * scale_y;
+            points_.push_back(p);
+        }
+        line_offsets_.push_back(points_.size());
+    }
+}
+
+QImage CoastlineRasterizer::LandMask(int width, int height) const
+{
+    std::lock_guard<std::mutex> lock(mask_mutex_);
+    if (mask_.isNull() || mask_.width() != width || mask_.height() != height) {
+        mask_ = Rasterize(width, height);
+    }
+    return mask_;
+}
+
+QImage CoastlineRasterizer::Rasterize(int width, int height) const
+{
+    QImage mask(width, height, QImage::Format_Indexed8);
+    if (mask.isNull()) {
+        return mask;
+    }
+    const size_t pixels_count = static_cast<size_t>(width) * height;
+    std::vector<int32_t> labels(pixels_count, kUnlabeled);
+
+    // 1. Draw the coastlines as barriers. The pixels are visited in the order the segment
+    //    crosses them (Amanatides-Woo), so that the lines are 4-connected and the flood fill
+    //    can't leak through them diagonally.
+    for (size_t line = 0; line + 1 < line_offsets_.size(); ++line) {
+        for (uint32_t i = line_offsets_[line] + 1; i < line_offsets_[line + 1]; ++i) {
+            double ax = points_[i - 1].x * width;
+            double ay = points_[i - 1].y * height;
+            double bx = points_[i].x * width;
+            double by = points_[i].y * height;
+            if (!ClipSegment(ax, ay, bx, by, width, height)) {
+                continue;
+            }
+            int x = std::min(width - 1, static_cast<int>(ax));
+            int y = std::min(height - 1, static_cast<int>(ay));
+            const int end_x = std::min(width - 1, static_cast<int>(bx));
+            const int end_y = std::min(height - 1, static_cast<int>(by));
+            const double dx = bx - ax;
+            const double dy = by - ay;
+            const int step_x = dx > 0 ? 1 : -1;
+            const int step_y = dy > 0 ? 1 : -1;
+            const double t_delta_x = dx != 0 ? std::fabs(1.0 / dx) : INFINITY;
+            const double t_delta_y = dy != 0 ? std::fabs(1.0 / dy) : INFINITY;
+            double t_max_x = dx != 0 ? ((dx > 0 ? x + 1 : x) - ax) / dx : INFINITY;
+            double t_max_y = dy != 0 ? ((dy > 0 ? y + 1 : y) - ay) / dy : INFINITY;
+            labels[static_cast<size_t>(y) * width + x] = kBarrier;
+            // Every step moves one pixel closer to the end, so this terminates.
+            while (x != end_x || y != end_y) {
+                if (t_max_x < t_max_y) {
+                    if (x == end_x) {
+                        break;
+                    }
+                    x += step_x;
+                    t_max_x += t_delta_x;
+                } else {
+                    if (y == end_y) {
+                        break;
+                    }
+                    y += step_y;
+                    t_max_y += t_delta_y;
+                }
+                labels[static_cast<size_t>(y) * width + x] = kBarrier;
+            }
+            for (; x != end_x; x += step_x) {
+                labels[static_cast<size_t>(y) * width + x + step_x] = kBarrier;
+            }
+            for (; y != end_y; y += step_y) {
+                labels[static_cast<size_t>(y + step_y) * width + x] = kBarrier;
+            }
+        }
+    }
+
+    // 2. Label the connected regions between the barriers with a scanline flood fill:
+    //    each span is filled at once, and only the start of each free run in the rows above
+    //    and below is pushed. Every pixel is visited a constant number of times.
+    int32_t regions_count = 0;
+    std::vector<std::pair<int, int>> stack;
+    for (int start_y = 0; start_y < height; ++start_y) {
+        for (int start_x = 0; start_x < width; ++start_x) {
+            if (labels[static_cast<size_t>(start_y) * width + start_x] != kUnlabeled) {
+                continue;
+            }
+            const int32_t region = ++regions_count;
+            stack.push_back({start_x, start_y});
+            while (!stack.empty()) {
+                int x = stack.back().first;
+                int y = stack.back().second;
+                stack.pop_back();
+                int32_t* row = labels.data() + static_cast<size_t>(y) * width;
+                if (row[x] != kUnlabeled) {
+                    continue;
+                }
+                int left = x;
+                while (left > 0 && row[left - 1] == kUnlabeled) {
+                    --left;
+                }
+                int right = x;
+                while (right < width - 1 && row[right + 1] == kUnlabeled) {
+                    ++right;
+                }
+                std::fill(row + left, row + right + 1, region);
+                for (int ny = y - 1; ny <= y + 1; ny += 2) {
+                    if (ny < 0 || ny >= height) {
+                        continue;
+                    }
+                    const int32_t* next_row = labels.data() + static_cast<size_t>(ny) * width;
+                    bool in_run = false;
+                    for (int nx = left; nx <= right; ++nx) {
+                        bool free = next_row[nx] == kUnlabeled;
+                        if (free && !in_run) {
+                            stack.push_back({nx, ny});
+                        }
+                        in_run = free;
+                    }
+                }
+            }
+        }
+    }
+
+    // 3. Every coastline segment votes (weighted by its length) for land on its left and
+    //    water on its right, a bit more than a pixel away from the barrier. In screen
+    //    coordinates (y down), the left of the direction (dx, dy) is (dy, -dx).
+    std::vector<double> land_votes(regions_count + 1, 0);
+    std::vector<double> water_votes(regions_count + 1, 0);
+    auto region_at = [&](double x, double y) {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return kBarrier;
+        }
+        return labels[static_cast<size_t>(y) * width + static_cast<size_t>(x)];
+    };
+    const double kSeedDistance = 1.5;
+    for (size_t line = 0; line + 1 < line_offsets_.size(); ++line) {
+        for (uint32_t i = line_offsets_[line] + 1; i < line_offsets_[line + 1]; ++i) {
+            double ax = points_[i - 1].x * width;
+            double ay = points_[i - 1].y * height;
+            double bx = points_[i].x * width;
+            double by = points_[i].y * height;
+            if (!ClipSegment(ax, ay, bx, by, width, height)) {
+                continue;
+            }
+            double length = std::hypot(bx - ax, by - ay);
+            if (length == 0) {
+                continue;
+            }
+            double mx = (ax + bx) / 2;
+            double my = (ay + by) / 2;
+            double nx = (by - ay) / length * kSeedDistance;
+            double ny = -(bx - ax) / length * kSeedDistance;
+            int32_t land = region_at(mx + nx, my + ny);
+            int32_t water = region_at(mx - nx, my - ny);
+            if (land > 0) {
+                land_votes[land] += length;
+            }
+            if (water > 0) {
+                water_votes[water] += length;
+            }
+        }
+    }
+
+    // 4. Regions without votes are not bounded by any coastline, which means land (i.e. lakes
+    //    or an extract without coast). The coastlines themselves are land as well.
+    std::vector<uchar> classes(regions_count + 1, kLand);
+    for (int32_t region = 1; region <= regions_count; ++region) {
+        if (water_votes[region] > land_votes[region]) {
+            classes[region] = kWater;
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        uchar* line = mask.scanLine(y);
+        const int32_t* row = labels.data() + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            line[x] = row[x] == kBarrier ? kLand : classes[row[x]];
+        }
+    }
+    qDebug() << "Rasterized the coastlines into" << regions_count << "regions";
+    return mask;
+}
+
+}  // namespace osm
@@ -0,0 +1,48 @@
+#ifndef COASTLINERASTERIZER_H
+#define COASTLINERASTERIZER_H
+
+#include "objects.h"
+#include "types.h"
+
+#include <QImage>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace osm
+{
+
+// Classifies land and water on a raster instead of building polygons (an alternative to the
+// OceanLandmassFactory): the connected coastlines are drawn as 4-connected barriers into a
+// grid at the output resolution, the grid is split into connected regions by a scanline flood
+// fill, and each region is land or water by the votes of the coastlines around it (the land
+// is on the left of a coastline, the water on the right).
+// The cost is linear in the number of pixels and coastline segments, and any number of border
+// crossings, islands and lakes is handled without special cases.
+class CoastlineRasterizer
+{
+public:
+    // The coastlines should already be connected (see OceanLandmassFactory::BuildChains()).
+    // Their points are copied, mapped to the unit square of the bbox.
+    CoastlineRasterizer(const std::vector<Way*>& coastlines, const BoundingBox& bbox);
+
+    // Returns a Format_Indexed8 image where the index is 1 for land and 0 for water.
+    // The color table is not set; set it to paint the mask in the wanted colors.
+    // The last mask is cached, and this may be called from several threads.
+    QImage LandMask(int width, int height) const;
+
+private:
+    QImage Rasterize(int width, int height) const;
+
+    // The coastline j consists of the points [line_offsets_[j], line_offsets_[j+1]).
+    std::vector<Point<float>> points_;
+    std::vector<uint32_t> line_offsets_;
+
+    mutable std::mutex mask_mutex_;
+    mutable QImage mask_;
+};
+
+}  // namespace osm
+
+#endif // COASTLINERASTERIZER_H
@@ -4,6 +4,10 @@
 namespace osm {
 
 static const int kMinCanvasSize = 512;
+// Sort the ways of the map data and of each objects layer along a Hilbert curve after loading.
+static const bool kSortWaysSpatially = true;
+// Coastline ends which are closer than this are connected when generating the ocean and landmass.
+static const double kCoastlineGapToleranceKm = 0.5;
 
 constexpr char kLandmassName[] = "Landmass";
 constexpr char kOceanName[] = "Ocean";
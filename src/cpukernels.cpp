@@ -0,0 +1,609 @@
+#include "cpukernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OSM_CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace effects {
+namespace cpu {
+
+namespace {
+
+// See kBlur13Taps. The weights of gaussian_blur.frag (blur13), split between the two pixels
+// of each linear sample, in 1/256 (rounded, so that the sum is exactly 256):
+// 0.1965, 0.1747, 0.1223, 0.0667, 0.0278, 0.0085, 0.0018.
+const uint16_t kBlur13Weights[kBlur13Radius + 1] = {50, 45, 31, 17, 7, 2, 1};
+
+void Blur13Scalar(const uint8_t* const taps[kBlur13Taps], uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t sum = 128 + kBlur13Weights[0] * taps[kBlur13Radius][i];
+        for (int d = 1; d <= kBlur13Radius; ++d) {
+            sum += kBlur13Weights[d] * (taps[kBlur13Radius - d][i] + taps[kBlur13Radius + d][i]);
+        }
+        out[i] = sum >> 8;
+    }
+}
+
+void ThresholdCombineScalar(const uint8_t* const color_0[3], const uint8_t* const color_1[3],
+                            float alpha, float threshold, uint8_t* out, size_t count)
+{
+    // In units of the 8 bit values, like the shader in units of 1/255.
+    const float beta = 1.0f - alpha;
+    const float threshold_squared = (threshold * 255.0f) * (threshold * 255.0f);
+    for (size_t i = 0; i < count; ++i) {
+        float r = color_0[0][i] * alpha + color_1[0][i] * beta;
+        float g = color_0[1][i] * alpha + color_1[1][i] * beta;
+        float b = color_0[2][i] * alpha + color_1[2][i] * beta;
+        float squared_length = r * r + g * g + b * b;
+        out[i] = squared_length < threshold_squared ? 0 : 255;
+    }
+}
+
+void BlendScalar(const uint8_t* t0, const uint8_t* t1, const uint8_t* alpha, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t x = t0[i] * (255 - alpha[i]) + t1[i] * alpha[i] + 127;
+        // x / 255 (exact for these values).
+        out[i] = (x + 1 + (x >> 8)) >> 8;
+    }
+}
+
+// One row of the sliding box sums: writes the averages of the sums, then adds the row which
+// enters the box and subtracts the one which leaves it. The sums are below 2^24, so they
+// are exact as floats.
+void BoxStepScalar(const uint8_t* add, const uint8_t* sub, uint32_t* sums, float scale, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<uint8_t>(static_cast<float>(sums[i]) * scale + 0.5f);
+        sums[i] += add[i] - sub[i];
+    }
+}
+
+void MaxRowsScalar(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::max(a[i], b[i]);
+    }
+}
+
+void MinRowsScalar(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::min(a[i], b[i]);
+    }
+}
+
+#ifdef OSM_CPU_X86
+
+__attribute__((target("sse2")))
+void Blur13Sse2(const uint8_t* const taps[kBlur13Taps], uint8_t* out, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(128);
+    __m128i weights[kBlur13Radius + 1];
+    for (int d = 0; d <= kBlur13Radius; ++d) {
+        weights[d] = _mm_set1_epi16(kBlur13Weights[d]);
+    }
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        // 16 bit lanes: the sum is at most 255 * 256 + 128.
+        __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(taps[kBlur13Radius] + i));
+        __m128i lo = _mm_add_epi16(rounding, _mm_mullo_epi16(_mm_unpacklo_epi8(center, zero), weights[0]));
+        __m128i hi = _mm_add_epi16(rounding, _mm_mullo_epi16(_mm_unpackhi_epi8(center, zero), weights[0]));
+        for (int d = 1; d <= kBlur13Radius; ++d) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(taps[kBlur13Radius - d] + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(taps[kBlur13Radius + d] + i));
+            __m128i sum_lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i sum_hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(sum_lo, weights[d]));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(sum_hi, weights[d]));
+        }
+        __m128i result = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    const uint8_t* rest[kBlur13Taps];
+    for (int k = 0; k < kBlur13Taps; ++k) {
+        rest[k] = taps[k] + i;
+    }
+    Blur13Scalar(rest, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void Blur13Avx2(const uint8_t* const taps[kBlur13Taps], uint8_t* out, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i rounding = _mm256_set1_epi16(128);
+    __m256i weights[kBlur13Radius + 1];
+    for (int d = 0; d <= kBlur13Radius; ++d) {
+        weights[d] = _mm256_set1_epi16(kBlur13Weights[d]);
+    }
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        // The unpacks and the pack work within the 128 bit lanes, so the order is kept.
+        __m256i center = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(taps[kBlur13Radius] + i));
+        __m256i lo = _mm256_add_epi16(rounding, _mm256_mullo_epi16(_mm256_unpacklo_epi8(center, zero), weights[0]));
+        __m256i hi = _mm256_add_epi16(rounding, _mm256_mullo_epi16(_mm256_unpackhi_epi8(center, zero), weights[0]));
+        for (int d = 1; d <= kBlur13Radius; ++d) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(taps[kBlur13Radius - d] + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(taps[kBlur13Radius + d] + i));
+            __m256i sum_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+            __m256i sum_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+            lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(sum_lo, weights[d]));
+            hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(sum_hi, weights[d]));
+        }
+        __m256i result = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    const uint8_t* rest[kBlur13Taps];
+    for (int k = 0; k < kBlur13Taps; ++k) {
+        rest[k] = taps[k] + i;
+    }
+    Blur13Scalar(rest, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void ThresholdCombineSse2(const uint8_t* const color_0[3], const uint8_t* const color_1[3],
+                          float alpha, float threshold, uint8_t* out, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 alpha_v = _mm_set1_ps(alpha);
+    const __m128 beta_v = _mm_set1_ps(1.0f - alpha);
+    const __m128 threshold_squared = _mm_set1_ps((threshold * 255.0f) * (threshold * 255.0f));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        // 4 groups of 4 pixels as floats, for each channel of both colors.
+        __m128 mixed[3][4];
+        for (int c = 0; c < 3; ++c) {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color_0[c] + i));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color_1[c] + i));
+            __m128i v0_16[2] = {_mm_unpacklo_epi8(v0, zero), _mm_unpackhi_epi8(v0, zero)};
+            __m128i v1_16[2] = {_mm_unpacklo_epi8(v1, zero), _mm_unpackhi_epi8(v1, zero)};
+            for (int q = 0; q < 4; ++q) {
+                __m128i a = q % 2 == 0 ? _mm_unpacklo_epi16(v0_16[q / 2], zero) : _mm_unpackhi_epi16(v0_16[q / 2], zero);
+                __m128i b = q % 2 == 0 ? _mm_unpacklo_epi16(v1_16[q / 2], zero) : _mm_unpackhi_epi16(v1_16[q / 2], zero);
+                mixed[c][q] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), alpha_v), _mm_mul_ps(_mm_cvtepi32_ps(b), beta_v));
+            }
+        }
+        __m128i below[4];
+        for (int q = 0; q < 4; ++q) {
+            __m128 squared_length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mixed[0][q], mixed[0][q]),
+                                                          _mm_mul_ps(mixed[1][q], mixed[1][q])),
+                                               _mm_mul_ps(mixed[2][q], mixed[2][q]));
+            below[q] = _mm_castps_si128(_mm_cmplt_ps(squared_length, threshold_squared));
+        }
+        __m128i below_8 = _mm_packs_epi16(_mm_packs_epi32(below[0], below[1]), _mm_packs_epi32(below[2], below[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(below_8, _mm_set1_epi8(-1)));
+    }
+    const uint8_t* rest_0[3] = {color_0[0] + i, color_0[1] + i, color_0[2] + i};
+    const uint8_t* rest_1[3] = {color_1[0] + i, color_1[1] + i, color_1[2] + i};
+    ThresholdCombineScalar(rest_0, rest_1, alpha, threshold, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void ThresholdCombineAvx2(const uint8_t* const color_0[3], const uint8_t* const color_1[3],
+                          float alpha, float threshold, uint8_t* out, size_t count)
+{
+    const __m256 alpha_v = _mm256_set1_ps(alpha);
+    const __m256 beta_v = _mm256_set1_ps(1.0f - alpha);
+    const __m256 threshold_squared = _mm256_set1_ps((threshold * 255.0f) * (threshold * 255.0f));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 mixed[3];
+        for (int c = 0; c < 3; ++c) {
+            __m256 a = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(color_0[c] + i))));
+            __m256 b = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(color_1[c] + i))));
+            mixed[c] = _mm256_add_ps(_mm256_mul_ps(a, alpha_v), _mm256_mul_ps(b, beta_v));
+        }
+        __m256 squared_length = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mixed[0], mixed[0]),
+                                                            _mm256_mul_ps(mixed[1], mixed[1])),
+                                              _mm256_mul_ps(mixed[2], mixed[2]));
+        __m256i below = _mm256_castps_si256(_mm256_cmp_ps(squared_length, threshold_squared, _CMP_LT_OQ));
+        __m128i below_16 = _mm_packs_epi32(_mm256_castsi256_si128(below), _mm256_extracti128_si256(below, 1));
+        __m128i below_8 = _mm_packs_epi16(below_16, below_16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(below_8, _mm_set1_epi8(-1)));
+    }
+    const uint8_t* rest_0[3] = {color_0[0] + i, color_0[1] + i, color_0[2] + i};
+    const uint8_t* rest_1[3] = {color_1[0] + i, color_1[1] + i, color_1[2] + i};
+    ThresholdCombineScalar(rest_0, rest_1, alpha, threshold, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void BlendSse2(const uint8_t* t0, const uint8_t* t1, const uint8_t* alpha, uint8_t* out, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(-1);
+    const __m128i rounding = _mm_set1_epi16(127);
+    const __m128i one = _mm_set1_epi16(1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + i));
+        __m128i inverse_a = _mm_sub_epi8(ones, a);
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t0 + i));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t1 + i));
+        __m128i x[2];
+        x[0] = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v0, zero), _mm_unpacklo_epi8(inverse_a, zero)),
+                                           _mm_mullo_epi16(_mm_unpacklo_epi8(v1, zero), _mm_unpacklo_epi8(a, zero))),
+                             rounding);
+        x[1] = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v0, zero), _mm_unpackhi_epi8(inverse_a, zero)),
+                                           _mm_mullo_epi16(_mm_unpackhi_epi8(v1, zero), _mm_unpackhi_epi8(a, zero))),
+                             rounding);
+        for (int k = 0; k < 2; ++k) {
+            x[k] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x[k], one), _mm_srli_epi16(x[k], 8)), 8);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(x[0], x[1]));
+    }
+    BlendScalar(t0 + i, t1 + i, alpha + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void BlendAvx2(const uint8_t* t0, const uint8_t* t1, const uint8_t* alpha, uint8_t* out, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi8(-1);
+    const __m256i rounding = _mm256_set1_epi16(127);
+    const __m256i one = _mm256_set1_epi16(1);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + i));
+        __m256i inverse_a = _mm256_sub_epi8(ones, a);
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t0 + i));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t1 + i));
+        __m256i x[2];
+        x[0] = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v0, zero), _mm256_unpacklo_epi8(inverse_a, zero)),
+                                                 _mm256_mullo_epi16(_mm256_unpacklo_epi8(v1, zero), _mm256_unpacklo_epi8(a, zero))),
+                                rounding);
+        x[1] = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v0, zero), _mm256_unpackhi_epi8(inverse_a, zero)),
+                                                 _mm256_mullo_epi16(_mm256_unpackhi_epi8(v1, zero), _mm256_unpackhi_epi8(a, zero))),
+                                rounding);
+        for (int k = 0; k < 2; ++k) {
+            x[k] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x[k], one), _mm256_srli_epi16(x[k], 8)), 8);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(x[0], x[1]));
+    }
+    BlendScalar(t0 + i, t1 + i, alpha + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void BoxStepSse2(const uint8_t* add, const uint8_t* sub, uint32_t* sums, float scale, uint8_t* out, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale_v = _mm_set1_ps(scale);
+    const __m128 half = _mm_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i add_8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(add + i));
+        __m128i sub_8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sub + i));
+        __m128i add_16[2] = {_mm_unpacklo_epi8(add_8, zero), _mm_unpackhi_epi8(add_8, zero)};
+        __m128i sub_16[2] = {_mm_unpacklo_epi8(sub_8, zero), _mm_unpackhi_epi8(sub_8, zero)};
+        __m128i averages[4];
+        for (int q = 0; q < 4; ++q) {
+            __m128i* sums_q = reinterpret_cast<__m128i*>(sums + i + 4 * q);
+            __m128i sum = _mm_loadu_si128(sums_q);
+            averages[q] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale_v), half));
+            __m128i a = q % 2 == 0 ? _mm_unpacklo_epi16(add_16[q / 2], zero) : _mm_unpackhi_epi16(add_16[q / 2], zero);
+            __m128i b = q % 2 == 0 ? _mm_unpacklo_epi16(sub_16[q / 2], zero) : _mm_unpackhi_epi16(sub_16[q / 2], zero);
+            _mm_storeu_si128(sums_q, _mm_sub_epi32(_mm_add_epi32(sum, a), b));
+        }
+        __m128i result = _mm_packus_epi16(_mm_packs_epi32(averages[0], averages[1]), _mm_packs_epi32(averages[2], averages[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    BoxStepScalar(add + i, sub + i, sums + i, scale, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void BoxStepAvx2(const uint8_t* add, const uint8_t* sub, uint32_t* sums, float scale, uint8_t* out, size_t count)
+{
+    const __m256 scale_v = _mm256_set1_ps(scale);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i* sums_i = reinterpret_cast<__m256i*>(sums + i);
+        __m256i sum = _mm256_loadu_si256(sums_i);
+        __m256i average = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(sum), scale_v), half));
+        __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(add + i)));
+        __m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sub + i)));
+        _mm256_storeu_si256(sums_i, _mm256_sub_epi32(_mm256_add_epi32(sum, a), b));
+        __m128i average_16 = _mm_packs_epi32(_mm256_castsi256_si128(average), _mm256_extracti128_si256(average, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(average_16, average_16));
+    }
+    BoxStepScalar(add + i, sub + i, sums + i, scale, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void MaxRowsSse2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i result = _mm_max_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    MaxRowsScalar(a + i, b + i, out + i, count - i);
+}
+
+__attribute__((target("sse2")))
+void MinRowsSse2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i result = _mm_min_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    MinRowsScalar(a + i, b + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void MaxRowsAvx2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i result = _mm256_max_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    MaxRowsScalar(a + i, b + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void MinRowsAvx2(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i result = _mm256_min_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    MinRowsScalar(a + i, b + i, out + i, count - i);
+}
+
+#endif  // OSM_CPU_X86
+
+struct Kernels
+{
+    void (*blur13)(const uint8_t* const taps[kBlur13Taps], uint8_t* out, size_t count);
+    void (*threshold_combine)(const uint8_t* const color_0[3], const uint8_t* const color_1[3],
+                              float alpha, float threshold, uint8_t* out, size_t count);
+    void (*blend)(const uint8_t* t0, const uint8_t* t1, const uint8_t* alpha, uint8_t* out, size_t count);
+    void (*box_step)(const uint8_t* add, const uint8_t* sub, uint32_t* sums, float scale, uint8_t* out, size_t count);
+    void (*max_rows)(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+    void (*min_rows)(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+};
+
+Kernels DetectKernels()
+{
+    Kernels kernels = {Blur13Scalar, ThresholdCombineScalar, BlendScalar, BoxStepScalar, MaxRowsScalar, MinRowsScalar};
+#ifdef OSM_CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels = {Blur13Avx2, ThresholdCombineAvx2, BlendAvx2, BoxStepAvx2, MaxRowsAvx2, MinRowsAvx2};
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels = {Blur13Sse2, ThresholdCombineSse2, BlendSse2, BoxStepSse2, MaxRowsSse2, MinRowsSse2};
+    }
+#endif
+    return kernels;
+}
+
+const Kernels& SelectedKernels()
+{
+    static const Kernels kernels = DetectKernels();
+    return kernels;
+}
+
+}  // namespace
+
+void Blur13(const uint8_t* const taps[kBlur13Taps], uint8_t* out, size_t count)
+{
+    SelectedKernels().blur13(taps, out, count);
+}
+
+void ThresholdCombine(const uint8_t* const color_0[3], const uint8_t* const color_1[3],
+                      float alpha, float threshold, uint8_t* out, size_t count)
+{
+    SelectedKernels().threshold_combine(color_0, color_1, alpha, threshold, out, count);
+}
+
+void Blend(const uint8_t* t0, const uint8_t* t1, const uint8_t* alpha, uint8_t* out, size_t count)
+{
+    SelectedKernels().blend(t0, t1, alpha, out, count);
+}
+
+void Darken(const uint8_t* in, const uint8_t* shade, float strength, uint8_t* out, size_t count)
+{
+    // The factors of the shades in 1/256.
+    uint16_t factors[256];
+    for (int value = 0; value < 256; ++value) {
+        factors[value] = static_cast<uint16_t>(std::lround(256 * (1 - strength * (255 - value) / 255.0f)));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<uint8_t>((in[i] * factors[shade[i]] + 128) >> 8);
+    }
+}
+
+void BoxBlurColumns(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end)
+{
+    if (begin >= end || height == 0) {
+        return;
+    }
+    const size_t count = end - begin;
+    auto row = [&](int y) { return in + static_cast<size_t>(std::min(std::max(y, 0), height - 1)) * width + begin; };
+    // The sums of the box around the row -1, so that the first step moves it to the row 0.
+    std::vector<uint32_t> sums(count, 0);
+    for (int y = -radius - 1; y < radius; ++y) {
+        const uint8_t* pixels = row(y);
+        for (size_t i = 0; i < count; ++i) {
+            sums[i] += pixels[i];
+        }
+    }
+    std::vector<uint8_t> ignored(count);
+    const float scale = 1.0f / (2 * radius + 1);
+    SelectedKernels().box_step(row(radius), row(-radius - 1), sums.data(), scale, ignored.data(), count);
+    for (int y = 0; y < height; ++y) {
+        SelectedKernels().box_step(row(y + radius + 1), row(y - radius), sums.data(), scale,
+                                   out + static_cast<size_t>(y) * width + begin, count);
+    }
+}
+
+namespace {
+
+// van Herk/Gil-Werman: the padded column is split into blocks of the window size. g holds the
+// running extremum from the start of each block, h the one to the end of each block, and every
+// window covers the end of one block and the start of the next: out = op(h[first], g[last]).
+void ExtremumColumns(void (*op)(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count),
+                     const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end)
+{
+    if (begin >= end || height == 0) {
+        return;
+    }
+    const size_t count = end - begin;
+    const int window = 2 * radius + 1;
+    const int padded_height = height + 2 * radius;
+    // The padded row p is the row p - radius of the plane (repeating the border rows).
+    auto row = [&](int p) {
+        return in + static_cast<size_t>(std::min(std::max(p - radius, 0), height - 1)) * width + begin;
+    };
+    std::vector<uint8_t> g(static_cast<size_t>(padded_height) * count);
+    std::vector<uint8_t> h(static_cast<size_t>(padded_height) * count);
+    for (int p = 0; p < padded_height; ++p) {
+        uint8_t* g_p = g.data() + static_cast<size_t>(p) * count;
+        if (p % window == 0) {
+            std::copy(row(p), row(p) + count, g_p);
+        } else {
+            op(g_p - count, row(p), g_p, count);
+        }
+    }
+    for (int p = padded_height - 1; p >= 0; --p) {
+        uint8_t* h_p = h.data() + static_cast<size_t>(p) * count;
+        if (p % window == window - 1 || p == padded_height - 1) {
+            std::copy(row(p), row(p) + count, h_p);
+        } else {
+            op(h_p + count, row(p), h_p, count);
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        op(h.data() + static_cast<size_t>(y) * count, g.data() + static_cast<size_t>(y + 2 * radius) * count,
+           out + static_cast<size_t>(y) * width + begin, count);
+    }
+}
+
+}  // namespace
+
+void MaxColumns(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end)
+{
+    ExtremumColumns(SelectedKernels().max_rows, in, out, width, height, radius, begin, end);
+}
+
+void MinColumns(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end)
+{
+    ExtremumColumns(SelectedKernels().min_rows, in, out, width, height, radius, begin, end);
+}
+
+void Transpose(const uint8_t* in, int width, int height, uint8_t* out, int begin, int end)
+{
+    // In tiles, so that the reads and the writes stay in the cache.
+    const int kTile = 32;
+    for (int tile_y = begin; tile_y < end; tile_y += kTile) {
+        const int tile_end_y = std::min(end, tile_y + kTile);
+        for (int tile_x = 0; tile_x < width; tile_x += kTile) {
+            const int tile_end_x = std::min(width, tile_x + kTile);
+            for (int y = tile_y; y < tile_end_y; ++y) {
+                const uint8_t* line = in + static_cast<size_t>(y) * width;
+                for (int x = tile_x; x < tile_end_x; ++x) {
+                    out[static_cast<size_t>(x) * height + y] = line[x];
+                }
+            }
+        }
+    }
+}
+
+namespace {
+// The limit of the current thread (0 for none).
+thread_local int threads_limit = 0;
+}  // namespace
+
+ThreadsLimit::ThreadsLimit(int threads_count) : previous_(threads_limit)
+{
+    threads_limit = std::max(1, threads_count);
+}
+
+ThreadsLimit::~ThreadsLimit()
+{
+    threads_limit = previous_;
+}
+
+void ParallelFor(int count, const std::function<void(int begin, int end)>& f, int min_band)
+{
+    int threads_count = std::max(1u, std::thread::hardware_concurrency());
+    if (threads_limit > 0) {
+        threads_count = std::min(threads_count, threads_limit);
+    }
+    threads_count = std::max(1, std::min(threads_count, count / std::max(1, min_band)));
+    if (threads_count == 1) {
+        f(0, count);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threads_count; ++t) {
+        threads.emplace_back(f, static_cast<int>(static_cast<int64_t>(count) * t / threads_count),
+                             static_cast<int>(static_cast<int64_t>(count) * (t + 1) / threads_count));
+    }
+    f(0, count / threads_count);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void MatchColor(const uint8_t* const planes[], const uint8_t values[], int planes_count,
+                uint8_t* out, size_t count)
+{
+    // Memory bound, and simple enough for the compiler to vectorize.
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = 255;
+    }
+    for (int p = 0; p < planes_count; ++p) {
+        const uint8_t* plane = planes[p];
+        const uint8_t value = values[p];
+        for (size_t i = 0; i < count; ++i) {
+            out[i] &= plane[i] == value ? 255 : 0;
+        }
+    }
+}
+
+void Select(const uint8_t* condition, const uint8_t* if_set, const uint8_t* if_clear,
+            uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = (if_set[i] & condition[i]) | (if_clear[i] & ~condition[i]);
+    }
+}
+
+void Or(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = a[i] | b[i];
+    }
+}
+
+void And(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = a[i] & b[i];
+    }
+}
+
+void Invert(const uint8_t* in, uint8_t* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = 255 - in[i];
+    }
+}
+
+}  // namespace cpu
+}  // namespace effects
@@ -0,0 +1,78 @@
+#ifndef CPUKERNELS_H
+#define CPUKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace effects {
+namespace cpu {
+
+// The inner loops of the CPU render passes, on rows of 8 bit values. The arithmetic heavy
+// kernels have SSE2 and AVX2 versions, which are selected at runtime on x86 (and give exactly
+// the same results as the scalar versions).
+
+// The 13 tap gaussian of gaussian_blur.frag. The shader samples between two pixels with
+// linear filtering; here the weights are split between both pixels instead (in 1/256).
+static const int kBlur13Taps = 13;
+static const int kBlur13Radius = 6;
+// out[i] = sum of the weights times taps[k][i]. taps[kBlur13Radius] is the center.
+void Blur13(const uint8_t* const taps[kBlur13Taps], uint8_t* out, size_t count);
+
+// threshold_combiner.frag: mixes color_0 * alpha + color_1 * (1 - alpha) (RGB planes), and
+// writes 0 where the length of the mixed color is below the threshold, else 255.
+void ThresholdCombine(const uint8_t* const color_0[3], const uint8_t* const color_1[3],
+                      float alpha, float threshold, uint8_t* out, size_t count);
+
+// blend.frag (mix): out = t0 * (1 - alpha) + t1 * alpha, rounded.
+void Blend(const uint8_t* t0, const uint8_t* t1, const uint8_t* alpha, uint8_t* out, size_t count);
+
+// darken.frag: out = in * (1 - strength * (255 - shade) / 255), rounded.
+void Darken(const uint8_t* in, const uint8_t* shade, float strength, uint8_t* out, size_t count);
+
+// A box filter with the given radius down the columns [begin, end) of the plane (which has
+// the stride width). The pixels beyond the top and the bottom repeat the border rows.
+// The cost per pixel doesn't depend on the radius. out must not be in.
+void BoxBlurColumns(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end);
+// The maximum (or minimum) of the 2 * radius + 1 pixels around each pixel of the columns
+// [begin, end), with 3 comparisons per pixel for any radius (van Herk/Gil-Werman). The pixels
+// beyond the top and the bottom repeat the border rows. out must not be in.
+void MaxColumns(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end);
+void MinColumns(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end);
+// Writes the rows [begin, end) of the plane as the columns of out (which has the stride height).
+void Transpose(const uint8_t* in, int width, int height, uint8_t* out, int begin, int end);
+
+// Calls f(begin, end) for consecutive bands of [0, count) on the hardware threads (bands
+// have at least min_band elements), and waits for all of them.
+void ParallelFor(int count, const std::function<void(int begin, int end)>& f, int min_band = 1);
+// Limits the threads of ParallelFor() on the current thread while the object lives, e.g. when
+// several images are processed at once on a thread pool.
+class ThreadsLimit
+{
+public:
+    explicit ThreadsLimit(int threads_count);
+    ~ThreadsLimit();
+
+private:
+    ThreadsLimit(const ThreadsLimit&) = delete;
+    ThreadsLimit& operator=(const ThreadsLimit&) = delete;
+    int previous_;
+};
+
+// out = 255 where all planes have their value, else 0.
+void MatchColor(const uint8_t* const planes[], const uint8_t values[], int planes_count,
+                uint8_t* out, size_t count);
+// out = condition ? if_set : if_clear (the condition is 0 or 255).
+void Select(const uint8_t* condition, const uint8_t* if_set, const uint8_t* if_clear,
+            uint8_t* out, size_t count);
+// out = a | b, i.e. white where the mask a is 255.
+void Or(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+// out = a & b, i.e. 255 where both masks are.
+void And(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+// out = 255 - in
+void Invert(const uint8_t* in, uint8_t* out, size_t count);
+
+}  // namespace cpu
+}  // namespace effects
+
+#endif // CPUKERNELS_H
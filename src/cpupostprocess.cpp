@@ -0,0 +1,575 @@
+#include "cpupostprocess.h"
+
+#include "cpukernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace effects {
+namespace cpu {
+
+namespace {
+
+const int kAlpha = PlanarImage::kAlpha;
+
+void CheckSizes(const PlanarImage& image_0, const PlanarImage& image_1)
+{
+    if (image_0.Width() != image_1.Width() || image_0.Height() != image_1.Height()) {
+        throw std::logic_error("The images of a render pass must have the same size.");
+    }
+}
+
+// Creates an image of the given size and calls op(channel, plane) for every plane to compute.
+// A channel shares the plane of a previous one if it does so in all inputs, and the result is
+// opaque if all inputs are.
+template <typename Op>
+PlanarImage MapChannels(int width, int height, const std::vector<const PlanarImage*>& inputs, Op op)
+{
+    PlanarImage result(width, height);
+    const bool opaque = std::all_of(inputs.begin(), inputs.end(), [](const PlanarImage* input) { return input->Opaque(); });
+    for (int channel = 0; channel < (opaque ? kAlpha : PlanarImage::kChannels); ++channel) {
+        int owner = channel;
+        for (int other = 0; other < channel && owner == channel; ++other) {
+            bool shared = true;
+            for (const PlanarImage* input : inputs) {
+                shared = shared && input->Plane(other) == input->Plane(channel);
+            }
+            if (shared) {
+                owner = other;
+            }
+        }
+        if (owner != channel) {
+            result.SharePlane(channel, owner);
+        } else {
+            result.AllocatePlane(channel);
+            op(channel, result.Plane(channel));
+        }
+    }
+    return result;
+}
+
+// MapChannels() with the size of the inputs.
+template <typename Op>
+PlanarImage MapChannels(const std::vector<const PlanarImage*>& inputs, Op op)
+{
+    return MapChannels(inputs.front()->Width(), inputs.front()->Height(), inputs, op);
+}
+
+// The index of the pixel i of a row (or a column) which repeats the size pixels of a texture,
+// mirrored at every edge (GL_MIRRORED_REPEAT).
+int MirroredIndex(int i, int size)
+{
+    const int period = 2 * size;
+    const int position = (i % period + period) % period;
+    return position < size ? position : period - 1 - position;
+}
+
+// A grey image: the color channels share one plane, and there is no alpha plane.
+PlanarImage OpaqueGreyImage(int width, int height)
+{
+    PlanarImage result(width, height);
+    result.AllocatePlane(0);
+    result.SharePlane(1, 0);
+    result.SharePlane(2, 0);
+    return result;
+}
+
+void BlurHorizontal(const uint8_t* in, uint8_t* out, int width, int height)
+{
+    // The row with kBlur13Radius wrapped pixels on both sides.
+    std::vector<uint8_t> padded(width + 2 * kBlur13Radius);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = in + static_cast<size_t>(y) * width;
+        for (size_t x = 0; x < padded.size(); ++x) {
+            padded[x] = row[((static_cast<int>(x) - kBlur13Radius) % width + width) % width];
+        }
+        const uint8_t* taps[kBlur13Taps];
+        for (int k = 0; k < kBlur13Taps; ++k) {
+            taps[k] = padded.data() + k;
+        }
+        cpu::Blur13(taps, out + static_cast<size_t>(y) * width, width);
+    }
+}
+
+void BlurVertical(const uint8_t* in, uint8_t* out, int width, int height)
+{
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* taps[kBlur13Taps];
+        for (int k = 0; k < kBlur13Taps; ++k) {
+            int row = ((y + k - kBlur13Radius) % height + height) % height;
+            taps[k] = in + static_cast<size_t>(row) * width;
+        }
+        cpu::Blur13(taps, out + static_cast<size_t>(y) * width, width);
+    }
+}
+
+// The radii of the box filters whose sequence approximates a gaussian with sigma.
+std::vector<int> BoxRadii(float sigma, int boxes_count)
+{
+    const double variance = 12.0 * sigma * sigma;
+    int lower = static_cast<int>(std::sqrt(variance / boxes_count + 1));
+    if (lower % 2 == 0) {
+        --lower;
+    }
+    lower = std::max(1, lower);
+    const int upper = lower + 2;
+    // The number of boxes with the lower width, so that the variance is the closest.
+    const int lower_count = static_cast<int>(std::round(
+        (variance - boxes_count * lower * lower - 4.0 * boxes_count * lower - 3.0 * boxes_count) / (-4.0 * lower - 4)));
+    std::vector<int> radii;
+    for (int i = 0; i < boxes_count; ++i) {
+        radii.push_back(((i < lower_count ? lower : upper) - 1) / 2);
+    }
+    return radii;
+}
+
+// Applies the box filters down the columns of the plane (in is overwritten).
+void BoxBlursDownColumns(uint8_t* in, uint8_t* out, int width, int height, const std::vector<int>& radii)
+{
+    for (size_t i = 0; i < radii.size(); ++i) {
+        // Bands of 64 columns at least, so that the rows of a band are long enough for SIMD.
+        cpu::ParallelFor(width, [&](int begin, int end) {
+            cpu::BoxBlurColumns(in, out, width, height, radii[i], begin, end);
+        }, 64);
+        std::swap(in, out);
+    }
+    if (radii.size() % 2 == 0) {
+        std::copy(in, in + static_cast<size_t>(width) * height, out);
+    }
+}
+
+typedef void (*ColumnsOp)(const uint8_t* in, uint8_t* out, int width, int height, int radius, int begin, int end);
+
+void ExtremumDownColumns(ColumnsOp op, const uint8_t* in, uint8_t* out, int width, int height, int radius)
+{
+    cpu::ParallelFor(width, [&](int begin, int end) {
+        op(in, out, width, height, radius, begin, end);
+    }, 64);
+}
+
+// Along the diagonals (down right or down left): the rows are shifted, so that the diagonals
+// become the columns of a wider plane. The pixels beside the image have the neutral value.
+void ExtremumAlongDiagonals(ColumnsOp op, uint8_t neutral, const uint8_t* in, uint8_t* out,
+                            int width, int height, int radius, bool down_right)
+{
+    const int sheared_width = width + height - 1;
+    std::vector<uint8_t> sheared(static_cast<size_t>(sheared_width) * height, neutral);
+    std::vector<uint8_t> result(sheared.size());
+    auto shift = [&](int y) { return static_cast<size_t>(y) * sheared_width + (down_right ? height - 1 - y : y); };
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* row = in + static_cast<size_t>(y) * width;
+        std::copy(row, row + width, sheared.begin() + shift(y));
+    }
+    ExtremumDownColumns(op, sheared.data(), result.data(), sheared_width, height, radius);
+    for (int y = 0; y < height; ++y) {
+        std::copy(result.begin() + shift(y), result.begin() + shift(y) + width, out + static_cast<size_t>(y) * width);
+    }
+}
+
+PlanarImage Morphology(const PlanarImage& image, int radius, MorphologyShape shape, bool maximum)
+{
+    if (radius <= 0) {
+        return image;
+    }
+    const ColumnsOp op = maximum ? cpu::MaxColumns : cpu::MinColumns;
+    const uint8_t neutral = maximum ? 0 : 255;
+    int square_radius = radius;
+    int diagonal_radius = 0;
+    if (shape == MORPHOLOGY_DISC) {
+        // A square with the half side a and a diamond of diagonal steps b reach a + 2b along
+        // the axes and (a + b) * sqrt(2) along the diagonals, which is the radius for both with
+        // b = radius * (1 - 1 / sqrt(2)). The square fills the gaps between the diagonal steps.
+        diagonal_radius = static_cast<int>(std::round(radius * (1 - std::sqrt(0.5))));
+        square_radius = std::max(1, radius - 2 * diagonal_radius);
+    }
+    const int width = image.Width();
+    const int height = image.Height();
+    std::vector<uint8_t> buffer_0(image.PixelsCount());
+    std::vector<uint8_t> buffer_1(image.PixelsCount());
+    return MapChannels({&image}, [&](int channel, uint8_t* out) {
+        // The rows as the columns of the transposed plane, like in GaussianBlur().
+        cpu::ParallelFor(height, [&](int begin, int end) {
+            cpu::Transpose(image.Plane(channel), width, height, buffer_0.data(), begin, end);
+        });
+        ExtremumDownColumns(op, buffer_0.data(), buffer_1.data(), height, width, square_radius);
+        cpu::ParallelFor(width, [&](int begin, int end) {
+            cpu::Transpose(buffer_1.data(), height, width, buffer_0.data(), begin, end);
+        });
+        ExtremumDownColumns(op, buffer_0.data(), out, width, height, square_radius);
+        if (diagonal_radius > 0) {
+            ExtremumAlongDiagonals(op, neutral, out, buffer_0.data(), width, height, diagonal_radius, true);
+            ExtremumAlongDiagonals(op, neutral, buffer_0.data(), out, width, height, diagonal_radius, false);
+        }
+    });
+}
+
+const float kInfinity = 1e20f;
+
+// The lower envelope of the parabolas (q - p)^2 + f[p]: d[q] is the minimum over p.
+// v and z are buffers of n and n + 1 elements.
+void DistanceTransform1d(const float* f, float* d, int n, int* v, float* z)
+{
+    int k = 0;
+    v[0] = 0;
+    z[0] = -kInfinity;
+    z[1] = kInfinity;
+    for (int q = 1; q < n; ++q) {
+        // Where the parabola of q gets lower than the last one of the envelope; the ones which
+        // it hides completely are removed (z[0] stops this, the parabolas are at least 1 apart).
+        auto intersection = [&](int p) {
+            return ((f[q] + static_cast<float>(q) * q) - (f[p] + static_cast<float>(p) * p)) / (2.0f * (q - p));
+        };
+        float s = intersection(v[k]);
+        while (s <= z[k]) {
+            --k;
+            s = intersection(v[k]);
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = kInfinity;
+    }
+    k = 0;
+    for (int q = 0; q < n; ++q) {
+        while (z[k + 1] < q) {
+            ++k;
+        }
+        const float distance = static_cast<float>(q - v[k]);
+        d[q] = distance * distance + f[v[k]];
+    }
+}
+
+// The squared euclidean distance of every pixel to the nearest pixel which is set in the mask
+// (kInfinity if there is none). The columns and the rows are separate passes.
+std::vector<float> SquaredDistanceTransform(const std::vector<uint8_t>& mask, int width, int height)
+{
+    const size_t count = mask.size();
+    std::vector<float> distances(count);
+    // The columns are binary, so two sweeps give the distances, row by row for all columns.
+    cpu::ParallelFor(width, [&](int begin, int end) {
+        std::vector<int> below(end - begin, -1);
+        std::vector<int> nearest(static_cast<size_t>(height) * (end - begin));
+        for (int y = 0; y < height; ++y) {
+            const uint8_t* row = mask.data() + static_cast<size_t>(y) * width + begin;
+            int* nearest_row = nearest.data() + static_cast<size_t>(y) * (end - begin);
+            for (int i = 0; i < end - begin; ++i) {
+                below[i] = row[i] ? 0 : (below[i] < 0 ? -1 : below[i] + 1);
+                nearest_row[i] = below[i];
+            }
+        }
+        std::vector<int> above(end - begin, -1);
+        for (int y = height - 1; y >= 0; --y) {
+            const uint8_t* row = mask.data() + static_cast<size_t>(y) * width + begin;
+            const int* nearest_row = nearest.data() + static_cast<size_t>(y) * (end - begin);
+            float* distances_row = distances.data() + static_cast<size_t>(y) * width + begin;
+            for (int i = 0; i < end - begin; ++i) {
+                above[i] = row[i] ? 0 : (above[i] < 0 ? -1 : above[i] + 1);
+                int distance = nearest_row[i] < 0 || (above[i] >= 0 && above[i] < nearest_row[i])
+                        ? above[i] : nearest_row[i];
+                distances_row[i] = distance < 0 ? kInfinity : static_cast<float>(distance) * distance;
+            }
+        }
+    }, 64);
+    cpu::ParallelFor(height, [&](int begin, int end) {
+        std::vector<float> row(width);
+        std::vector<int> v(width);
+        std::vector<float> z(width + 1);
+        for (int y = begin; y < end; ++y) {
+            float* distances_row = distances.data() + static_cast<size_t>(y) * width;
+            std::copy(distances_row, distances_row + width, row.begin());
+            DistanceTransform1d(row.data(), distances_row, width, v.data(), z.data());
+        }
+    });
+    return distances;
+}
+
+}  // namespace
+
+PlanarImage GaussianBlur(const PlanarImage& image, float sigma)
+{
+    if (sigma <= 0) {
+        return image;
+    }
+    const int width = image.Width();
+    const int height = image.Height();
+    const std::vector<int> radii = BoxRadii(sigma, 3);
+    std::vector<uint8_t> buffer_0(image.PixelsCount());
+    std::vector<uint8_t> buffer_1(image.PixelsCount());
+    return MapChannels({&image}, [&](int channel, uint8_t* out) {
+        // The rows are blurred as the columns of the transposed plane, so that both directions
+        // run along the rows in memory and the SIMD lanes are neighbouring columns.
+        cpu::ParallelFor(height, [&](int begin, int end) {
+            cpu::Transpose(image.Plane(channel), width, height, buffer_0.data(), begin, end);
+        });
+        BoxBlursDownColumns(buffer_0.data(), buffer_1.data(), height, width, radii);
+        cpu::ParallelFor(width, [&](int begin, int end) {
+            cpu::Transpose(buffer_1.data(), height, width, buffer_0.data(), begin, end);
+        });
+        BoxBlursDownColumns(buffer_0.data(), out, width, height, radii);
+    });
+}
+
+int GaussianBlurRadius(float sigma)
+{
+    if (sigma <= 0) {
+        return 0;
+    }
+    const std::vector<int> radii = BoxRadii(sigma, 3);
+    return std::accumulate(radii.begin(), radii.end(), 0);
+}
+
+PlanarImage Blur(const PlanarImage& image)
+{
+    std::vector<uint8_t> horizontal(image.PixelsCount());
+    return MapChannels({&image}, [&](int channel, uint8_t* out) {
+        BlurHorizontal(image.Plane(channel), horizontal.data(), image.Width(), image.Height());
+        BlurVertical(horizontal.data(), out, image.Width(), image.Height());
+    });
+}
+
+PlanarImage Erode(const PlanarImage& image, int radius, MorphologyShape shape)
+{
+    return Morphology(image, radius, shape, true);
+}
+
+PlanarImage Dilate(const PlanarImage& image, int radius, MorphologyShape shape)
+{
+    return Morphology(image, radius, shape, false);
+}
+
+PlanarImage ThresholdCombine(const PlanarImage& image, const PlanarImage& noise, float alpha, float threshold)
+{
+    CheckSizes(image, noise);
+    PlanarImage result = OpaqueGreyImage(image.Width(), image.Height());
+    const uint8_t* color_0[3] = {image.Plane(0), image.Plane(1), image.Plane(2)};
+    const uint8_t* color_1[3] = {noise.Plane(0), noise.Plane(1), noise.Plane(2)};
+    cpu::ThresholdCombine(color_0, color_1, alpha, threshold, result.Plane(0), image.PixelsCount());
+    return result;
+}
+
+PlanarImage ColorCombine(const PlanarImage& image, const PlanarImage& texture)
+{
+    CheckSizes(image, texture);
+    const size_t count = image.PixelsCount();
+    std::vector<uint8_t> white(count);
+    const uint8_t* planes[PlanarImage::kChannels] = {image.Plane(0), image.Plane(1), image.Plane(2), nullptr};
+    const uint8_t values[PlanarImage::kChannels] = {255, 255, 255, 255};
+    if (!image.Opaque()) {
+        planes[kAlpha] = image.Plane(kAlpha);
+    }
+    cpu::MatchColor(planes, values, image.Opaque() ? kAlpha : PlanarImage::kChannels, white.data(), count);
+    // The color of the texture with the alpha of the image.
+    return MapChannels({&image, &texture}, [&](int channel, uint8_t* out) {
+        const uint8_t* source = channel == kAlpha ? image.Plane(kAlpha) : texture.Plane(channel);
+        cpu::Or(white.data(), source, out, count);
+    });
+}
+
+PlanarImage Invert(const PlanarImage& image)
+{
+    PlanarImage result(image.Width(), image.Height());
+    for (int channel = 0; channel < kAlpha; ++channel) {
+        int owner = image.PlaneOwner(channel);
+        if (owner != channel) {
+            result.SharePlane(channel, owner);
+        } else {
+            result.AllocatePlane(channel);
+            cpu::Invert(image.Plane(channel), result.Plane(channel), image.PixelsCount());
+        }
+    }
+    return result;
+}
+
+PlanarImage Mask(const PlanarImage& image, const PlanarImage& mask)
+{
+    CheckSizes(image, mask);
+    const size_t count = image.PixelsCount();
+    std::vector<uint8_t> white(count);
+    const uint8_t* planes[3] = {mask.Plane(0), mask.Plane(1), mask.Plane(2)};
+    const uint8_t values[3] = {0, 0, 0};
+    cpu::MatchColor(planes, values, 3, white.data(), count);
+    return MapChannels({&image}, [&](int channel, uint8_t* out) {
+        cpu::Or(white.data(), image.Plane(channel), out, count);
+    });
+}
+
+int EdgeGradientRadius(float edge_sigma)
+{
+    return static_cast<int>(std::ceil(4 * std::max(edge_sigma, 0.01f) + 1));
+}
+
+PlanarImage EdgeGradient(const PlanarImage& image, float edge_sigma)
+{
+    const int width = image.Width();
+    const int height = image.Height();
+    const size_t count = image.PixelsCount();
+    std::vector<uint8_t> white(count);
+    const uint8_t* planes[3] = {image.Plane(0), image.Plane(1), image.Plane(2)};
+    const uint8_t values[3] = {255, 255, 255};
+    cpu::MatchColor(planes, values, 3, white.data(), count);
+    const std::vector<float> distances = SquaredDistanceTransform(white, width, height);
+
+    // The blurred inverted shapes at the distance d from the center of the nearest white
+    // pixel, i.e. d - 0.5 from the edge: the normal distribution function of the blur.
+    // The squared distances are integers, so the curve is a table up to 4 sigma.
+    const float sigma = std::max(edge_sigma, 0.01f);
+    const float max_distance = EdgeGradientRadius(edge_sigma);
+    std::vector<uint8_t> falloff(static_cast<size_t>(max_distance * max_distance) + 1);
+    for (size_t squared = 0; squared < falloff.size(); ++squared) {
+        float edge_distance = std::sqrt(static_cast<float>(squared)) - 0.5f;
+        falloff[squared] = static_cast<uint8_t>(std::round(127.5f * (1 + std::erf(edge_distance / (sigma * std::sqrt(2.0f))))));
+    }
+
+    PlanarImage result = OpaqueGreyImage(width, height);
+    uint8_t* out = result.Plane(0);
+    cpu::ParallelFor(height, [&](int begin, int end) {
+        for (size_t i = static_cast<size_t>(begin) * width; i < static_cast<size_t>(end) * width; ++i) {
+            if (white[i]) {
+                out[i] = 255;
+            } else {
+                out[i] = distances[i] < falloff.size() ? falloff[static_cast<size_t>(distances[i])] : 255;
+            }
+        }
+    });
+    return result;
+}
+
+PlanarImage Blend(const PlanarImage& texture_0, const PlanarImage& texture_1)
+{
+    CheckSizes(texture_0, texture_1);
+    if (texture_0.Opaque()) {
+        // Mixed by an alpha of 1.
+        return texture_1;
+    }
+    return MapChannels({&texture_0, &texture_1}, [&](int channel, uint8_t* out) {
+        cpu::Blend(texture_0.Plane(channel), texture_1.Plane(channel), texture_0.Plane(kAlpha),
+                   out, texture_0.PixelsCount());
+    });
+}
+
+PlanarImage Darken(const PlanarImage& image, const PlanarImage& shade, float strength)
+{
+    CheckSizes(image, shade);
+    const float clamped = std::min(std::max(strength, 0.0f), 1.0f);
+    return MapChannels({&image}, [&](int channel, uint8_t* out) {
+        if (channel == kAlpha) {
+            std::copy(image.Plane(kAlpha), image.Plane(kAlpha) + image.PixelsCount(), out);
+        } else {
+            cpu::Darken(image.Plane(channel), shade.Plane(0), clamped, out, image.PixelsCount());
+        }
+    });
+}
+
+PlanarImage MaskedOverlay(const PlanarImage& texture_0, const PlanarImage& texture_1, const QColor& mask_color)
+{
+    return MaskedOverlay(std::vector<PlanarImage>{texture_0, texture_1}, mask_color);
+}
+
+PlanarImage MaskedOverlay(const std::vector<PlanarImage>& textures, const QColor& mask_color)
+{
+    if (textures.empty()) {
+        throw std::logic_error("At least one texture needs to be provided for the overlay.");
+    }
+    for (const PlanarImage& texture : textures) {
+        CheckSizes(textures.front(), texture);
+    }
+    const int width = textures.front().Width();
+    const int height = textures.front().Height();
+    // The shader gets the components as floats, where 1.0 is the maximum.
+    auto to_value = [](int component) { return static_cast<uint8_t>(std::min(255, component * 255)); };
+    const uint8_t values[3] = {to_value(mask_color.red()), to_value(mask_color.green()), to_value(mask_color.blue())};
+
+    // Like in MapChannels(), but the channels are computed together, row by row.
+    PlanarImage result(width, height);
+    std::vector<int> channels;
+    for (int channel = 0; channel < kAlpha; ++channel) {
+        int owner = channel;
+        for (int other = 0; other < channel && owner == channel; ++other) {
+            if (std::all_of(textures.begin(), textures.end(), [other, channel](const PlanarImage& texture) {
+                    return texture.Plane(other) == texture.Plane(channel); })) {
+                owner = other;
+            }
+        }
+        if (owner != channel) {
+            result.SharePlane(channel, owner);
+        } else {
+            result.AllocatePlane(channel);
+            channels.push_back(channel);
+        }
+    }
+
+    cpu::ParallelFor(height, [&](int begin, int end) {
+        // 255 where the pixel has the mask color in all textures so far.
+        std::vector<uint8_t> masked(width);
+        std::vector<uint8_t> matched(width);
+        for (int y = begin; y < end; ++y) {
+            const size_t offset = static_cast<size_t>(y) * width;
+            auto row_planes = [offset](const PlanarImage& texture, const uint8_t* planes[3]) {
+                for (int channel = 0; channel < kAlpha; ++channel) {
+                    planes[channel] = texture.Plane(channel) + offset;
+                }
+            };
+            const uint8_t* planes[3];
+            row_planes(textures.front(), planes);
+            cpu::MatchColor(planes, values, 3, masked.data(), width);
+            for (int channel : channels) {
+                std::copy(planes[channel], planes[channel] + width, result.Plane(channel) + offset);
+            }
+            for (size_t i = 1; i < textures.size(); ++i) {
+                if (std::find(masked.begin(), masked.end(), 255) == masked.end()) {
+                    break;
+                }
+                row_planes(textures[i], planes);
+                for (int channel : channels) {
+                    uint8_t* out = result.Plane(channel) + offset;
+                    cpu::Select(masked.data(), planes[channel], out, out, width);
+                }
+                if (i + 1 < textures.size()) {
+                    cpu::MatchColor(planes, values, 3, matched.data(), width);
+                    cpu::And(masked.data(), matched.data(), masked.data(), width);
+                }
+            }
+        }
+    }, 16);
+    return result;
+}
+
+PlanarImage Crop(const PlanarImage& image, const QRect& rect)
+{
+    if (!QRect(0, 0, image.Width(), image.Height()).contains(rect)) {
+        throw std::logic_error("The rect to crop is not within the image.");
+    }
+    return MapChannels(rect.width(), rect.height(), {&image}, [&](int channel, uint8_t* out) {
+        const uint8_t* in = image.Plane(channel);
+        for (int y = 0; y < rect.height(); ++y) {
+            const uint8_t* line = in + static_cast<size_t>(rect.y() + y) * image.Width() + rect.x();
+            std::copy(line, line + rect.width(), out + static_cast<size_t>(y) * rect.width());
+        }
+    });
+}
+
+PlanarImage Mirrored(const PlanarImage& texture, const QRect& region)
+{
+    std::vector<int> columns(region.width());
+    for (int x = 0; x < region.width(); ++x) {
+        columns[x] = MirroredIndex(region.x() + x, texture.Width());
+    }
+    return MapChannels(region.width(), region.height(), {&texture}, [&](int channel, uint8_t* out) {
+        const uint8_t* in = texture.Plane(channel);
+        cpu::ParallelFor(region.height(), [&](int begin, int end) {
+            for (int y = begin; y < end; ++y) {
+                const uint8_t* line = in + static_cast<size_t>(MirroredIndex(region.y() + y, texture.Height())) * texture.Width();
+                uint8_t* out_line = out + static_cast<size_t>(y) * region.width();
+                for (int x = 0; x < region.width(); ++x) {
+                    out_line[x] = line[columns[x]];
+                }
+            }
+        }, 16);
+    });
+}
+
+}  // namespace cpu
+}  // namespace effects
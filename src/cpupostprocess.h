@@ -0,0 +1,80 @@
+#ifndef CPUPOSTPROCESS_H
+#define CPUPOSTPROCESS_H
+
+#include "planarimage.h"
+
+#include <QColor>
+#include <QRect>
+
+#include <vector>
+
+namespace effects {
+namespace cpu {
+
+// The render passes of the shaders in src/shaders on planar 8 bit images, for hosts without
+// a GPU. Like the GL textures, the images wrap around at the borders (GL_REPEAT), and all
+// images of one call must have the same size. Channels which share their planes in all inputs
+// share them in the result, so grey images are processed once instead of three times.
+
+// gaussian_blur.frag with blur_size 13, horizontally and then vertically.
+PlanarImage Blur(const PlanarImage& image);
+// The standard deviation of Blur().
+const float kBlurSigma = 2.0f;
+// A gaussian blur with any standard deviation (in pixels), approximated by three box
+// filters (see Kovesi, "Fast Almost-Gaussian Filtering"). The cost doesn't depend on sigma,
+// so the blur can grow with the size of the image. Unlike Blur(), the borders are repeated
+// instead of wrapped around.
+PlanarImage GaussianBlur(const PlanarImage& image, float sigma);
+// The distance up to which GaussianBlur() reads the neighbours of a pixel (for the margins of tiles).
+int GaussianBlurRadius(float sigma);
+// The structuring elements of Erode() and Dilate().
+enum MorphologyShape {
+    MORPHOLOGY_SQUARE, MORPHOLOGY_DISC
+};
+// The layers are black shapes on white, so like erosion.frag, Erode() shrinks the dark shapes
+// (the maximum within the structuring element), and like dilation.frag, Dilate() grows them
+// (the minimum). The square has the side 2 * radius + 1; the disc is approximated by an
+// octagon. The cost per pixel doesn't depend on the radius (van Herk/Gil-Werman). Unlike the
+// shaders, the borders are repeated instead of wrapped around.
+PlanarImage Erode(const PlanarImage& image, int radius, MorphologyShape shape = MORPHOLOGY_SQUARE);
+PlanarImage Dilate(const PlanarImage& image, int radius, MorphologyShape shape = MORPHOLOGY_SQUARE);
+// threshold_combiner.frag: black where image * alpha + noise * (1 - alpha) is darker than
+// the threshold, else white.
+PlanarImage ThresholdCombine(const PlanarImage& image, const PlanarImage& noise, float alpha, float threshold);
+// color_combiner.frag: white where the image is white, else the color of the texture.
+PlanarImage ColorCombine(const PlanarImage& image, const PlanarImage& texture);
+// invert.frag
+PlanarImage Invert(const PlanarImage& image);
+// mask.frag: white where the mask is black, else the image.
+PlanarImage Mask(const PlanarImage& image, const PlanarImage& mask);
+// Steps 5 to 7 of the watercolor pass (invert, blur, mask) in one linear pass: white where the
+// image is white, and inside the other (dark) shapes a gradient which is darkest at their edges,
+// from the exact euclidean distance to the nearest white pixel (Felzenszwalb/Huttenlocher).
+// The gradient is what the blur with the standard deviation edge_sigma gives at a straight edge,
+// for any edge_sigma.
+PlanarImage EdgeGradient(const PlanarImage& image, float edge_sigma);
+// The distance to the nearest white pixel from which EdgeGradient() is white.
+int EdgeGradientRadius(float edge_sigma);
+// blend.frag: mixes texture_0 and texture_1 by the alpha of texture_0.
+PlanarImage Blend(const PlanarImage& texture_0, const PlanarImage& texture_1);
+// darken.frag: multiplies the colors of the image with the grey of the shade (e.g. the result
+// of EdgeGradient()), with the given strength. The alpha of the image is kept.
+PlanarImage Darken(const PlanarImage& image, const PlanarImage& shade, float strength);
+// masked_overlay.frag: the color of texture_1 where texture_0 has the mask color, else the color
+// of texture_0. Like the uniform of the shader, the components of the mask color are taken as
+// they are (i.e. QColor(1, 1, 1) means white).
+PlanarImage MaskedOverlay(const PlanarImage& texture_0, const PlanarImage& texture_1, const QColor& mask_color);
+// MaskedOverlay() of all textures at once (the first one on top): the color of the first texture
+// which doesn't have the mask color. The textures are read row by row in one pass, and the
+// layers below are only read for the rows which still have masked pixels. The result is opaque.
+PlanarImage MaskedOverlay(const std::vector<PlanarImage>& textures, const QColor& mask_color);
+// The pixels of the rect (which must be within the image).
+PlanarImage Crop(const PlanarImage& image, const QRect& rect);
+// The region of the plane which is covered by the texture, repeated and mirrored at every edge
+// (GL_MIRRORED_REPEAT), with the texture at the origin. The texture needn't be tileable.
+PlanarImage Mirrored(const PlanarImage& texture, const QRect& region);
+
+}  // namespace cpu
+}  // namespace effects
+
+#endif // CPUPOSTPROCESS_H
@@ -3,13 +3,16 @@
 
 #include <QImage>
 #include <canvas.h>
+#include <rendersnapshot.h>
 
 namespace effects {
 
 class Effect
 {
 public:
-    virtual QImage Apply(osm::Canvas* canvas, bool offscreen) = 0;
+    // Renders the snapshot with the given canvas and applies the effect. Neither the snapshot
+    // nor the configuration of the canvas is changed.
+    virtual QImage Apply(osm::Canvas* canvas, const osm::RenderSnapshot& snapshot, bool offscreen) = 0;
     virtual ~Effect() {};
 };
 
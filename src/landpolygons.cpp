@@ -0,0 +1,423 @@
+#include "landpolygons.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace osm {
+
+namespace {
+
+const char kMagic[8] = {'O', 'S', 'M', 'L', 'A', 'N', 'D', '1'};
+
+// The grid index covers the whole world with cells of 1x1 degree.
+const int kCellsX = 360;
+const int kCellsY = 180;
+
+const int32_t kShapefileCode = 9994;
+const int32_t kShapePolygon = 5;
+const int32_t kShapePolygonZ = 15;
+const int32_t kShapePolygonM = 25;
+
+int CellX(float lon)
+{
+    return std::min(kCellsX - 1, std::max(0, static_cast<int>(std::floor(lon + 180.0f))));
+}
+
+int CellY(float lat)
+{
+    return std::min(kCellsY - 1, std::max(0, static_cast<int>(std::floor(lat + 90.0f))));
+}
+
+bool Intersects(const BoundingBox& a, const BoundingBox& b)
+{
+    return a.min_lat <= b.max_lat && b.min_lat <= a.max_lat
+        && a.min_lon <= b.max_lon && b.min_lon <= a.max_lon;
+}
+
+bool Contains(const BoundingBox& outer, const BoundingBox& inner)
+{
+    return outer.min_lat <= inner.min_lat && inner.max_lat <= outer.max_lat
+        && outer.min_lon <= inner.min_lon && inner.max_lon <= outer.max_lon;
+}
+
+// All values in the file are 4 bytes (uint32 or float32) and little endian.
+// On big endian hosts they are swapped in place.
+template <typename T>
+void SwapLittleEndian(std::vector<T>& values)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    char* bytes = reinterpret_cast<char*>(values.data());
+    for (size_t i = 0; i < values.size() * sizeof(T); i += 4) {
+        std::reverse(bytes + i, bytes + i + 4);
+    }
+#else
+    Q_UNUSED(values);
+#endif
+}
+
+template <typename T>
+void ReadArray(QFile& file, std::vector<T>& values, size_t count)
+{
+    values.resize(count);
+    qint64 bytes = static_cast<qint64>(count * sizeof(T));
+    if (bytes > 0 && file.read(reinterpret_cast<char*>(values.data()), bytes) != bytes) {
+        throw std::logic_error("Unexpected end of the land polygons file \"" + file.fileName().toStdString() + "\".");
+    }
+    SwapLittleEndian(values);
+}
+
+template <typename T>
+void WriteArray(QFile& file, const std::vector<T>& values)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    std::vector<T> swapped(values);
+    SwapLittleEndian(swapped);
+    const char* data = reinterpret_cast<const char*>(swapped.data());
+#else
+    const char* data = reinterpret_cast<const char*>(values.data());
+#endif
+    qint64 bytes = static_cast<qint64>(values.size() * sizeof(T));
+    if (bytes > 0 && file.write(data, bytes) != bytes) {
+        throw std::logic_error("Could not write the land polygons file \"" + file.fileName().toStdString() + "\".");
+    }
+}
+
+double ReadDoubleLittleEndian(const uchar* data)
+{
+    quint64 bits = qFromLittleEndian<quint64>(data);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// One step of the Sutherland-Hodgman algorithm: clips the (open) ring to the half-plane
+// where the coordinate (x if axis is 0, else y) is at least (keep_greater) or at most the limit.
+void ClipToHalfPlane(const std::vector<Point<float>>& in, std::vector<Point<float>>& out,
+                     int axis, float limit, bool keep_greater)
+{
+    out.clear();
+    if (in.empty()) {
+        return;
+    }
+    auto coordinate = [axis](const Point<float>& p) { return axis == 0 ? p.x : p.y; };
+    auto inside = [&](const Point<float>& p) {
+        return keep_greater ? coordinate(p) >= limit : coordinate(p) <= limit;
+    };
+    auto intersection = [&](const Point<float>& a, const Point<float>& b) {
+        float t = (limit - coordinate(a)) / (coordinate(b) - coordinate(a));
+        Point<float> p;
+        p.x = axis == 0 ? limit : a.x + t * (b.x - a.x);
+        p.y = axis == 0 ? a.y + t * (b.y - a.y) : limit;
+        return p;
+    };
+
+    const Point<float>* a = &in.back();
+    bool a_inside = inside(*a);
+    for (auto b = in.begin(); b != in.end(); ++b) {
+        bool b_inside = inside(*b);
+        if (b_inside != a_inside) {
+            out.push_back(intersection(*a, *b));
+        }
+        if (b_inside) {
+            out.push_back(*b);
+        }
+        a = &*b;
+        a_inside = b_inside;
+    }
+}
+
+}  // namespace
+
+void LandPolygons::Load(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::logic_error("Could not open land polygons file \"" + filename.toStdString() + "\".");
+    }
+
+    char magic[sizeof(kMagic)];
+    std::vector<uint32_t> counts;
+    if (file.read(magic, sizeof(magic)) != sizeof(magic) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::logic_error("\"" + filename.toStdString() + "\" is not a land polygons file.");
+    }
+    ReadArray(file, counts, 3);
+    qint64 expected_size = sizeof(kMagic) + 4 * (3 + static_cast<qint64>(counts[0]) + 1 + counts[1] + 1)
+            + 8 * static_cast<qint64>(counts[2]);
+    if (file.size() != expected_size) {
+        throw std::logic_error("The land polygons file \"" + filename.toStdString() + "\" is corrupt.");
+    }
+
+    Clear();
+    ReadArray(file, polygon_offsets_, static_cast<size_t>(counts[0]) + 1);
+    ReadArray(file, ring_offsets_, static_cast<size_t>(counts[1]) + 1);
+    ReadArray(file, points_, counts[2]);
+
+    bool valid = polygon_offsets_.front() == 0 && polygon_offsets_.back() == counts[1]
+            && ring_offsets_.front() == 0 && ring_offsets_.back() == counts[2]
+            && std::adjacent_find(polygon_offsets_.begin(), polygon_offsets_.end(),
+                                  std::greater_equal<uint32_t>()) == polygon_offsets_.end()
+            && std::is_sorted(ring_offsets_.begin(), ring_offsets_.end());
+    if (!valid) {
+        Clear();
+        throw std::logic_error("The land polygons file \"" + filename.toStdString() + "\" is corrupt.");
+    }
+    BuildIndex();
+}
+
+void LandPolygons::Save(const QString& filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        throw std::logic_error("Could not open land polygons file \"" + filename.toStdString() + "\" for writing.");
+    }
+
+    // The offsets are empty before anything was loaded.
+    const std::vector<uint32_t> no_offsets = {0};
+    const std::vector<uint32_t>& polygon_offsets = Empty() ? no_offsets : polygon_offsets_;
+    const std::vector<uint32_t>& ring_offsets = Empty() ? no_offsets : ring_offsets_;
+    std::vector<uint32_t> counts = {static_cast<uint32_t>(polygon_offsets.size() - 1),
+                                    static_cast<uint32_t>(ring_offsets.size() - 1),
+                                    static_cast<uint32_t>(Empty() ? 0 : points_.size())};
+    file.write(kMagic, sizeof(kMagic));
+    WriteArray(file, counts);
+    WriteArray(file, polygon_offsets);
+    WriteArray(file, ring_offsets);
+    WriteArray(file, Empty() ? std::vector<Point<float>>() : points_);
+}
+
+void LandPolygons::ImportShapefile(const QString& filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::logic_error("Could not open shapefile \"" + filename.toStdString() + "\".");
+    }
+    // The files are big, so they are mapped instead of being read.
+    const qint64 size = file.size();
+    const uchar* data = size >= 100 ? file.map(0, size) : nullptr;
+    if (data == nullptr || qFromBigEndian<qint32>(data) != kShapefileCode) {
+        throw std::logic_error("\"" + filename.toStdString() + "\" is not a shapefile.");
+    }
+    int32_t shape_type = qFromLittleEndian<qint32>(data + 32);
+    if (shape_type != kShapePolygon && shape_type != kShapePolygonZ && shape_type != kShapePolygonM) {
+        throw std::logic_error("The shapefile \"" + filename.toStdString() + "\" does not contain polygons.");
+    }
+    auto corrupt = [&filename]() {
+        return std::logic_error("The shapefile \"" + filename.toStdString() + "\" is corrupt.");
+    };
+
+    Clear();
+    polygon_offsets_.push_back(0);
+    ring_offsets_.push_back(0);
+    std::vector<int32_t> parts;
+    // Each record is: record header (big endian), shape type, box, number of parts and points,
+    // the parts (index of the first point of each ring) and the points (x, y as doubles).
+    for (qint64 pos = 100; pos + 8 <= size;) {
+        qint64 content_length = 2 * static_cast<qint64>(qFromBigEndian<qint32>(data + pos + 4));
+        const uchar* record = data + pos + 8;
+        pos += 8 + content_length;
+        if (content_length < 4 || pos > size) {
+            Clear();
+            throw corrupt();
+        }
+        if (qFromLittleEndian<qint32>(record) != shape_type) {
+            // A null shape.
+            continue;
+        }
+        int32_t parts_count = qFromLittleEndian<qint32>(record + 36);
+        int32_t points_count = qFromLittleEndian<qint32>(record + 40);
+        if (content_length < 44 || parts_count < 0 || points_count < 0
+            || 44 + 4 * static_cast<qint64>(parts_count) + 16 * static_cast<qint64>(points_count) > content_length) {
+            Clear();
+            throw corrupt();
+        }
+        if (points_.size() + points_count > std::numeric_limits<uint32_t>::max()) {
+            Clear();
+            throw std::logic_error("The shapefile \"" + filename.toStdString() + "\" has too many points.");
+        }
+        const uchar* points = record + 44 + 4 * parts_count;
+        parts.resize(parts_count + 1);
+        for (int32_t i = 0; i < parts_count; ++i) {
+            parts[i] = qFromLittleEndian<qint32>(record + 44 + 4 * i);
+        }
+        parts[parts_count] = points_count;
+
+        bool polygon_open = false;
+        for (int32_t part = 0; part < parts_count; ++part) {
+            if (parts[part] < 0 || parts[part + 1] > points_count || parts[part + 1] - parts[part] < 4) {
+                continue;
+            }
+            double twice_area = 0;
+            size_t first = points_.size();
+            for (int32_t i = parts[part]; i < parts[part + 1]; ++i) {
+                Point<float> p;
+                p.x = ReadDoubleLittleEndian(points + 16 * i);
+                p.y = ReadDoubleLittleEndian(points + 16 * i + 8);
+                if (i > parts[part]) {
+                    const Point<float>& prev = points_.back();
+                    twice_area += static_cast<double>(prev.x) * p.y - static_cast<double>(p.x) * prev.y;
+                }
+                points_.push_back(p);
+            }
+            if (!(points_[first] == points_.back())) {
+                points_.push_back(points_[first]);
+            }
+            // Clockwise (with y up) is an outer ring; a counterclockwise one is a hole of the last
+            // outer ring (or else it is taken as an outer ring).
+            if (twice_area <= 0 && polygon_open) {
+                polygon_offsets_.push_back(ring_offsets_.size() - 1);
+            }
+            polygon_open = true;
+            ring_offsets_.push_back(points_.size());
+        }
+        if (polygon_open) {
+            polygon_offsets_.push_back(ring_offsets_.size() - 1);
+        }
+    }
+    file.unmap(const_cast<uchar*>(data));
+    BuildIndex();
+}
+
+void LandPolygons::Clear()
+{
+    points_.clear();
+    ring_offsets_.clear();
+    polygon_offsets_.clear();
+    ring_bounds_.clear();
+    cell_offsets_.clear();
+    cell_polygons_.clear();
+}
+
+void LandPolygons::BuildIndex()
+{
+    ring_bounds_.clear();
+    ring_bounds_.reserve(ring_offsets_.empty() ? 0 : ring_offsets_.size() - 1);
+    for (size_t ring = 0; ring + 1 < ring_offsets_.size(); ++ring) {
+        BoundingBox bounds = {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(),
+                              std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()};
+        for (uint32_t i = ring_offsets_[ring]; i < ring_offsets_[ring + 1]; ++i) {
+            bounds.min_lat = std::min(bounds.min_lat, points_[i].y);
+            bounds.max_lat = std::max(bounds.max_lat, points_[i].y);
+            bounds.min_lon = std::min(bounds.min_lon, points_[i].x);
+            bounds.max_lon = std::max(bounds.max_lon, points_[i].x);
+        }
+        ring_bounds_.push_back(bounds);
+    }
+
+    // Every polygon is put into all cells which its bounds (the bounds of the outer ring) overlap.
+    // The cells are stored contiguously: count first, then fill.
+    cell_offsets_.assign(kCellsX * kCellsY + 1, 0);
+    for (size_t polygon = 0; polygon < PolygonsCount(); ++polygon) {
+        const BoundingBox& bounds = ring_bounds_[polygon_offsets_[polygon]];
+        for (int y = CellY(bounds.min_lat); y <= CellY(bounds.max_lat); ++y) {
+            for (int x = CellX(bounds.min_lon); x <= CellX(bounds.max_lon); ++x) {
+                ++cell_offsets_[y * kCellsX + x + 1];
+            }
+        }
+    }
+    for (size_t i = 1; i < cell_offsets_.size(); ++i) {
+        cell_offsets_[i] += cell_offsets_[i - 1];
+    }
+    cell_polygons_.resize(cell_offsets_.back());
+    std::vector<uint32_t> fill(cell_offsets_.begin(), cell_offsets_.end() - 1);
+    for (size_t polygon = 0; polygon < PolygonsCount(); ++polygon) {
+        const BoundingBox& bounds = ring_bounds_[polygon_offsets_[polygon]];
+        for (int y = CellY(bounds.min_lat); y <= CellY(bounds.max_lat); ++y) {
+            for (int x = CellX(bounds.min_lon); x <= CellX(bounds.max_lon); ++x) {
+                cell_polygons_[fill[y * kCellsX + x]++] = polygon;
+            }
+        }
+    }
+    qDebug() << "Indexed" << PolygonsCount() << "land polygons with" << points_.size() << "points";
+}
+
+std::vector<uint32_t> LandPolygons::Query(const BoundingBox& bbox) const
+{
+    std::vector<uint32_t> polygons;
+    if (Empty()) {
+        return polygons;
+    }
+    for (int y = CellY(bbox.min_lat); y <= CellY(bbox.max_lat); ++y) {
+        for (int x = CellX(bbox.min_lon); x <= CellX(bbox.max_lon); ++x) {
+            uint32_t cell = y * kCellsX + x;
+            for (uint32_t i = cell_offsets_[cell]; i < cell_offsets_[cell + 1]; ++i) {
+                if (Intersects(ring_bounds_[polygon_offsets_[cell_polygons_[i]]], bbox)) {
+                    polygons.push_back(cell_polygons_[i]);
+                }
+            }
+        }
+    }
+    // A polygon is found in each cell it overlaps.
+    std::sort(polygons.begin(), polygons.end());
+    polygons.erase(std::unique(polygons.begin(), polygons.end()), polygons.end());
+    return polygons;
+}
+
+std::shared_ptr<PolygonRings> LandPolygons::Clip(const BoundingBox& bbox) const
+{
+    auto rings = std::make_shared<PolygonRings>();
+    rings->width = 1;
+    rings->height = 1;
+    rings->ring_offsets.push_back(0);
+    rings->polygon_offsets.push_back(0);
+    if (bbox.max_lat <= bbox.min_lat || bbox.max_lon <= bbox.min_lon) {
+        return rings;
+    }
+
+    // The same mapping as in the OceanLandmassFactory.
+    const double scale_x = 1.0 / (static_cast<double>(bbox.max_lon) - bbox.min_lon);
+    const double scale_y = 1.0 / (static_cast<double>(bbox.max_lat) - bbox.min_lat);
+    std::vector<Point<float>> ring;
+    std::vector<Point<float>> clipped;
+    std::vector<uint32_t> polygons = Query(bbox);
+    for (auto it = polygons.begin(); it != polygons.end(); ++it) {
+        size_t rings_count = rings->RingsCount();
+        for (uint32_t r = polygon_offsets_[*it]; r < polygon_offsets_[*it + 1]; ++r) {
+            bool outer = r == polygon_offsets_[*it];
+            if (!Intersects(ring_bounds_[r], bbox)) {
+                if (outer) {
+                    break;
+                }
+                continue;
+            }
+
+            // The rings are stored closed; the clipping works on open rings.
+            ring.clear();
+            for (uint32_t i = ring_offsets_[r]; i + 1 < ring_offsets_[r + 1]; ++i) {
+                Point<float> p;
+                p.x = (points_[i].x - bbox.min_lon) * scale_x;
+                p.y = 1.0 - (points_[i].y - bbox.min_lat) * scale_y;
+                ring.push_back(p);
+            }
+            if (!Contains(bbox, ring_bounds_[r])) {
+                ClipToHalfPlane(ring, clipped, 0, 0, true);
+                ClipToHalfPlane(clipped, ring, 0, 1, false);
+                ClipToHalfPlane(ring, clipped, 1, 0, true);
+                ClipToHalfPlane(clipped, ring, 1, 1, false);
+            }
+            if (ring.size() < 3) {
+                if (outer) {
+                    break;
+                }
+                continue;
+            }
+            rings->points.insert(rings->points.end(), ring.begin(), ring.end());
+            rings->points.push_back(ring.front());
+            rings->ring_offsets.push_back(rings->points.size());
+        }
+        if (rings->RingsCount() > rings_count) {
+            rings->polygon_offsets.push_back(rings->RingsCount());
+        }
+    }
+    return rings;
+}
+
+}  // namespace osm
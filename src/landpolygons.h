@@ -0,0 +1,71 @@
+#ifndef LANDPOLYGONS_H
+#define LANDPOLYGONS_H
+
+#include "polygonobjects.h"
+#include "types.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace osm
+{
+
+// Precomputed land polygons (i.e. the OSM land polygons, which are generated from the
+// complete coastline of the planet), as an alternative to connecting the coastlines of an extract.
+// The polygons are kept in lat/lon and indexed by a grid of 1x1 degree cells, so that the
+// ocean and landmass of any bbox are an index query and a clip.
+//
+// The polygons are stored in a simple binary file (all values little endian):
+//   char[8]  magic "OSMLAND1"
+//   uint32   number of polygons P
+//   uint32   number of rings R
+//   uint32   number of points N
+//   uint32   polygon offsets [P + 1] (index of the first ring; the first ring is the outer ring)
+//   uint32   ring offsets [R + 1] (index of the first point; the rings are closed)
+//   float32  points [N] (lon, lat)
+// Such a file is written by Save(), i.e. after importing the polygons of a shapefile once.
+class LandPolygons
+{
+public:
+    explicit LandPolygons() = default;
+
+    // Throws an std::logic_error exception in case of any error.
+    void Load(const QString& filename);
+    // Throws an std::logic_error exception in case of any error.
+    void Save(const QString& filename) const;
+    // Reads the polygons of an ESRI shapefile (.shp) in WGS84 coordinates. The rings are grouped
+    // into polygons by their orientation (outer rings are clockwise, holes counterclockwise).
+    // Throws an std::logic_error exception in case of any error.
+    void ImportShapefile(const QString& filename);
+    void Clear();
+
+    bool Empty() const { return polygon_offsets_.size() < 2; }
+    size_t PolygonsCount() const { return Empty() ? 0 : polygon_offsets_.size() - 1; }
+
+    // Returns the polygons which intersect the bbox, clipped to it and mapped to the unit square
+    // of the bbox (x to the right, y down; like the polygons of the OceanLandmassFactory).
+    std::shared_ptr<PolygonRings> Clip(const BoundingBox& bbox) const;
+
+private:
+    // Computes the bounds of the rings and builds the grid index.
+    void BuildIndex();
+    // Returns the indices of the polygons whose bounds intersect the bbox (ascending).
+    std::vector<uint32_t> Query(const BoundingBox& bbox) const;
+
+    // x = lon, y = lat.
+    std::vector<Point<float>> points_;
+    std::vector<uint32_t> ring_offsets_;
+    std::vector<uint32_t> polygon_offsets_;
+    std::vector<BoundingBox> ring_bounds_;
+
+    // The polygons of grid cell i are [cell_offsets_[i], cell_offsets_[i+1]) in cell_polygons_.
+    std::vector<uint32_t> cell_offsets_;
+    std::vector<uint32_t> cell_polygons_;
+};
+
+}  // namespace osm
+
+#endif // LANDPOLYGONS_H
@@ -2,18 +2,26 @@
 
 #include <QDebug>
 #include <QElapsedTimer>
+#include <QCheckBox>
+#include <QComboBox>
 #include <QFileDialog>
 #include <QGridLayout>
 #include <QHBoxLayout>
 #include <QKeyEvent>
 #include <QPushButton>
+#include <QSpinBox>
 #include <QStandardPaths>
 #include <QVBoxLayout>
 
+#include "coastlinerasterizer.h"
 #include "constants.h"
-#include "oceanlandmassfactory.h"
+#include "noisecache.h"
+#include "polygonobjects.h"
 #include "utils.h"
 
+#include <memory>
+#include <stdexcept>
+
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent),
       watercolor_effect_(nullptr),
@@ -22,7 +30,8 @@ MainWindow::MainWindow(QWidget* parent)
       canvas_pm_(nullptr),
       map_data_(nullptr),
       current_config_widget_(nullptr),
-      render_status_(RenderStatus::NONE) {
+      render_status_(RenderStatus::NONE),
+      coastline_mode_(CoastlineMode::POLYGONS) {
   SetupUi();
   SetupObjectsRepository();
   SetupWatercolorEffect();
@@ -62,6 +71,10 @@ void MainWindow::SetupUi() {
   QPushButton* btn_open = new QPushButton(tr("Open OSM File"));
   QObject::connect(btn_open, &QPushButton::clicked, this,
                    &MainWindow::OpenFile);
+  QPushButton* btn_open_land_polygons =
+      new QPushButton(tr("Open Land Polygons"));
+  QObject::connect(btn_open_land_polygons, &QPushButton::clicked, this,
+                   &MainWindow::OpenLandPolygons);
   QPushButton* btn_render_bw = new QPushButton(tr("Render B/W Map"));
   QObject::connect(btn_render_bw, &QPushButton::clicked, this, [this] {
     RenderMap(ChangeCanvasTo(
@@ -80,9 +93,54 @@ void MainWindow::SetupUi() {
 
   QVBoxLayout* button_layout = new QVBoxLayout();
   button_layout->addWidget(btn_open);
+  button_layout->addWidget(btn_open_land_polygons);
+  QComboBox* coastline_mode = new QComboBox();
+  coastline_mode->addItem(tr("Coastlines: Polygons"), CoastlineMode::POLYGONS);
+  coastline_mode->addItem(tr("Coastlines: Flood Fill"),
+                          CoastlineMode::FLOOD_FILL);
+  QObject::connect(
+      coastline_mode, QOverload<int>::of(&QComboBox::currentIndexChanged),
+      this, [this, coastline_mode](int index) {
+        coastline_mode_ = static_cast<CoastlineMode>(
+            coastline_mode->itemData(index).toInt());
+        GenerateCoastlines();
+        ObjectsConfigUpdated();
+      });
+  button_layout->addWidget(coastline_mode);
   button_layout->addWidget(btn_render_bw);
   button_layout->addWidget(btn_render_pm);
   button_layout->addWidget(btn_render_watercolor_effect);
+  QComboBox* watercolor_backend = new QComboBox();
+  watercolor_backend->addItem(tr("Watercolor: OpenGL"),
+                              effects::RenderPass::BACKEND_GL);
+  watercolor_backend->addItem(tr("Watercolor: CPU"),
+                              effects::RenderPass::BACKEND_CPU);
+  QObject::connect(
+      watercolor_backend, QOverload<int>::of(&QComboBox::currentIndexChanged),
+      this, [this, watercolor_backend](int index) {
+        watercolor_effect_->Backend(static_cast<effects::RenderPass::BACKEND>(
+            watercolor_backend->itemData(index).toInt()));
+      });
+  button_layout->addWidget(watercolor_backend);
+  // The tiles of the CPU backend (0: the whole canvas at once).
+  QSpinBox* watercolor_tile_size = new QSpinBox();
+  watercolor_tile_size->setPrefix(tr("Watercolor tiles: "));
+  watercolor_tile_size->setRange(0, 4096);
+  watercolor_tile_size->setSingleStep(64);
+  QObject::connect(watercolor_tile_size,
+                   QOverload<int>::of(&QSpinBox::valueChanged), this,
+                   [this](int size) { watercolor_effect_->TileSize(size); });
+  button_layout->addWidget(watercolor_tile_size);
+  // Keeps the noise images between the sessions (up to 1 GB).
+  QCheckBox* noise_on_disk = new QCheckBox(tr("Keep the noise on disk"));
+  QObject::connect(noise_on_disk, &QCheckBox::toggled, this, [](bool checked) {
+    effects::NoiseCache::Instance().Directory(
+        checked ? QStandardPaths::writableLocation(
+                      QStandardPaths::CacheLocation) +
+                      "/noise"
+                : QString());
+  });
+  button_layout->addWidget(noise_on_disk);
   canvas_ = new osm::Canvas(300, 300, &objects_repository_);  //, this);
   canvas_list_.push_back(canvas_);
   canvas_container_ = new QVBoxLayout;
@@ -266,44 +324,44 @@ void MainWindow::SetupWatercolorEffect() {
       new effects::WatercolorEffectConfiguration(
           osm::kBuildingsName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/brown_42.jpg"));
+          ":/textures/brown_42.jpg");
   watercolor_effect_configurations_[osm::kHighwaysName] =
       new effects::WatercolorEffectConfiguration(
           osm::kHighwaysName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/orange_11.jpg"));
+          ":/textures/orange_11.jpg");
   watercolor_effect_configurations_[osm::kHighwaysExtName] =
       new effects::WatercolorEffectConfiguration(
           osm::kHighwaysExtName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/orange_10.jpg"));
+          ":/textures/orange_10.jpg");
   watercolor_effect_configurations_[osm::kWaterwaysName] =
       new effects::WatercolorEffectConfiguration(
           osm::kWaterwaysName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/blue_24.jpg"));
+          ":/textures/blue_24.jpg");
 
   watercolor_effect_configurations_[osm::kDevelopedLandName] =
       new effects::WatercolorEffectConfiguration(
           osm::kDevelopedLandName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/gray_04.jpg"));
+          ":/textures/gray_04.jpg");
   watercolor_effect_configurations_[osm::kGreenlandName] =
       new effects::WatercolorEffectConfiguration(
           osm::kGreenlandName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/green_09.jpg"));
+          ":/textures/green_09.jpg");
 
   watercolor_effect_configurations_[osm::kOceanName] =
       new effects::WatercolorEffectConfiguration(
           osm::kOceanName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/blue_01.jpg"));
+          ":/textures/blue_01.jpg");
   watercolor_effect_configurations_[osm::kLandmassName] =
       new effects::WatercolorEffectConfiguration(
           osm::kLandmassName, noise_scale_factor, final_blend_alpha,
           threshold_combiner_alpha, threshold_combiner_threshold,
-          QImage(":/textures/brown_40.jpg"));
+          ":/textures/brown_40.jpg");
 
   watercolor_effect_ =
       new effects::WatercolorEffect(watercolor_effect_configurations_);
@@ -320,6 +378,8 @@ void MainWindow::OpenFile() {
       objects_repository_.Objects(*it)->Clear();
     }
 
+    // The factory refers to the nodes of the old map data.
+    ocean_landmass_factory_.reset();
     if (map_data_ != nullptr) {
       delete map_data_;
     }
@@ -331,11 +391,21 @@ void MainWindow::OpenFile() {
       }
     });
 
+    if (osm::kSortWaysSpatially) {
+      map_data_->SortSpatially();
+      for (auto it = objects_repository_.OrderedObjectsNames()->begin();
+           it != objects_repository_.OrderedObjectsNames()->end(); ++it) {
+        objects_repository_.Objects(*it)->SortSpatially(map_data_->Bounds());
+      }
+    }
+
     for (auto it = canvas_list_.begin(); it != canvas_list_.end(); ++it) {
       (*it)->MapData(map_data_);
       (*it)->ResetTransformation();  // Not sure if I really want this here...
     }
 
+    ocean_landmass_factory_.reset(new osm::OceanLandmassFactory(
+        objects_repository_.Objects(osm::kCoastlinesName)));
     GenerateCoastlines();
 
     // try {
@@ -351,6 +421,43 @@ void MainWindow::OpenFile() {
   }
 }
 
+void MainWindow::OpenLandPolygons() {
+  const QString homefolder =
+      QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
+  QString filename = QFileDialog::getOpenFileName(
+      this, tr("Open Land Polygons"), homefolder,
+      tr("Land Polygons (*.landpolygons *.shp)"));
+  if (filename.isEmpty()) {
+    return;
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  try {
+    if (filename.endsWith(".shp", Qt::CaseInsensitive)) {
+      land_polygons_.ImportShapefile(filename);
+      // Next time the binary file can be opened, which is much faster.
+      QString converted = filename.left(filename.size() - 4) + ".landpolygons";
+      try {
+        land_polygons_.Save(converted);
+        qDebug() << "Saved the land polygons to" << converted;
+      } catch (const std::logic_error& e) {
+        qDebug() << e.what();
+      }
+    } else {
+      land_polygons_.Load(filename);
+    }
+  } catch (const std::logic_error& e) {
+    qDebug() << e.what();
+    land_polygons_.Clear();
+  }
+  qDebug() << "Loaded" << land_polygons_.PolygonsCount() << "land polygons in"
+           << timer.elapsed() << "ms";
+
+  GenerateCoastlines();
+  ObjectsConfigUpdated();
+}
+
 void MainWindow::RenderMap(osm::Canvas* canvas) {
   // canvas_->enable_all_collections();
 
@@ -362,7 +469,7 @@ void MainWindow::RenderMap(osm::Canvas* canvas) {
       osm::utils::GetAspectRatio(map_data_->MinLat(), map_data_->MaxLat(),
                                  map_data_->MinLon(), map_data_->MaxLon());
   canvas->setFixedSize(osm::Canvas::kMaxHeight * a, osm::Canvas::kMaxHeight);
-  QImage image = canvas->RenderToImage();
+  QImage image = canvas->RenderToRaster(objects_repository_.Snapshot());
   canvas->ShowImage(image);
 
   render_status_ = RenderStatus::MAP;
@@ -379,7 +486,8 @@ void MainWindow::RenderEffect(effects::Effect* effect) {
   current_canvas_->setFixedSize(osm::Canvas::kMaxHeight * a,
                                 osm::Canvas::kMaxHeight);
 
-  QImage effect_img = effect->Apply(current_canvas_, true);
+  QImage effect_img =
+      effect->Apply(current_canvas_, objects_repository_.Snapshot(), true);
   current_canvas_->ShowImage(effect_img);
 
   render_status_ = RenderStatus::EFFECT;
@@ -451,28 +559,77 @@ void MainWindow::ObjectsConfigUpdated() {
 void MainWindow::WatercolorEffectConfigUpdated() {}
 
 void MainWindow::GenerateCoastlines() {
-  float a =
-      osm::utils::GetAspectRatio(map_data_->MinLat(), map_data_->MaxLat(),
-                                 map_data_->MinLon(), map_data_->MaxLon());
-  int w = osm::Canvas::kMaxHeight * a;
-  int h = osm::Canvas::kMaxHeight;
+  if (map_data_ == nullptr) {
+    return;
+  }
+  osm::BoundingBox bbox = {.min_lat = map_data_->MinLat(),
+                           .max_lat = map_data_->MaxLat(),
+                           .min_lon = map_data_->MinLon(),
+                           .max_lon = map_data_->MaxLon()};
+  std::shared_ptr<osm::PolygonRings> rings;
+  std::shared_ptr<osm::CoastlineRasterizer> land_mask;
+  if (!land_polygons_.Empty()) {
+    // The precomputed land polygons replace the coastlines of the extract.
+    QElapsedTimer timer;
+    timer.start();
+    rings = land_polygons_.Clip(bbox);
+    qDebug() << "Clipped" << rings->PolygonsCount() << "land polygons in"
+             << timer.elapsed() << "ms";
+  } else if (coastline_mode_ == CoastlineMode::FLOOD_FILL &&
+             ocean_landmass_factory_) {
+    // Only the chains are needed; the land is classified when the mask is
+    // rasterized for the canvas size.
+    ocean_landmass_factory_->BuildChains();
+    land_mask = std::make_shared<osm::CoastlineRasterizer>(
+        ocean_landmass_factory_->WorkSetWays(), bbox);
+  } else {
+    rings = ConnectCoastlines(bbox);
+  }
+  if (!rings && !land_mask) {
+    return;
+  }
+  if (rings) {
+    rings->Triangulate();
+  }
+
+  // Now "rings" (or "land_mask") contains the newly created landmass.
+
+  osm::PolygonObjects* obj_ocean = dynamic_cast<osm::PolygonObjects*>(
+      objects_repository_.Objects(osm::kOceanName));
+  if (obj_ocean == nullptr) {
+    obj_ocean =
+        new osm::PolygonObjects(osm::kOceanName, osm::ObjectsTypes::OCEAN);
+    objects_repository_.AddObjects(osm::kOceanName, obj_ocean);
+  }
+  obj_ocean->Rings(rings);
+  obj_ocean->LandMask(land_mask);
+
+  osm::PolygonObjects* obj_landmass = dynamic_cast<osm::PolygonObjects*>(
+      objects_repository_.Objects(osm::kLandmassName));
+  if (obj_landmass == nullptr) {
+    obj_landmass = new osm::PolygonObjects(osm::kLandmassName,
+                                           osm::ObjectsTypes::LANDMASS);
+    objects_repository_.AddObjects(osm::kLandmassName, obj_landmass);
+  }
+  obj_landmass->Rings(rings);
+  obj_landmass->LandMask(land_mask);
+}
+
+std::shared_ptr<osm::PolygonRings> MainWindow::ConnectCoastlines(
+    const osm::BoundingBox& bbox) {
+  if (!ocean_landmass_factory_) {
+    return nullptr;
+  }
 
   qDebug() << "Start generating ocean and landmass polygons...";
   QElapsedTimer timer;
   timer.start();
   // auto start = std::chrono::high_resolution_clock::now();
-  osm::Objects* coastlines = objects_repository_.Objects(osm::kCoastlinesName);
-  float scale = 1.0f;
-  int diff_w = (w - w * scale) / 2.0f;
-  int diff_h = (h - h * scale) / 2.0f;
-  osm::OceanLandmassFactory factory(coastlines, w, h, scale,
-                                    {.x = diff_w, .y = diff_h},
-                                    {.min_lat = map_data_->MinLat(),
-                                     .max_lat = map_data_->MaxLat(),
-                                     .min_lon = map_data_->MinLon(),
-                                     .max_lon = map_data_->MaxLon()});
-  factory.Build();
-  auto coastline_polygons = factory.CoastlinePolygon();
+  // The coastlines are only connected by the first build; the polygons are in the
+  // unit square of the bbox, so they are valid for every canvas size.
+  osm::OceanLandmassFactory& factory = *ocean_landmass_factory_;
+  factory.Build(bbox);
+  const auto& coastline_polygons = factory.CoastlinePolygon();
 
   /*debug_widget_->setFixedSize(w, h);
   QPainter painter(debug_widget_);
@@ -517,55 +674,28 @@ void MainWindow::GenerateCoastlines() {
   // qDebug() << "Done -> took " << elapsed.count() << "s\n";
   qDebug() << "Done -> took " << timer.elapsed() << "ms\n";
 
-  std::vector<osm::Way*> ways;
-  // Now generate nodes and ways and add everything to an OsmObjCollection
-  // instance.
+  // Copy all polygons into one contiguous block. Ocean and landmass share it.
+  size_t points_count = 0;
   for (auto it = coastline_polygons.begin(); it != coastline_polygons.end();
        ++it) {
-    osm::Way* way = new osm::Way;
-    way->is_closed = true;
-    ways.push_back(way);
-    std::vector<osm::Point<double>> polygon = *it;
-    int node_idx = 0;
-    for (auto it_nodes = polygon.begin() /*+4*/; it_nodes != polygon.end();
-         ++it_nodes, ++node_idx) {
-      osm::Node* node = new osm::Node;
-      node->lat = it_nodes->lat;
-      node->lon = it_nodes->lon;
-      node->x = it_nodes->x;
-      node->y = h - it_nodes->y;
-      way->nodes.push_back(node);
-      // if (it_nodes <= polygon.begin()+10 || it_nodes >= polygon.end()-10) {
-      //     qDebug() << node_idx << ":" << it_nodes->x << "," << it_nodes->y;
-      // }
-    }
-    /*osm::Node* node = new osm::Node;
-    node->lat = polygon.at(0).lat;
-    node->lon = polygon.at(0).lon;
-    node->x = polygon.at(0).x;
-    node->y = h - polygon.at(0).y;
-    way->nodes.push_back(node);*/
-  }
-
-  // Now "ways" contains all the newly created coastline polygons (which is the
-  // landmass).
-
-  osm::Objects* obj_ocean = objects_repository_.Objects(osm::kOceanName);
-  if (obj_ocean == nullptr) {
-    obj_ocean = new osm::Objects(osm::kOceanName, {}, osm::ObjectsTypes::OCEAN);
-    objects_repository_.AddObjects(osm::kOceanName, obj_ocean);
-  } else {
-    obj_ocean->Clear();
+    points_count += it->size();
   }
-  obj_ocean->Ways(ways);
-
-  osm::Objects* obj_landmass = objects_repository_.Objects(osm::kLandmassName);
-  if (obj_landmass == nullptr) {
-    obj_landmass =
-        new osm::Objects(osm::kLandmassName, {}, osm::ObjectsTypes::LANDMASS);
-    objects_repository_.AddObjects(osm::kLandmassName, obj_landmass);
-  } else {
-    obj_landmass->Clear();
+  auto rings = std::make_shared<osm::PolygonRings>();
+  rings->width = 1;
+  rings->height = 1;
+  rings->points.reserve(points_count);
+  rings->ring_offsets.reserve(coastline_polygons.size() + 1);
+  rings->polygon_offsets.reserve(coastline_polygons.size() + 1);
+  rings->ring_offsets.push_back(0);
+  rings->polygon_offsets.push_back(0);
+  for (auto it = coastline_polygons.begin(); it != coastline_polygons.end();
+       ++it) {
+    for (auto it_points = it->begin(); it_points != it->end(); ++it_points) {
+      rings->points.push_back({.x = static_cast<float>(it_points->x),
+                               .y = static_cast<float>(it_points->y)});
+    }
+    rings->ring_offsets.push_back(rings->points.size());
+    rings->polygon_offsets.push_back(rings->ring_offsets.size() - 1);
   }
-  obj_landmass->Ways(ways);
+  return rings;
 }
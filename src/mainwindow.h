@@ -3,6 +3,8 @@
 
 #include "canvas.h"
 #include "canvaspietmondrien.h"
+#include "landpolygons.h"
+#include "oceanlandmassfactory.h"
 #include "objectsrepository.h"
 #include "parser.h"
 #include "watercoloreffect.h"
@@ -14,6 +16,8 @@
 #include <QMainWindow>
 #include <QVBoxLayout>
 
+#include <memory>
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -30,6 +34,7 @@ private:
     void SetupObjectsRepository();
     void SetupWatercolorEffect();
     void OpenFile();
+    void OpenLandPolygons();
     void RenderMap(osm::Canvas* canvas);
     void RenderEffect(effects::Effect* effect);
     //void Save();
@@ -38,7 +43,9 @@ private:
     void ObjectsConfigUpdated();
     void WatercolorEffectConfigUpdated();
 
+    // Generates the ocean and landmass, from the land polygons if they are loaded.
     void GenerateCoastlines();
+    std::shared_ptr<osm::PolygonRings> ConnectCoastlines(const osm::BoundingBox& bbox);
 
     //QOpenGLWidget* debug_widget_;
     QHash<QString, effects::WatercolorEffectConfiguration*> watercolor_effect_configurations_;
@@ -50,6 +57,9 @@ private:
     QVBoxLayout* canvas_container_;
     osm::Parser parser_;
     osm::MapData* map_data_;
+    // Keeps the connected coastlines of the current map data.
+    std::unique_ptr<osm::OceanLandmassFactory> ocean_landmass_factory_;
+    osm::LandPolygons land_polygons_;
     osm::ObjectsRepository objects_repository_;
     QListWidget* objects_list_;
     QVBoxLayout* objects_config_layout_;
@@ -59,6 +69,9 @@ private:
 
     enum RenderStatus { NONE, MAP, EFFECT };
     RenderStatus render_status_;
+    // How the ocean and landmass are generated from the coastlines (unless land polygons are loaded).
+    enum CoastlineMode { POLYGONS, FLOOD_FILL };
+    CoastlineMode coastline_mode_;
 };
 
 #endif // MAINWINDOW_H
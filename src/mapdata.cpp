@@ -1,7 +1,12 @@
 #include "mapdata.h"
+#include "utils.h"
 
 #include <QDebug>
 
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
 namespace osm {
 
 MapData::MapData()
@@ -55,4 +60,49 @@ float MapData::MaxLon()
     return max_lon_;
 }
 
+BoundingBox MapData::Bounds()
+{
+    return {.min_lat = min_lat_, .max_lat = max_lat_, .min_lon = min_lon_, .max_lon = max_lon_};
+}
+
+void MapData::SortSpatially()
+{
+    BoundingBox bbox = Bounds();
+    utils::SortWaysByHilbertIndex(ways_, bbox);
+
+    // Move the nodes into one block, in the order of the first way referencing them.
+    // The storage is reserved upfront for every allocated node (the ways can reference nodes
+    // which were replaced in nodes_, e.g. by a later node with the same id), so the pointers
+    // into it stay valid.
+    std::vector<Node> storage;
+    storage.reserve(nodes_for_deletion_.size() + node_storage_.size());
+    std::unordered_map<Node*, Node*> relocated;
+    relocated.reserve(nodes_.size());
+    auto relocate = [&storage, &relocated](Node* node) -> Node* {
+        if (node == nullptr) {
+            return nullptr;
+        }
+        auto it = relocated.find(node);
+        if (it != relocated.end()) {
+            return it->second;
+        }
+        storage.push_back(std::move(*node));
+        relocated[node] = &storage.back();
+        return &storage.back();
+    };
+    for (auto it = ways_.begin(); it != ways_.end(); ++it) {
+        for (auto it_nodes = (*it)->nodes.begin(); it_nodes != (*it)->nodes.end(); ++it_nodes) {
+            *it_nodes = relocate(*it_nodes);
+        }
+    }
+    // Nodes which are not part of any way go to the end.
+    for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
+        it->second = relocate(it->second);
+    }
+
+    qDeleteAll(nodes_for_deletion_);
+    nodes_for_deletion_.clear();
+    node_storage_.swap(storage);
+}
+
 }  // namespace osm
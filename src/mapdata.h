@@ -23,6 +23,12 @@ public:
     float MaxLat();
     float MinLon();
     float MaxLon();
+    BoundingBox Bounds();
+
+    // Sorts the ways by the Hilbert index of their bbox centroid and moves the nodes
+    // into one contiguous block in the order in which the sorted ways reference them.
+    // Node pointers change, but all ways and the id lookup are updated accordingly.
+    void SortSpatially();
 
 private:
     float min_lon_;
@@ -32,6 +38,7 @@ private:
     std::vector<Way*> ways_;
     std::map<std::string, Node*> nodes_;
     std::vector<Node*> nodes_for_deletion_;
+    std::vector<Node> node_storage_;  // Used instead of nodes_for_deletion_ after SortSpatially().
     std::vector<Tag*> tags_for_deletion_;
     Point<float> min_xy_;
     Point<float> max_xy_;
@@ -0,0 +1,142 @@
+#include "noisecache.h"
+
+#include "qnoise.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+
+#include <algorithm>
+
+namespace effects {
+
+bool NoiseCache::Key::operator==(const Key& other) const
+{
+    return region == other.region && world_width == other.world_width && scale_factor == other.scale_factor &&
+           seed == other.seed && octaves == other.octaves;
+}
+
+QString NoiseCache::Key::FileName() const
+{
+    return QString("noise_%1x%2+%3+%4_%5_%6_%7_%8.pgm").arg(region.width()).arg(region.height())
+            .arg(region.x()).arg(region.y()).arg(world_width)
+            .arg(scale_factor, 0, 'g', 17).arg(seed).arg(octaves);
+}
+
+uint qHash(const NoiseCache::Key& key, uint seed)
+{
+    seed = ::qHash(key.region.x(), seed);
+    seed = ::qHash(key.region.y(), seed) ^ (seed << 1);
+    seed = ::qHash(key.region.width(), seed) ^ (seed << 1);
+    seed = ::qHash(key.region.height(), seed) ^ (seed << 1);
+    seed = ::qHash(key.world_width, seed) ^ (seed << 1);
+    seed = ::qHash(key.scale_factor, seed) ^ (seed << 1);
+    seed = ::qHash(static_cast<qint64>(key.seed), seed) ^ (seed << 1);
+    return ::qHash(key.octaves, seed) ^ (seed << 1);
+}
+
+NoiseCache& NoiseCache::Instance()
+{
+    static NoiseCache cache;
+    return cache;
+}
+
+NoiseCache::NoiseCache(int max_megabytes) : planes_(max_megabytes * 1024), directory_max_bytes_(0)
+{
+}
+
+QImage NoiseCache::Noise(const QRect& region, int world_width, double scale_factor, int64_t seed, int octaves)
+{
+    const PlanarImage planes = Planes(region, world_width, scale_factor, seed, octaves);
+    QImage image(planes.Width(), planes.Height(), QImage::Format_Grayscale8);
+    for (int y = 0; y < image.height(); ++y) {
+        std::copy(planes.Plane(0) + static_cast<size_t>(y) * planes.Width(),
+                  planes.Plane(0) + static_cast<size_t>(y + 1) * planes.Width(), image.scanLine(y));
+    }
+    return image;
+}
+
+PlanarImage NoiseCache::Planes(const QRect& region, int world_width, double scale_factor, int64_t seed, int octaves)
+{
+    const Key key = {region, world_width, scale_factor, seed, octaves};
+    QString path;
+    qint64 max_bytes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (PlanarImage* planes = planes_.object(key)) {
+            return *planes;
+        }
+        if (!directory_.isEmpty()) {
+            path = QDir(directory_).filePath(key.FileName());
+        }
+        max_bytes = directory_max_bytes_;
+    }
+
+    // Not locked, so that the layers generate their noise in parallel (two threads which want
+    // the same image may both generate it).
+    QImage image;
+    if (!path.isEmpty() && QFile::exists(path)) {
+        image = QImage(path).convertToFormat(QImage::Format_Grayscale8);
+        if (image.size() != region.size()) {
+            image = QImage();
+        } else {
+            // The files are trimmed by the time of their last use.
+            QFile file(path);
+            if (file.open(QIODevice::ReadWrite)) {
+                file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+            }
+        }
+    }
+    if (image.isNull()) {
+        image = QNoise::create_noise_image(region, world_width, scale_factor, octaves, seed);
+        if (!path.isEmpty()) {
+            if (QDir().mkpath(QFileInfo(path).path()) && image.save(path, "PGM")) {
+                TrimDirectory(QFileInfo(path).path(), max_bytes);
+            } else {
+                qDebug() << "Can't save the noise image" << path;
+            }
+        }
+    }
+    const PlanarImage planes = PlanarImage::FromImage(image);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    planes_.insert(key, new PlanarImage(planes), std::max<size_t>(1, planes.PixelsCount() / 1024));
+    return planes;
+}
+
+void NoiseCache::Directory(const QString& directory, int max_megabytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_ = directory;
+    directory_max_bytes_ = static_cast<qint64>(max_megabytes) * 1024 * 1024;
+}
+
+QString NoiseCache::Directory() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return directory_;
+}
+
+void NoiseCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    planes_.clear();
+}
+
+void NoiseCache::TrimDirectory(const QString& directory, qint64 max_bytes)
+{
+    // The most recently used files first.
+    const QFileInfoList files = QDir(directory).entryInfoList({"noise_*.pgm"}, QDir::Files, QDir::Time);
+    qint64 bytes = 0;
+    for (const QFileInfo& file : files) {
+        bytes += file.size();
+        if (bytes > max_bytes && !QFile::remove(file.filePath())) {
+            qDebug() << "Can't remove the noise image" << file.filePath();
+        }
+    }
+}
+
+}  // namespace effects
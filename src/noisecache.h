@@ -0,0 +1,68 @@
+#ifndef NOISECACHE_H
+#define NOISECACHE_H
+
+#include "planarimage.h"
+
+#include <QCache>
+#include <QImage>
+#include <QRect>
+#include <QString>
+
+#include <cstdint>
+#include <mutex>
+
+namespace effects {
+
+// The noise images of the watercolor passes (see QNoise::create_noise_image()), by region of
+// the world, scale, seed and octaves. The noise is kept in memory as a single grey plane, ready
+// for the CPU passes (the least recently used images are dropped beyond the memory limit), so
+// that repeated renders don't generate or convert it again. Optionally, the images are also
+// saved as files, which are uncompressed grey PGMs that load faster than the noise is generated
+// (unlike PNGs). This may be called from several threads.
+class NoiseCache
+{
+public:
+    // The cache which is shared by all passes.
+    static NoiseCache& Instance();
+
+    explicit NoiseCache(int max_megabytes = 256);
+
+    // The noise of the region of a world (see QNoise::create_noise_image()), as Grayscale8.
+    QImage Noise(const QRect& region, int world_width, double scale_factor, int64_t seed, int octaves);
+    // The same for the CPU passes. The plane is shared with the cache, so it must not be written to.
+    PlanarImage Planes(const QRect& region, int world_width, double scale_factor, int64_t seed, int octaves);
+
+    // The directory for the files (empty, the default: memory only). It is created when needed.
+    // Beyond max_megabytes, the least recently used files are deleted.
+    void Directory(const QString& directory, int max_megabytes = 1024);
+    QString Directory() const;
+    void Clear();
+
+private:
+    struct Key
+    {
+        QRect region;
+        int world_width;
+        double scale_factor;
+        int64_t seed;
+        int octaves;
+
+        bool operator==(const Key& other) const;
+        // The name of the file.
+        QString FileName() const;
+    };
+    friend uint qHash(const Key& key, uint seed);
+
+    // Deletes the least recently used files of the directory beyond the size limit.
+    void TrimDirectory(const QString& directory, qint64 max_bytes);
+
+    mutable std::mutex mutex_;
+    // The costs are in kilobytes.
+    QCache<Key, PlanarImage> planes_;
+    QString directory_;
+    qint64 directory_max_bytes_;
+};
+
+}  // namespace effects
+
+#endif // NOISECACHE_H
@@ -1,4 +1,8 @@
 #include "objects.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <utility>
 
 namespace osm {
 
@@ -40,4 +44,9 @@ void Objects::Clear()
     ways_.clear();
 }
 
+void Objects::SortSpatially(const BoundingBox& bbox)
+{
+    utils::SortWaysByHilbertIndex(ways_, bbox);
+}
+
 }  // namespace osm
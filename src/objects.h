@@ -3,6 +3,10 @@
 
 #include "types.h"
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace osm
 {
 
@@ -18,9 +22,11 @@ public:
     ObjectsTypes ObjectsType() { return type_; }
 
     bool Grab(Way* way);
-    int Size();
+    virtual int Size();
     std::vector<Way*>* Ways();
-    void Clear();
+    virtual void Clear();
+    // Sorts the ways by the Hilbert index of their bbox centroid (see MapData::SortSpatially()).
+    void SortSpatially(const BoundingBox& bbox);
 
     // For testing with coastlines only:
     void Ways(std::vector<Way*> ways) {this->ways_ = ways;}
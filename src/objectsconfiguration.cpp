@@ -131,4 +131,16 @@ QColor ObjectsConfiguration::SelectColor(QLineEdit* target)
     return Qt::transparent;
 }
 
+LayerStyle ObjectsConfiguration::Style() const
+{
+    LayerStyle style;
+    style.enabled = enabled_;
+    style.line_width = line_width_;
+    style.outline_color = outline_color_;
+    style.outlined = outlined_;
+    style.fill_color = fill_color_;
+    style.filled = filled_;
+    return style;
+}
+
 }  // namespace osm
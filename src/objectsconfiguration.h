@@ -1,6 +1,8 @@
 #ifndef OBJECTSCONFIGURATION_H
 #define OBJECTSCONFIGURATION_H
 
+#include "rendersnapshot.h"
+
 #include <QCheckBox>
 #include <QColor>
 #include <QLineEdit>
@@ -17,18 +19,21 @@ public:
     explicit ObjectsConfiguration(bool enabled, int linewidth, QColor outline_color, bool outlined, QColor fill_color, bool filled);
     virtual ~ObjectsConfiguration();
 
-    void Enabled(bool enabled) { enabled_ = enabled; }
+    // The setters emit Updated like the widget, so that cached snapshots are taken again.
+    void Enabled(bool enabled) { enabled_ = enabled; emit Updated(this); }
     bool Enabled() { return enabled_; }
-    void LineWidth(int w) { line_width_ = w; }
+    void LineWidth(int w) { line_width_ = w; emit Updated(this); }
     int LineWidth() { return line_width_; }
-    void OutlineColor(QColor col) { outline_color_ = col; }
+    void OutlineColor(QColor col) { outline_color_ = col; emit Updated(this); }
     QColor OutlineColor() { return outline_color_; }
-    void Outlined(bool outlined) { outlined_ = outlined; }
+    void Outlined(bool outlined) { outlined_ = outlined; emit Updated(this); }
     bool Outlined() { return outlined_; }
-    void FillColor(QColor col) { fill_color_ = col; }
+    void FillColor(QColor col) { fill_color_ = col; emit Updated(this); }
     QColor FillColor() { return fill_color_; }
-    void Filled(bool filled) { filled_ = filled; }
+    void Filled(bool filled) { filled_ = filled; emit Updated(this); }
     bool Filled() { return filled_; }
+    // The current values, e.g. for a render snapshot.
+    LayerStyle Style() const;
 
     QWidget* Widget() { return widget_; }
 
@@ -1,15 +1,24 @@
 #include "objectsrepository.h"
 
+#include <QDebug>
 #include <QException>
 
 namespace osm {
 
+ObjectsRepository::~ObjectsRepository()
+{
+    for (auto it = configuration_connections_.begin(); it != configuration_connections_.end(); ++it) {
+        QObject::disconnect(*it);
+    }
+}
+
 void ObjectsRepository::AddObjects(QString name, osm::Objects* objects)
 {
     if (objects_by_name_.find(name) == objects_by_name_.end()) {
         ordered_objectsname_.push_back(name);
     }
     objects_by_name_[name] = objects;
+    snapshot_valid_ = false;
 }
 
 Objects* ObjectsRepository::Objects(QString name)
@@ -29,6 +38,7 @@ bool ObjectsRepository::SetObjectsOrder(QVector<QString> order)
         }
     }
     ordered_objectsname_ = order;
+    snapshot_valid_ = false;
     return true;
 }
 
@@ -43,7 +53,33 @@ osm::ObjectsConfiguration* ObjectsRepository::ObjectsConfiguration(QString name)
 
 void ObjectsRepository::ObjectsConfiguration(QString name, osm::ObjectsConfiguration* config)
 {
+    QObject::disconnect(configuration_connections_.take(name));
     objects_configuration_[name] = config;
+    snapshot_valid_ = false;
+    if (config != nullptr) {
+        configuration_connections_[name] = QObject::connect(config, &osm::ObjectsConfiguration::Updated,
+                                                            [this] { snapshot_valid_ = false; });
+    }
+}
+
+RenderSnapshot ObjectsRepository::Snapshot()
+{
+    if (snapshot_valid_) {
+        return snapshot_;
+    }
+    QVector<RenderLayer> layers;
+    layers.reserve(ordered_objectsname_.size());
+    for (auto it = ordered_objectsname_.begin(); it != ordered_objectsname_.end(); ++it) {
+        osm::ObjectsConfiguration* config = ObjectsConfiguration(*it);
+        if (config == nullptr) {
+            qDebug() << "Could not find the objects configuration for" << *it;
+            continue;
+        }
+        layers.push_back({*it, Objects(*it), config->Style()});
+    }
+    snapshot_ = RenderSnapshot(layers);
+    snapshot_valid_ = true;
+    return snapshot_;
 }
 
 void ObjectsRepository::Clear()
@@ -51,8 +87,14 @@ void ObjectsRepository::Clear()
     ordered_objectsname_.clear();
     qDeleteAll(objects_by_name_);
     objects_by_name_.clear();
+    for (auto it = configuration_connections_.begin(); it != configuration_connections_.end(); ++it) {
+        QObject::disconnect(*it);
+    }
+    configuration_connections_.clear();
     qDeleteAll(objects_configuration_);
     objects_configuration_.clear();
+    snapshot_ = RenderSnapshot();
+    snapshot_valid_ = false;
 }
 
 int ObjectsRepository::Size()
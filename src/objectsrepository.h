@@ -3,9 +3,11 @@
 
 #include "objects.h"
 #include "objectsconfiguration.h"
+#include "rendersnapshot.h"
 
 #include <QException>
 #include <QHash>
+#include <QMetaObject>
 #include <QString>
 #include <QVector>
 
@@ -15,6 +17,7 @@ class ObjectsRepository
 {
 public:
     explicit ObjectsRepository() = default;
+    ~ObjectsRepository();
 
     void AddObjects(QString name, Objects* objects);
     Objects* Objects(QString name);
@@ -22,6 +25,10 @@ public:
     QVector<QString>* OrderedObjectsNames() { return &ordered_objectsname_; }
     osm::ObjectsConfiguration* ObjectsConfiguration(QString name);
     void ObjectsConfiguration(QString name, osm::ObjectsConfiguration* config);
+    // A snapshot of the ordered objects and their current configuration. Objects without a
+    // configuration are left out. The snapshot is only taken again after the order, the
+    // objects or a configuration changed (see ObjectsConfiguration::Updated).
+    RenderSnapshot Snapshot();
 
     void Clear();
     int Size();
@@ -30,6 +37,11 @@ private:
     QVector<QString> ordered_objectsname_;
     QHash<QString, osm::Objects*> objects_by_name_;
     QHash<QString, osm::ObjectsConfiguration*> objects_configuration_;
+    // The connections to ObjectsConfiguration::Updated by name, which are disconnected when the
+    // configuration is replaced or the repository goes away before it.
+    QHash<QString, QMetaObject::Connection> configuration_connections_;
+    RenderSnapshot snapshot_;
+    bool snapshot_valid_ = false;
 };
 
 class ObjectsNotFound : QException
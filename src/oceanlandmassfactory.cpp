@@ -5,704 +5,622 @@
 #include <QDebug>
 #include <QString>
 
-#include <iostream>
-#include <iterator>     // std::back_inserter
-#include <algorithm>    // std::copy
-#include <queue>
-#include <stack>
-#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace osm {
 
-OceanLandmassFactory::OceanLandmassFactory(Objects* coastline_objects,
-                                           int window_width, int window_height,
-                                           float render_scale, Point<int> render_offset,
-                                           const BoundingBox& bbox) :
-render_width_(window_width), render_height_(window_height),
-render_scale_(render_scale), render_offset_(render_offset),
-bbox_(bbox), coastline_objects_(coastline_objects)
+const int32_t OceanLandmassFactory::kNoSegment;
+
+namespace {
+
+// The rings are computed in the unit square (see Build()).
+const double kWidth = 1.0;
+const double kHeight = 1.0;
+
+enum OutCodeBits { kInside = 0, kOutLeft = 1, kOutRight = 2, kOutTop = 4, kOutBottom = 8 };
+
+}  // namespace
+
+OceanLandmassFactory::OceanLandmassFactory(Objects* coastline_objects) :
+coastline_objects_(coastline_objects)
 {
 
 }
 
-void OceanLandmassFactory::Build()
+void OceanLandmassFactory::Build(const BoundingBox& bbox)
 {
-    if (coastline_objects_->Ways()->empty()) {
-        return;
-    }
-
-    work_set_.clear();
+    bbox_ = bbox;
     coastline_polygons_.clear();
-    border_type_to_intersection_point_.clear();
-    for (auto it = way_to_border_intersection_point_.begin(); it != way_to_border_intersection_point_.end(); ++it) {
-        it->second.clear();
+    coastline_paths_.clear();
+    if (coastline_objects_ == nullptr || coastline_objects_->Ways()->empty()) {
+        return;
     }
-    way_to_border_intersection_point_.clear();
-    border_intersection_point_to_way_.clear();
-    bip_to_coastlinepath_.clear();
 
-    FirstPass();
-    //SecondPass();
+    BuildChains();
     ThirdPass();
     FourthPass();
 }
 
-void OceanLandmassFactory::FirstPass()
+void OceanLandmassFactory::BuildChains()
 {
-    std::set<std::string> startpoints;
-    std::set<std::string> endpoints;
-    std::unordered_map<std::string, Way*> endpoints_to_ways;
-    std::unordered_map<std::string, Way*> startpoints_to_ways;
+    // The chains only depend on the coastlines, so they are connected once per dataset.
+    if (chains_built_ || coastline_objects_ == nullptr) {
+        return;
+    }
+    FirstPass();
+    SecondPass();
+    MaterializeChains();
+    chains_built_ = true;
+}
 
-    // Create local datastructures with start- and endpoints only,
-    // and their mapping to their respective ways.
-    for (auto it = coastline_objects_->Ways()->begin(); it != coastline_objects_->Ways()->end(); ++it) {
-        Way* w = *it;
-        Node* ep = w->nodes.at(w->nodes.size() - 1);
-        Node* sp = w->nodes.at(0);
-        endpoints.insert(ep->id);
-        endpoints_to_ways[ep->id] = w;
-        startpoints.insert(sp->id);
-        startpoints_to_ways[sp->id] = w;
-        work_set_.insert(w);
+void OceanLandmassFactory::GapTolerance(double km)
+{
+    if (km != gap_tolerance_km_) {
+        gap_tolerance_km_ = km;
+        chains_built_ = false;
     }
+}
 
+void OceanLandmassFactory::FirstPass()
+{
     /*
-     * There are two ways where the endpoint of the first way
-     * has the same id as the startpoint of the second way
+     * Two ways are connected if the endpoint of the first way is the startpoint
+     * of the second way (the same node):
      *
      *       ep
      * o-----o
-     *       sp_it
+     *       sp
      *       o---------o
      *
-     * In the end there will be one combined way
-     * (the sp_it point will not be added - therefore +1 when copying,
-     * since this point is equal to ep).
+     * The combined way doesn't contain the shared node twice:
      * o---------------o
      *
-     * You remove the two original ways, and insert the new way instead.
-     * You also want to make sure that you remove the ways and their ids
-     * from the local data structures.
-     * You then add the newly created way to the mapping of points to ways.
-     *
-     * In step n-1 there will be one startpoint and one endpoint:
-     * o-----o
-     *       o-----------.....(very long)...----o
-     * o-----------------...................----o
-     * And in this case ep and sp belong to the same way, and you just
-     * remove the endpoint from the local datastructure, and the sp
-     * remains -> leave the while loop in step n
+     * The nodes are unique per id (see Parser), so the node pointers serve as
+     * integer endpoint ids. Every way is linked to its successor by index
+     * (next_/prev_), and each finished chain is copied into a new way exactly
+     * once (see MaterializeChains()).
      * */
-    while (!endpoints.empty()) {
-        std::string ep = *endpoints.begin();
-
-        auto sp_it = startpoints.find(ep);
-        // If a startpoint could be found with the same id, and the ways for each point is not the same...
-        if (sp_it != startpoints.end() && (startpoints_to_ways[*sp_it]->id != endpoints_to_ways[ep]->id)) {
-            std::string sp = *sp_it;
-            Way* way = new Way;
-            Way* sp_w = startpoints_to_ways[sp];
-            Way* ep_w = endpoints_to_ways[ep];
-            way->id = ep_w->id + " + " + sp_w->id;
-            std::copy(ep_w->nodes.begin(), ep_w->nodes.end(), std::back_inserter(way->nodes));
-            std::copy(sp_w->nodes.begin() + 1, sp_w->nodes.end(), std::back_inserter(way->nodes));
-            work_set_.erase(work_set_.find(ep_w));
-            work_set_.erase(work_set_.find(sp_w));
-            work_set_.insert(way);
-
-            // Remove the sp and ep which are connected now - they're in the middle of the new way now.
-            if (startpoints.find(sp) != startpoints.end()) startpoints.erase(startpoints.find(sp));
-            if (endpoints.find(ep) != endpoints.end()) endpoints.erase(endpoints.find(ep));
-            if (endpoints_to_ways.find(ep) != endpoints_to_ways.end()) endpoints_to_ways.erase(endpoints_to_ways.find(ep));
-            if (startpoints_to_ways.find(sp) != startpoints_to_ways.end()) startpoints_to_ways.erase(startpoints_to_ways.find(sp));
-
-            // And update the sp and ep to point to the new way
-            endpoints_to_ways[way->nodes.at(way->nodes.size() - 1)->id] = way;
-            startpoints_to_ways[way->nodes.at(0)->id] = way;
-
+    segments_.clear();
+    segments_.reserve(coastline_objects_->Ways()->size());
+    for (auto it = coastline_objects_->Ways()->begin(); it != coastline_objects_->Ways()->end(); ++it) {
+        Way* w = *it;
+        if (w->nodes.size() < 2 || w->nodes.front() == nullptr || w->nodes.back() == nullptr) {
+            continue;
         }
+        segments_.push_back(w);
+    }
+
+    std::unordered_map<const Node*, int32_t> startpoint_to_segment;
+    startpoint_to_segment.reserve(segments_.size());
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        // If two ways start at the same node (broken data), only the first one is connected.
+        startpoint_to_segment.insert({segments_[i]->nodes.front(), static_cast<int32_t>(i)});
+    }
 
-        // ep could already be deleted above after the new connected way was created.
-        // This case here happens if the above conditions are false: either there is no startpoint
-        // for this endpoint, or their way ids are equal (they belong to the same way).
-        if (endpoints.find(ep) != endpoints.end()) {
-            endpoints.erase(endpoints.find(ep));
+    next_.assign(segments_.size(), kNoSegment);
+    prev_.assign(segments_.size(), kNoSegment);
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        auto sp_it = startpoint_to_segment.find(segments_[i]->nodes.back());
+        if (sp_it == startpoint_to_segment.end() || sp_it->second == static_cast<int32_t>(i)
+            || prev_[sp_it->second] != kNoSegment) {
+            // No successor, a way which is closed by itself, or the successor is already taken.
+            continue;
         }
+        next_[i] = sp_it->second;
+        prev_[sp_it->second] = i;
     }
 }
 
 void OceanLandmassFactory::SecondPass()
 {
-    /*std::cout << "Check for SP -> EP mapping.\n";
-    // Startpoint of w1 to endpoint of w2 mapping.
-    std::string_view("_IGNORE");
-    for (auto it1 = coastlines_ways_->ways()->begin(); it1 != coastlines_ways_->ways()->end(); ++it1) {
-        Way* w1 = *it1;
-        if (ends_with(w1->id, "_IGNORE")) {
+    // The open chains (head and tail segment) after the first pass.
+    struct Chain
+    {
+        int32_t head;
+        int32_t tail;
+    };
+    std::vector<Chain> chains;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (prev_[i] != kNoSegment) {
             continue;
         }
-        if (attached_to_another_way_.find(w1) != attached_to_another_way_.end()) {
-            // Ok, this way w1 was already attached to another way.
-            continue;
+        int32_t tail = i;
+        while (next_[tail] != kNoSegment) {
+            tail = next_[tail];
         }
-        Node* n1 = w1->nodes.at(0);
-        // Now iterate over all ways again and check if there's a way with an apropriate endpoint.
-        for (auto it2 = coastlines_ways_->ways()->begin(); it2 != coastlines_ways_->ways()->end(); ++it2) {
-            Way* w2 = *it2;
-            if (ends_with(w2->id, "_IGNORE")) {
-                continue;
-            }
-            if (w1 == w2) {
-                // Obviously, if it is the same, continue to search.
-                continue;
-            }
-            // First check if this way w1 was already attached to the way w2.
-            if ((set_of_ways_attached_to_another_way_.find(w2) != set_of_ways_attached_to_another_way_.end())
-                && (set_of_ways_attached_to_another_way_[w2].find(w1) != set_of_ways_attached_to_another_way_[w2].end())) {
-                continue;
-            }
-            // Otherwise calculate the distance between the points.
-            Node* n2 = w2->nodes.at(w2->nodes.size()-1);
-            if (n1->id != n2->id) {
-                double d = distance(n1->lat, n1->lon, n2->lat, n2->lon);
-                if (processed_way_.find(w1) != processed_way_.end()) {
-                    std::cout << "w1 was already processed\n";
-                }
-                if (processed_way_.find(w2) != processed_way_.end()) {
-                    std::cout << "w2 was already processed\n";
-                }
-                std::cout << "Distance between SP w1 ID:" << w1->id << " and EP w2 ID:" << w2->id << " = " << d << "\n\n";
-            }
+        if (segments_[tail]->nodes.back() != segments_[i]->nodes.front()) {
+            chains.push_back({static_cast<int32_t>(i), tail});
         }
     }
-
-    std::cout << "Check for EP -> SP mapping.\n";
-    // Endpoint of w1 to startpoint of w2 mapping.
-    for (auto it1 = coastlines_ways_->ways()->begin(); it1 != coastlines_ways_->ways()->end(); ++it1) {
-        Way* w1 = *it1;
-        if (ends_with(w1->id, "_IGNORE")) {
-            continue;
-        }
-        Node* n1 = w1->nodes.at(w1->nodes.size()-1);
-        for (auto it2 = coastlines_ways_->ways()->begin(); it2 != coastlines_ways_->ways()->end(); ++it2) {
-            Way* w2 = *it2;
-            if (ends_with(w2->id, "_IGNORE")) {
-                continue;
-            }
-            if (w1 == w2) {
-                continue;
-            }
-            if (attached_to_another_way_.find(w2) != attached_to_another_way_.end()) {
-                // Ok, this way w2 was already attached to another way.
-                continue;
-            }
-            Node* n2 = w2->nodes.at(0);
-            if (n1->id != n2->id) {
-                double d = distance(n1->lat, n1->lon, n2->lat, n2->lon);
-                if (processed_way_.find(w1) != processed_way_.end()) {
-                    std::cout << "w1 was already processed\n";
-                }
-                if (processed_way_.find(w2) != processed_way_.end()) {
-                    std::cout << "w2 was already processed\n";
-                }
-                std::cout << "Distance between EP w1 ID:" << w1->id << " and SP w2 ID:" << w2->id << " = " << d << "\n\n";
-            }
-        }
+    if (chains.empty()) {
+        return;
     }
-     */
-}
 
-// Set the intersection point to either start or end depending on the vector between the node points and the border type.
-// node_im1 and node_i are the two node points between which the intersection was found.
-void OceanLandmassFactory::SetIntersectionPointType(BorderIntersectionPoint& border_ip, const Point<double>& node_im1, const Point<double>& node_i)
-{
-    // Just check if the points are inside or outside the bbox.
-    if ((node_im1.x > 0 && node_im1.x < render_width_ && node_im1.y > 0 && node_im1.y < render_height_)
-        && (node_i.x <= 0 || node_i.x >= render_width_ || node_i.y <= 0 || node_i.y >= render_height_)){
-        // i-1 inside, i outside -> line leaves the bbox => endpoint
-        border_ip.point_type = PointType::kEnd;
-    } else if ((node_i.x >= 0 && node_i.x <= render_width_ && node_i.y >= 0 && node_i.y <= render_height_)
-               && (node_im1.x < 0 || node_im1.x > render_width_ || node_im1.y < 0 || node_im1.y > render_height_)){
-        // i-1 outside, i inside -> line enters the bbox => startpoint
-        border_ip.point_type = PointType::kStart;
+    // Put the startpoints of the chains into a grid with cells of the size of the tolerance,
+    // so that the candidates for an endpoint are in the 3x3 cells around it. The cells are
+    // sized for the latitude farthest from the equator, where the degrees of longitude are shortest.
+    double max_abs_lat = 0;
+    for (size_t i = 0; i < chains.size(); ++i) {
+        max_abs_lat = std::max(max_abs_lat, std::fabs(static_cast<double>(segments_[chains[i].head]->nodes.front()->lat)));
+    }
+    double cell_lat = gap_tolerance_km_ / 111.2;
+    double cell_lon = cell_lat / std::max(0.01, std::cos(max_abs_lat * M_PI / 180.0));
+    auto cell_key = [](int64_t row, int64_t col) {
+        return (static_cast<uint64_t>(row) << 32) ^ static_cast<uint64_t>(col & 0xffffffff);
+    };
+    std::unordered_map<uint64_t, std::vector<size_t>> grid;
+    grid.reserve(chains.size());
+    for (size_t i = 0; i < chains.size(); ++i) {
+        const Node* sp = segments_[chains[i].head]->nodes.front();
+        grid[cell_key(std::floor(sp->lat / cell_lat), std::floor(sp->lon / cell_lon))].push_back(i);
     }
-}
-
-void OceanLandmassFactory::ThirdPass()
-{
-    //std::unordered_map<BorderType, std::set<BorderIntersectionPoint>, std::hash<int>> border_type_to_intersection_point;
-    std::unordered_set<Point<double>, PointHashFunction<double>> intersection_points;  // key = x, value = y; Used to avoid duplicates
-    //std::unordered_map<Way*, std::vector<BorderIntersectionPoint>> way_to_border_intersection_point;
-
-    std::shared_ptr<CoastlinePath> current_coastlinepath = nullptr;
-
-    // This algorithm will always find the startpoint first, then the endpoint.
-    // This is because it always starts with the first node and iterates through to the end node.
-
-    border_type_to_intersection_point_[BorderType::kTop] = {};
-    border_type_to_intersection_point_[BorderType::kRight] = {};
-    border_type_to_intersection_point_[BorderType::kBottom] = {};
-    border_type_to_intersection_point_[BorderType::kLeft] = {};
-
-    Line<double> top = {.start={.x=0,.y=0},.end={.x=static_cast<double>(render_width_),.y=0}};
-    Line<double> right = {.start={.x=static_cast<double>(render_width_),.y=0},.end={.x=static_cast<double>(render_width_),.y=static_cast<double>(render_height_)}};
-    Line<double> bottom = {.start={.x=0,.y=static_cast<double>(render_height_)},.end={.x=static_cast<double>(render_width_),.y=static_cast<double>(render_height_)}};
-    Line<double> left = {.start={.x=0,.y=0},.end={.x=0,.y=static_cast<double>(render_height_)}};
-
-    //Point<double> intersection_pt = {.x=0,.y=0};
-    //bool intersects = false;
-
-    // TODO: Allow alternating start and endpoint. I.e. a long coastline that
-    // intersects with borders multiple times.
-
-    // NOTE: If the nodes are quite close to the border, it can happen, that two consecutive points
-    // are determined as two end or two start points. You can ignore these points since the
-    // area described by them is too small anyways.
-    // Added note after reading this: really ????
 
-    for (auto it = work_set_.begin(); it != work_set_.end(); ++it) {
-        Way* w = *it;
-        way_to_border_intersection_point_[w] = {};
-        //std::cout << "Computing intersections for way " << w->id << " <" << w << ">\n";
-        // TODO: Add the intersections in a vector or queue. Then it should be star-end-start-end-... for the same way.
-        Point<double> a, b;
-        float x, y;
-        for (size_t node_i = 1; node_i < w->nodes.size(); ++node_i) {
-            osm::utils::MapLatLonToXy(w->nodes.at(node_i - 1)->lat,
-                                 w->nodes.at(node_i - 1)->lon,
-                                 bbox_.min_lat, bbox_.max_lat,
-                                 bbox_.min_lon, bbox_.max_lon,
-                                 render_width_, render_height_,
-                                 x, y);
-            a.x = x;
-            a.y = render_height_ - y;
-            osm::utils::MapLatLonToXy(w->nodes.at(node_i)->lat,
-                                 w->nodes.at(node_i)->lon,
-                                 bbox_.min_lat, bbox_.max_lat,
-                                 bbox_.min_lon, bbox_.max_lon,
-                                 render_width_, render_height_,
-                                 x, y);
-            b.x = x;
-            b.y = render_height_ - y;
-
-            // Find an intersection between node i-1 and i and the top border.
-            std::shared_ptr<Point<double>> top_pt = Intersection({.start=a,.end=b}, top);
-            if (top_pt) {
-                // We found the intersection...
-                if (intersection_points.find(*top_pt) == intersection_points.end()) {
-                    // ...and it has not yet been discovered / added before.
-                    BorderIntersectionPoint border_ip;
-                    border_ip.p = top_pt;
-                    border_ip.w = w;
-                    border_ip.border_type = BorderType::kTop;
-                    border_ip.border = top;
-                    SetIntersectionPointType(border_ip, a, b);
-                    if (border_ip.point_type == PointType::kStart) {
-                        // In that case the i-1 node was outside of the border, and i was inside.
-                        // Then create a new coastline path - if not yet there.
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath = bip_to_coastlinepath_[border_ip];  //????? WTF?
-                        current_coastlinepath->start = border_ip;
-                        current_coastlinepath->points.push_back({.x=top_pt->x,.y=top_pt->y});
-                    } else if (border_ip.point_type == PointType::kEnd) {
-                        // In that case the i-1 node was inside of the border, and i was outside
-                        // TODO: if current_coastlinepath == nullptr then create it.
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath->end = border_ip;
-                        current_coastlinepath->points.push_back({.x=top_pt->x,.y=top_pt->y});
-                        current_coastlinepath = nullptr;
-                    }
-                    border_type_to_intersection_point_[BorderType::kTop].insert(border_ip);
-                    way_to_border_intersection_point_[w].push_back(border_ip);
-                    border_intersection_point_to_way_[border_ip] = w;
-                    intersection_points.insert(*top_pt);
+    // Collect all endpoint-startpoint pairs within the tolerance. An endpoint is only
+    // connected to a startpoint (not to another endpoint), so that the land stays on the left.
+    // Connecting the endpoint of a chain to its own startpoint closes it.
+    struct Gap
+    {
+        double distance;
+        size_t from;
+        size_t to;
+    };
+    // Only the nearest few candidates of each endpoint are kept, which keeps the number
+    // of pairs linear even where many coastline ends are close together.
+    const size_t kMaxCandidates = 4;
+    auto by_distance = [](const Gap& a, const Gap& b) {
+        return a.distance < b.distance;
+    };
+    std::vector<Gap> gaps;
+    std::vector<Gap> candidates;
+    for (size_t i = 0; i < chains.size(); ++i) {
+        const Node* ep = segments_[chains[i].tail]->nodes.back();
+        int64_t row = std::floor(ep->lat / cell_lat);
+        int64_t col = std::floor(ep->lon / cell_lon);
+        candidates.clear();
+        for (int64_t r = row - 1; r <= row + 1; ++r) {
+            for (int64_t c = col - 1; c <= col + 1; ++c) {
+                auto cell = grid.find(cell_key(r, c));
+                if (cell == grid.end()) {
+                    continue;
                 }
-            }
-            std::shared_ptr<Point<double>> right_pt = Intersection({.start=a,.end=b}, right);
-            if (right_pt) {
-                if (intersection_points.find(*right_pt) == intersection_points.end()) {
-                    BorderIntersectionPoint border_ip;
-                    border_ip.p = right_pt;
-                    border_ip.w = w;
-                    border_ip.border_type = BorderType::kRight;
-                    border_ip.border = top;
-                    SetIntersectionPointType(border_ip, a, b);
-                    if (border_ip.point_type == PointType::kStart) {
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath = bip_to_coastlinepath_[border_ip];
-                        current_coastlinepath->start = border_ip;
-                        current_coastlinepath->points.push_back({.x=right_pt->x,.y=right_pt->y});
-                    } else if (border_ip.point_type == PointType::kEnd) {
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath->end = border_ip;
-                        current_coastlinepath->points.push_back({.x=right_pt->x,.y=right_pt->y});
-                        current_coastlinepath = nullptr;
-                    }
-                    border_type_to_intersection_point_[BorderType::kRight].insert(border_ip);
-                    way_to_border_intersection_point_[w].push_back(border_ip);
-                    border_intersection_point_to_way_[border_ip] = w;
-                    intersection_points.insert(*right_pt);
-                }
-            }
-            std::shared_ptr<Point<double>> bottom_pt = Intersection({.start=a,.end=b}, bottom);
-            if (bottom_pt) {
-                if (intersection_points.find(*bottom_pt) == intersection_points.end()) {
-                    BorderIntersectionPoint border_ip;
-                    border_ip.p = bottom_pt;
-                    border_ip.w = w;
-                    border_ip.border_type = BorderType::kBottom;
-                    border_ip.border = top;
-                    SetIntersectionPointType(border_ip, a, b);
-                    if (border_ip.point_type == PointType::kStart) {
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath = bip_to_coastlinepath_[border_ip];
-                        current_coastlinepath->start = border_ip;
-                        current_coastlinepath->points.push_back({.x=bottom_pt->x,.y=bottom_pt->y});
-                    } else if (border_ip.point_type == PointType::kEnd) {
-                        if (current_coastlinepath == nullptr) {
-                            // Is this code ever reached???
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath; // Also set the reference for the endpoint.
-                        current_coastlinepath->end = border_ip;
-                        current_coastlinepath->points.push_back({.x=bottom_pt->x,.y=bottom_pt->y});
-                        current_coastlinepath = nullptr;
+                for (auto it = cell->second.begin(); it != cell->second.end(); ++it) {
+                    const Node* sp = segments_[chains[*it].head]->nodes.front();
+                    // Rank by the local (equirectangular) distance in grid units, which is a cell
+                    // at most. Only the kept candidates are measured exactly.
+                    double d_lat = (sp->lat - ep->lat) / cell_lat;
+                    double d_lon = (sp->lon - ep->lon) / cell_lon;
+                    double d = d_lat * d_lat + d_lon * d_lon;
+                    if (d <= 1.1) {
+                        candidates.push_back({d, i, *it});
                     }
-                    border_type_to_intersection_point_[BorderType::kBottom].insert(border_ip);
-                    way_to_border_intersection_point_[w].push_back(border_ip);
-                    border_intersection_point_to_way_[border_ip] = w;
-                    intersection_points.insert(*bottom_pt);
                 }
             }
-            std::shared_ptr<Point<double>> left_pt = Intersection({.start=a,.end=b}, left);
-            if (left_pt) {
-                if (intersection_points.find(*left_pt) == intersection_points.end()) {
-                    BorderIntersectionPoint border_ip;
-                    border_ip.p = left_pt;
-                    border_ip.w = w;
-                    border_ip.border_type = BorderType::kLeft;
-                    border_ip.border = top;
-                    SetIntersectionPointType(border_ip, a, b);
-                    if (border_ip.point_type == PointType::kStart) {
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath = bip_to_coastlinepath_[border_ip];
-                        current_coastlinepath->start = border_ip;
-                        current_coastlinepath->points.push_back({.x=left_pt->x,.y=left_pt->y});
-                    } else if (border_ip.point_type == PointType::kEnd) {
-                        if (current_coastlinepath == nullptr) {
-                            current_coastlinepath = std::make_shared<CoastlinePath>();
-                        }
-                        bip_to_coastlinepath_[border_ip] = current_coastlinepath;
-                        current_coastlinepath->end = border_ip;
-                        current_coastlinepath->points.push_back({.x=left_pt->x,.y=left_pt->y});
-                        current_coastlinepath = nullptr;
-                    }
-                    border_type_to_intersection_point_[BorderType::kLeft].insert(border_ip);
-                    way_to_border_intersection_point_[w].push_back(border_ip);
-                    border_intersection_point_to_way_[border_ip] = w;
-                    intersection_points.insert(*left_pt);
-                }
+        }
+        size_t count = std::min(kMaxCandidates, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), by_distance);
+        for (size_t k = 0; k < count; ++k) {
+            const Node* sp = segments_[chains[candidates[k].to].head]->nodes.front();
+            candidates[k].distance = Distance(ep->lat, ep->lon, sp->lat, sp->lon);
+            if (candidates[k].distance <= gap_tolerance_km_) {
+                gaps.push_back(candidates[k]);
             }
+        }
+    }
 
-            if (current_coastlinepath != nullptr) {
-                // Keep pushing the nodes / points as long as there is a current (open) path.
-                // That means a startpoint was found and opens the way, and not yet an endpoint which closes the way.
-                current_coastlinepath->points.push_back(b);
-            }
+    // Close the smallest gaps first; every endpoint and startpoint is used once.
+    std::sort(gaps.begin(), gaps.end(), by_distance);
+    std::vector<bool> endpoint_used(chains.size(), false);
+    std::vector<bool> startpoint_used(chains.size(), false);
+    for (auto it = gaps.begin(); it != gaps.end(); ++it) {
+        if (endpoint_used[it->from] || startpoint_used[it->to]) {
+            continue;
         }
+        endpoint_used[it->from] = true;
+        startpoint_used[it->to] = true;
+        next_[chains[it->from].tail] = chains[it->to].head;
+        prev_[chains[it->to].head] = chains[it->from].tail;
     }
 }
 
-std::vector<osm::Point<double>> OceanLandmassFactory::CloseCoastlinePath(std::vector<BorderIntersectionPoint>& path)
+void OceanLandmassFactory::MaterializeChains()
 {
-    std::vector<osm::Point<double>> coastline_polygon;
-
-    // There is a special case if there are only two points. Then all the corners need to be added, too.
-    if (path.size() == 2) {
-        //std::cout << "Special case: just two points\n";
-        auto p_0 = path[0].p;
-        auto p_1 = path[1].p;
-
-        // Add the first point p_0.
-        coastline_polygon.push_back({.x=p_0->x,.y=p_0->y});
-
-        // Then add all the corners betweeen the first (p_0) and second point (p_1).
-        if (path[0].point_type == PointType::kStart && path[1].point_type == PointType::kEnd) {
-            std::vector<osm::Point<double>> corners = GetCornerPoints(path[0], path[1]);
-            for (auto c_it = corners.begin(); c_it != corners.end(); ++c_it) {
-                coastline_polygon.push_back(*c_it);
+    work_set_.clear();
+    chains_.clear();
+    std::vector<bool> visited(segments_.size(), false);
+    auto materialize = [&](int32_t first) {
+        // Count first, so that the nodes are copied once into a vector of the right size.
+        size_t nodes_count = 1;
+        size_t segments_count = 0;
+        for (int32_t i = first; i != kNoSegment; i = next_[i]) {
+            nodes_count += segments_[i]->nodes.size();
+            ++segments_count;
+            if (next_[i] == first) {
+                break;
             }
         }
-
-        // Add the second point p_1.
-        coastline_polygon.push_back({.x=p_1->x,.y=p_1->y});
-
-        /*
-        // The two points are on oppsite sides.
-        if (p_0->y == 0 && p_1->y == render_height_) {
-            // Add corners to the right of the line (top right, bottom right).
-            coastline_polygon.push_back({.x=p_0->x,.y=p_0->y});
-            coastline_polygon.push_back({.x=static_cast<double>(render_width_),.y=0});
-            coastline_polygon.push_back({.x=static_cast<double>(render_width_),.y=static_cast<double>(render_height_)});
-            coastline_polygon.push_back({.x=p_1->x,.y=p_1->y});
-        } else if (p_0->y == render_height_ && p_1->y == 0) {
-            // Add corners to the right of the line (bottom left, top left).
-            coastline_polygon.push_back({.x=p_0->x,.y=p_0->y});
-            coastline_polygon.push_back({.x=0,.y=static_cast<double>(render_height_)});
-            coastline_polygon.push_back({.x=0,.y=0});
-            coastline_polygon.push_back({.x=p_1->x,.y=p_1->y});
-        }  else if (p_0->x == 0 && p_1->x == render_width_) {
-            // Add corners to the right of the line (top right, top left).
-            coastline_polygon.push_back({.x=p_0->x,.y=p_0->y});
-            coastline_polygon.push_back({.x=0,.y=0});
-            coastline_polygon.push_back({.x=static_cast<double>(render_width_),.y=0});
-            coastline_polygon.push_back({.x=p_1->x,.y=p_1->y});
-        }  else if (p_0->x == render_width_ && p_1->x == 0) {
-            // Add corners to the right of the line (bottom left, bottom right).
-            coastline_polygon.push_back({.x=p_0->x,.y=p_0->y});
-            coastline_polygon.push_back({.x=static_cast<double>(render_width_),.y=static_cast<double>(render_height_)});
-            coastline_polygon.push_back({.x=0,.y=static_cast<double>(render_height_)});
-            coastline_polygon.push_back({.x=p_1->x,.y=p_1->y});
+        if (segments_count == 1 && next_[first] == kNoSegment) {
+            // Nothing to connect - use the original way.
+            visited[first] = true;
+            work_set_.push_back(segments_[first]);
+            return;
         }
-
-
-        // The two points are on orthogonal sides.
-        if (p_0->y == 0 && p_1->y > 0 && p_1->y < render_height_ && p_1->x == render_width_) {
-
-        }
-         */
-
-        // And now add all the points between p_1 and p_0.
-        // I assume that p_0 is always the STARTpoint. We fill up the polygon from end to start (p_1 to p_0).
-        // Added note after reading this: HOW DOES THIS WORK? You can't start with the begin() of one entry (path[1]), and check
-        // for an end() condition with another entry (path[0]). Or do path[0] and path[1] point to the same item??
-        qDebug() << QString::fromStdString(path[0].to_string());
-        qDebug() << QString::fromStdString(path[1].to_string());
-        /*for (auto it = bip_to_coastlinepath_[path[1]]->points.begin(); it != bip_to_coastlinepath_[path[0]]->points.end(); ++it) {
-            coastline_polygon.push_back(*it);
-        }*/
-        for (auto it = bip_to_coastlinepath_[path[1]]->points.rbegin(); it != bip_to_coastlinepath_[path[1]]->points.rend(); ++it) {
-            coastline_polygon.push_back(*it);
-        }
-        //for (auto it = bip_to_coastlinepath_[path[0]]->points.begin(); it != bip_to_coastlinepath_[path[0]]->points.end(); ++it) {
-        //    coastline_polygon.push_back(*it);
-        //}
-        return coastline_polygon;
-    }
-
-    // Add all points of all paths to the polygon.
-    coastline_polygon.push_back({.x=path[0].p->x,.y=path[0].p->y});
-    for (size_t i = 1; i < path.size(); ++i) {
-        auto p_im1 = path[i-1].p;
-        auto p_i = path[i].p;
-        CoastlinePath* cp_im1 = bip_to_coastlinepath_[path[i-1]].get();
-        CoastlinePath* cp_i = bip_to_coastlinepath_[path[i]].get();
-        // If they're on the same border line, then just connect them directly.
-        // If not then check clockwise for border / corner crossing. TODO: But only consider the corner cases if their coastline path is the same.
-        /*if ((p_i->x == 0 && p_im1->x == 0) || (p_i->x == render_width_ && p_im1->x == render_width_)
-            || (p_i->y == 0 && p_im1->y == 0) || (p_i->y == render_height_ && p_im1->y == render_height_)) {
-            //coastline_polygon.push_back({.x=static_cast<int>(p_i->x),.y=static_cast<int>(p_i->y)});
-        }*/
-
-        /*
-        // If it is the same coastline and i-1 is the startpoint and i is the endpoint
-        // (that means the corner is on the landmass) then add the corners, too.
-        if (//cp_im1 == cp_i &&
-            path[i-1].point_type == PointType::kStart && path[i].point_type == PointType::kEnd) {
-            if (p_im1->x == 0 && p_im1->y > 0 && p_im1->y < render_height_ && p_i->x > 0 && p_i->x < render_width_ && p_i->y == 0) { // Check if the two points are across the top left corner
-                std::cout << "    Add top left corner\n";
-                coastline_polygon.push_back({.x=0,.y=0});
-                //coastline_polygon.push_back({.x=p_i->x,.y=p_i->y});
-            } else if (p_im1->x > 0 && p_im1->x < render_width_ && p_im1->y == 0 && p_i->x == render_width_ && p_i->y > 0 && p_i->y < render_height_) { // Check if the two points are across the top right corner
-                std::cout << "    Add top right corner\n";
-                coastline_polygon.push_back({.x=static_cast<double>(render_width_),.y=0});
-                //coastline_polygon.push_back({.x=p_i->x,.y=p_i->y});
-            } else if (p_im1->x == render_width_ && p_im1->y > 0 && p_im1->y < render_height_ && p_i->x > 0 && p_i->x < render_width_ && p_i->y == render_height_) { // Check if the two points are across the bottom right corner
-                std::cout << "    Add bottom right corner\n";
-                coastline_polygon.push_back({.x=static_cast<double>(render_width_),.y=static_cast<double>(render_height_)});
-                //coastline_polygon.push_back({.x=p_i->x,.y=p_i->y});
-            } else if (p_im1->x > 0 && p_im1->x < render_width_ && p_im1->y == render_height_ && p_i->x == 0 && p_i->y > 0 && p_i->y < render_height_) { // Check if the two points are across the bottom left corner
-                std::cout << "    Add bottom left corner\n";
-                coastline_polygon.push_back({.x=0,.y=static_cast<double>(render_height_)});
-                //coastline_polygon.push_back({.x=p_i->x,.y=p_i->y});
+        std::unique_ptr<Way> way(new Way);
+        way->nodes.reserve(nodes_count);
+        int32_t i = first;
+        do {
+            visited[i] = true;
+            way->id += (i == first ? "" : " + ") + segments_[i]->id;
+            auto begin = segments_[i]->nodes.begin();
+            if (!way->nodes.empty() && way->nodes.back() == *begin) {
+                // The shared node is only added once. Otherwise the second pass bridged a gap.
+                ++begin;
             }
+            way->nodes.insert(way->nodes.end(), begin, segments_[i]->nodes.end());
+            i = next_[i];
+        } while (i != kNoSegment && i != first);
+        if (i == first && way->nodes.back() != way->nodes.front()) {
+            way->nodes.push_back(way->nodes.front());
         }
-         */
-        if (path[i-1].point_type == PointType::kStart && path[i].point_type == PointType::kEnd) {
-            std::vector<osm::Point<double>> corners = GetCornerPoints(path[i-1], path[i]);
-            for (auto c_it = corners.begin(); c_it != corners.end(); ++c_it) {
-                coastline_polygon.push_back(*c_it);
-            }
-        }
-
-        // Add all points from the path to the polygon.
-        // They're on different borders, so let's add the points in between them.
-        // Always fill in the points from end to start to keep the flow clockwise.
-        if (cp_im1 == cp_i && path[i-1].point_type == PointType::kStart && path[i].point_type == PointType::kEnd) {
-            // Here we can assume that the point at position i is the ENDpoint of the path with the point at i-1 as STARTpoint.
-            /*for (size_t p_idx=0; p_idx < bip_to_coastlinepath_[path[i]]->points.size(); ++p_idx) {
-                coastline_polygon.push_back(bip_to_coastlinepath_[path[i]]->points[p_idx]);
-            }*/
-            for (auto it_pt = bip_to_coastlinepath_[path[i]]->points.rbegin(); it_pt != bip_to_coastlinepath_[path[i]]->points.rend(); ++it_pt) {
-                coastline_polygon.push_back(*it_pt);
-            }
-        } else if (cp_im1 == cp_i && path[i-1].point_type == PointType::kEnd && path[i].point_type == PointType::kStart) {
-            // Here we can assume that the point at position i is the STARTpoint of the path with the point at i as ENDpoint.
-            /*for (size_t p_idx=0; p_idx < bip_to_coastlinepath_[path[i-1]]->points.size(); ++p_idx) {
-                coastline_polygon.push_back(bip_to_coastlinepath_[path[i-1]]->points[p_idx]);
-            }*/
-            for (auto it_pt = bip_to_coastlinepath_[path[i-1]]->points.rbegin(); it_pt != bip_to_coastlinepath_[path[i-1]]->points.rend(); ++it_pt) {
-                coastline_polygon.push_back(*it_pt);
-            }
+        way->is_closed = way->nodes.front() == way->nodes.back();
+        work_set_.push_back(way.get());
+        chains_.push_back(std::move(way));
+    };
+
+    // First the open chains, which start at a way without a predecessor...
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (prev_[i] == kNoSegment) {
+            materialize(i);
         }
-
-        coastline_polygon.push_back({.x=p_i->x,.y=p_i->y});
     }
-
-    if (bip_to_coastlinepath_[path[0]].get() == bip_to_coastlinepath_[path[path.size()-1]].get()) {
-        auto points = (path[0].point_type == PointType::kStart && path[path.size()-1].point_type == PointType::kEnd)
-                ? bip_to_coastlinepath_[path[path.size()-1]]->points : bip_to_coastlinepath_[path[0]]->points;
-        /*for (size_t i = 0; i < points.size(); ++i) {
-            coastline_polygon.push_back(points[i]);
-        }*/
-        for (auto it_pt = points.rbegin(); it_pt != points.rend(); ++it_pt) {
-            coastline_polygon.push_back(*it_pt);
+    // ...then the remaining ways, which all belong to closed rings (i.e. islands).
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (!visited[i]) {
+            materialize(i);
         }
     }
-
-    return coastline_polygon;
 }
 
-std::vector<osm::Point<double>> OceanLandmassFactory::GetCornerPoints(BorderIntersectionPoint& start, BorderIntersectionPoint& end) {
-    // I assume that start is really a startpoint, and end is really an endpoint.
-    // If they're on the same border, then return an empty list of corner points.
-    if (start.p->x == end.p->x || start.p->y == end.p->y) {
-        // We can assume that the points are on the borders, so need to check for the respective
-        // other coordinates.
-        return {};
+int OceanLandmassFactory::OutCode(const Point<double>& p) const
+{
+    int code = kInside;
+    if (p.x < 0) {
+        code |= kOutLeft;
+    } else if (p.x > kWidth) {
+        code |= kOutRight;
     }
-
-    std::vector<osm::Point<double>> corners;
-    osm::Point<double> point = *start.p;
-    osm::Point<double> next_corner = GetNextCorner(point);
-    while (!osm::utils::IsOnLine({.start=next_corner,.end=point}, *end.p)) {
-        corners.push_back(next_corner);
-        point = next_corner;
-        next_corner = GetNextCorner(point);
+    if (p.y < 0) {
+        code |= kOutTop;
+    } else if (p.y > kHeight) {
+        code |= kOutBottom;
     }
-
-    return corners;
+    return code;
 }
 
-osm::Point<double> OceanLandmassFactory::GetNextCorner(osm::Point<double> p)
+double OceanLandmassFactory::PerimeterPosition(const Point<double>& p, BorderType border_type) const
 {
-    if (p.x == 0 && p.y > 0 && p.y <= render_height_) return {.x=0,.y=0};
-    else if (p.y == 0 && p.x >= 0 && p.x < render_width_) return {.x=static_cast<double>(render_width_),.y=0};
-    else if (p.x == render_width_ && p.y >= 0 && p.y < render_height_) return {.x=static_cast<double>(render_width_),.y=static_cast<double>(render_height_)};
-    else if (p.y == render_height_ && p.x > 0 && p.x <= render_width_) return {.x=0,.y=static_cast<double>(render_height_)};
+    const double width = kWidth;
+    const double height = kHeight;
+    switch (border_type) {
+    case BorderType::kTop:
+        return p.x;
+    case BorderType::kRight:
+        return width + p.y;
+    case BorderType::kBottom:
+        return width + height + (width - p.x);
+    case BorderType::kLeft:
+        return 2 * width + height + (height - p.y);
+    default:
+        return 0;
+    }
 }
 
-void OceanLandmassFactory::FourthPass()
+BorderIntersectionPoint OceanLandmassFactory::NearestBorderPoint(const Point<double>& p, PointType point_type) const
 {
-    // Now go over all the edges (boundaries) again, and connect startpoint and endpoints....
-    std::queue<BorderIntersectionPoint> q;
-    for (auto it = border_type_to_intersection_point_[BorderType::kTop].begin();
-         it != border_type_to_intersection_point_[BorderType::kTop].end(); ++it) {
-        q.push(*it);
-    }
-    for (auto it = border_type_to_intersection_point_[BorderType::kRight].begin();
-         it != border_type_to_intersection_point_[BorderType::kRight].end(); ++it) {
-        q.push(*it);
-    }
-    for (auto it = border_type_to_intersection_point_[BorderType::kBottom].begin();
-         it != border_type_to_intersection_point_[BorderType::kBottom].end(); ++it) {
-        q.push(*it);
+    const double width = kWidth;
+    const double height = kHeight;
+    const double distances[4] = {p.y, width - p.x, height - p.y, p.x};
+    const BorderType borders[4] = {BorderType::kTop, BorderType::kRight, BorderType::kBottom, BorderType::kLeft};
+    int nearest = 0;
+    for (int k = 1; k < 4; ++k) {
+        if (distances[k] < distances[nearest]) {
+            nearest = k;
+        }
     }
-    for (auto it = border_type_to_intersection_point_[BorderType::kLeft].begin();
-         it != border_type_to_intersection_point_[BorderType::kLeft].end(); ++it) {
-        q.push(*it);
+    BorderIntersectionPoint border_ip;
+    border_ip.p = p;
+    if (borders[nearest] == BorderType::kLeft) border_ip.p.x = 0;
+    else if (borders[nearest] == BorderType::kRight) border_ip.p.x = width;
+    else if (borders[nearest] == BorderType::kTop) border_ip.p.y = 0;
+    else border_ip.p.y = height;
+    border_ip.border_type = borders[nearest];
+    border_ip.point_type = point_type;
+    border_ip.perimeter_position = PerimeterPosition(border_ip.p, border_ip.border_type);
+    return border_ip;
+}
+
+void OceanLandmassFactory::AddCornersCounterclockwise(double from, double to, std::vector<Point<double>>& ring) const
+{
+    const double width = kWidth;
+    const double height = kHeight;
+    // The corners in clockwise order, and their position on the perimeter.
+    const Point<double> corners[4] = {{{0}, {0}}, {{width}, {0}}, {{width}, {height}}, {{0}, {height}}};
+    const double positions[4] = {0, width, width + height, 2 * width + height};
+
+    if (to <= from) {
+        for (int k = 3; k >= 0; --k) {
+            if (positions[k] < from && positions[k] > to) {
+                ring.push_back(corners[k]);
+            }
+        }
+    } else {
+        // Walk past the top left corner, where the position wraps around.
+        for (int k = 3; k >= 0; --k) {
+            if (positions[k] < from) {
+                ring.push_back(corners[k]);
+            }
+        }
+        for (int k = 3; k >= 1; --k) {
+            if (positions[k] > to) {
+                ring.push_back(corners[k]);
+            }
+        }
     }
+}
 
-    if (q.empty()) {
+void OceanLandmassFactory::ThirdPass()
+{
+    const double width = kWidth;
+    const double height = kHeight;
+    if (bbox_.max_lat <= bbox_.min_lat || bbox_.max_lon <= bbox_.min_lon) {
         return;
     }
+    // The same linear mapping as utils::MapLatLonToXy(), but into the unit square.
+    const double min_lat = bbox_.min_lat;
+    const double min_lon = bbox_.min_lon;
+    const double scale_x = width / (static_cast<double>(bbox_.max_lon) - min_lon);
+    const double scale_y = height / (static_cast<double>(bbox_.max_lat) - min_lat);
+
+    // Every node is projected once. Then each segment is classified by the outcodes
+    // (Cohen-Sutherland) of its points: segments which are completely inside or completely
+    // on the outer side of one border are skipped, and only the remaining ones are clipped
+    // (Liang-Barsky) to find where they enter or leave the bbox.
+    // Points on the border count as inside, so a node which is exactly on the border is
+    // only found once.
+    // A coastline can enter and leave the bbox any number of times; each part inside
+    // becomes one coastline path.
+    std::vector<Point<double>> points;
+    for (auto it = work_set_.begin(); it != work_set_.end(); ++it) {
+        Way* w = *it;
 
-    if (q.front().point_type == PointType::kEnd) {
-        auto pt = q.front();
-        q.pop();
-        q.push(pt);
-    }
+        points.resize(w->nodes.size());
+        for (size_t node_i = 0; node_i < w->nodes.size(); ++node_i) {
+            points[node_i].x = (w->nodes[node_i]->lon - min_lon) * scale_x;
+            points[node_i].y = height - (w->nodes[node_i]->lat - min_lat) * scale_y;
+        }
+
+        // The index of the first path of this way, if the way starts inside of the bbox.
+        size_t first_path = coastline_paths_.size();
+        bool starts_inside = false;
+        CoastlinePath current_coastlinepath;
+        // Nodes on the border are also border points, so consecutive points can be the same.
+        auto append = [](CoastlinePath& path, const Point<double>& point) {
+            if (path.points.empty() || !(path.points.back() == point)) {
+                path.points.push_back(point);
+            }
+        };
+        bool inside = false;
+        int code_a = OutCode(points[0]);
+        if (code_a == kInside) {
+            starts_inside = true;
+            inside = true;
+            append(current_coastlinepath, points[0]);
+        }
+        for (size_t node_i = 1; node_i < points.size(); ++node_i) {
+            const Point<double>& a = points[node_i - 1];
+            const Point<double>& b = points[node_i];
+            int code_b = OutCode(b);
+            if ((code_a | code_b) == kInside) {
+                append(current_coastlinepath, b);
+                code_a = code_b;
+                continue;
+            }
+            if ((code_a & code_b) != kInside) {
+                code_a = code_b;
+                continue;
+            }
 
-    std::stack<std::vector<BorderIntersectionPoint>> s;
-    while (!q.empty()) {
-        auto bip = q.front();
-
-        if (bip.point_type == PointType::kStart) {
-            if (s.size() > 0) {
-                if (s.top().size() > 0) { // Should always be true
-                    //if (bip.w == p.back().w
-                    if (bip_to_coastlinepath_[bip] == bip_to_coastlinepath_[s.top().back()]
-                        && s.top().back().point_type == PointType::kEnd) {
-                        // If the coastline path of the next in the queue is the same as the last
-                        // one added to the stack (which was an endpoint), then add the current bip
-                        // (which is a startpoint) to the stack.
-                        s.top().push_back(bip);
-                    } else {
-                        // In this case the startpoint belongs to a new path, and we add it to the stack.
-                        s.push({});
-                        s.top().push_back(bip);
+            double dx = b.x - a.x;
+            double dy = b.y - a.y;
+            const double p[4] = {-dx, dx, -dy, dy};
+            const double q[4] = {a.x, width - a.x, a.y, height - a.y};
+            const BorderType borders[4] = {BorderType::kLeft, BorderType::kRight, BorderType::kTop, BorderType::kBottom};
+            double t_enter = 0;
+            double t_leave = 1;
+            BorderType enter_border = BorderType::kBorderTypeDefault;
+            BorderType leave_border = BorderType::kBorderTypeDefault;
+            bool rejected = false;
+            for (int k = 0; k < 4 && !rejected; ++k) {
+                if (p[k] == 0) {
+                    rejected = q[k] < 0;
+                } else if (p[k] < 0) {
+                    double t = q[k] / p[k];
+                    if (t > t_enter) {
+                        t_enter = t;
+                        enter_border = borders[k];
+                    }
+                } else {
+                    double t = q[k] / p[k];
+                    if (t < t_leave) {
+                        t_leave = t;
+                        leave_border = borders[k];
                     }
                 }
-            } else {
-                s.push({});
-                s.top().push_back(bip);
             }
-        } else if (bip.point_type == PointType::kEnd) {
-            if (s.size() > 0) {
-                if (s.top().size() > 0) { // Should always be true
-                    //if (bip.w == p.back().w
-                    if (bip_to_coastlinepath_[bip] == bip_to_coastlinepath_[s.top().front()]
-                        && s.top().front().point_type == PointType::kStart) {
-                        s.top().push_back(bip);
-                        coastline_polygons_.insert(CloseCoastlinePath(s.top()));
-                        s.pop();
-                    } else {
-                        s.top().push_back(bip);
-                    }
+            if (rejected || t_enter > t_leave || (code_a != kInside && code_b != kInside && t_enter == t_leave)) {
+                // The segment misses the bbox, or just touches a corner.
+                code_a = code_b;
+                continue;
+            }
+
+            auto border_point = [&](double t, BorderType border_type, PointType point_type) {
+                BorderIntersectionPoint border_ip;
+                if (t == 0) {
+                    // A node on the border is the border point itself.
+                    border_ip.p = a;
+                } else if (t == 1) {
+                    border_ip.p = b;
+                } else {
+                    border_ip.p.x = a.x + t * dx;
+                    border_ip.p.y = a.y + t * dy;
                 }
+                // Put the point exactly on the border.
+                if (border_type == BorderType::kLeft) border_ip.p.x = 0;
+                else if (border_type == BorderType::kRight) border_ip.p.x = width;
+                else if (border_type == BorderType::kTop) border_ip.p.y = 0;
+                else if (border_type == BorderType::kBottom) border_ip.p.y = height;
+                border_ip.w = w;
+                border_ip.border_type = border_type;
+                border_ip.point_type = point_type;
+                border_ip.perimeter_position = PerimeterPosition(border_ip.p, border_type);
+                return border_ip;
+            };
+
+            if (code_a != kInside) {
+                // Node i-1 is outside and the segment enters the bbox => startpoint.
+                current_coastlinepath = CoastlinePath();
+                current_coastlinepath.start = border_point(t_enter, enter_border, PointType::kStart);
+                append(current_coastlinepath, current_coastlinepath.start.p);
+                inside = true;
+            }
+            if (code_b != kInside) {
+                // Node i is outside and the segment leaves the bbox => endpoint.
+                current_coastlinepath.end = border_point(t_leave, leave_border, PointType::kEnd);
+                append(current_coastlinepath, current_coastlinepath.end.p);
+                // Unless the coastline just touches the border, i.e. the path is a single point.
+                // The first path of a way which starts on the border is kept for now, since a
+                // closed way continues with it (see below).
+                if (current_coastlinepath.points.size() > 1
+                    || (starts_inside && coastline_paths_.size() == first_path)) {
+                    coastline_paths_.push_back(std::move(current_coastlinepath));
+                }
+                current_coastlinepath = CoastlinePath();
+                inside = false;
+            } else {
+                append(current_coastlinepath, b);
             }
+            code_a = code_b;
         }
 
-        q.pop();
+        if (!inside) {
+            // Nothing to continue.
+        } else if (starts_inside && first_path == coastline_paths_.size()) {
+            // The way never leaves the bbox. If it is closed, it is an island.
+            if (w->is_closed) {
+                coastline_paths_.push_back(std::move(current_coastlinepath));
+            }
+        } else if (starts_inside && w->is_closed) {
+            // A closed way which starts inside: the last path continues with the first one.
+            CoastlinePath& first = coastline_paths_[first_path];
+            current_coastlinepath.points.insert(current_coastlinepath.points.end(),
+                                                first.points.begin() + 1, first.points.end());
+            current_coastlinepath.end = first.end;
+            first = std::move(current_coastlinepath);
+        } else if (current_coastlinepath.points.size() > 1) {
+            // The coastline ends inside of the bbox (i.e. it is cut off by the extract).
+            coastline_paths_.push_back(std::move(current_coastlinepath));
+        }
+        if (starts_inside && first_path < coastline_paths_.size() && coastline_paths_[first_path].points.size() < 2) {
+            // The way starts on the border and leaves it at once, and nothing continues with it.
+            coastline_paths_.erase(coastline_paths_.begin() + first_path);
+        }
     }
 }
 
-void OceanLandmassFactory::GetClosestPoint(const Way* const way)
+void OceanLandmassFactory::FourthPass()
 {
+    // Every border intersection point is mapped to its clockwise position along the
+    // perimeter (see PerimeterPosition()). The land is on the left of a coastline, so a
+    // ring continues from the endpoint of a path counterclockwise along the border to
+    // the nearest startpoint, which is found by a binary search in the sorted startpoints.
+    std::vector<std::pair<double, size_t>> startpoints;
+    size_t cut_off = 0;
+    for (size_t i = 0; i < coastline_paths_.size(); ++i) {
+        CoastlinePath& path = coastline_paths_[i];
+        if (path.start.point_type == PointType::kPointTypeDefault
+            && path.end.point_type == PointType::kPointTypeDefault
+            && path.points.front() == path.points.back()) {
+            // An island inside of the bbox is already a ring.
+            if (path.points.size() > 3) {
+                coastline_polygons_.push_back(path.points);
+            }
+            continue;
+        }
+        if (path.start.point_type != PointType::kStart || path.end.point_type != PointType::kEnd) {
+            // The coastline is cut off inside of the bbox (i.e. by the extract, see SecondPass()).
+            // It is continued straight to the nearest border, so that the land along it isn't lost.
+            ++cut_off;
+            if (path.start.point_type != PointType::kStart) {
+                path.start = NearestBorderPoint(path.points.front(), PointType::kStart);
+                if (!(path.start.p == path.points.front())) {
+                    path.points.insert(path.points.begin(), path.start.p);
+                }
+            }
+            if (path.end.point_type != PointType::kEnd) {
+                path.end = NearestBorderPoint(path.points.back(), PointType::kEnd);
+                if (!(path.end.p == path.points.back())) {
+                    path.points.push_back(path.end.p);
+                }
+            }
+        }
+        startpoints.push_back({path.start.perimeter_position, i});
+    }
+    if (cut_off > 0) {
+        qDebug() << "Closed" << cut_off << "coastlines which end inside of the bbox at the nearest border";
+    }
+    if (startpoints.empty()) {
+        return;
+    }
+    std::sort(startpoints.begin(), startpoints.end());
+
+    const size_t kNone = std::numeric_limits<size_t>::max();
+    std::vector<size_t> next(coastline_paths_.size(), kNone);
+    for (auto it = startpoints.begin(); it != startpoints.end(); ++it) {
+        double end_position = coastline_paths_[it->second].end.perimeter_position;
+        // The startpoint with the largest position <= end_position, or else the last one.
+        auto next_it = std::upper_bound(startpoints.begin(), startpoints.end(),
+                                        std::make_pair(end_position, kNone));
+        if (next_it == startpoints.begin()) {
+            next_it = startpoints.end();
+        }
+        --next_it;
+        next[it->second] = next_it->second;
+    }
 
+    std::vector<bool> visited(coastline_paths_.size(), false);
+    for (auto it = startpoints.begin(); it != startpoints.end(); ++it) {
+        if (visited[it->second]) {
+            continue;
+        }
+        std::vector<Point<double>> ring;
+        size_t i = it->second;
+        do {
+            visited[i] = true;
+            const CoastlinePath& path = coastline_paths_[i];
+            ring.insert(ring.end(), path.points.begin(), path.points.end());
+            AddCornersCounterclockwise(path.end.perimeter_position,
+                                       coastline_paths_[next[i]].start.perimeter_position, ring);
+            i = next[i];
+            // With broken data two endpoints can lead to the same startpoint; then the ring
+            // is closed early.
+        } while (!visited[i]);
+        coastline_polygons_.push_back(std::move(ring));
+    }
 }
 
 double OceanLandmassFactory::Distance(double a_lat, double a_lon, double b_lat, double b_lon)
@@ -710,34 +628,4 @@ double OceanLandmassFactory::Distance(double a_lat, double a_lon, double b_lat,
     return osm::utils::HaversineKm(a_lat, a_lon, b_lat, b_lon);
 }
 
-std::shared_ptr<Point<double>> OceanLandmassFactory::Intersection(const Line<double>& a, const Line<double>& b)
-{
-    double a1 = a.end.y - a.start.y;
-    double b1 = a.start.x - a.end.x;
-    double c1 = a1 * a.start.x + b1 * a.start.y;
-
-    double a2 = b.end.y - b.start.y;
-    double b2 = b.start.x - b.end.x;
-    double c2 = a2 * b.start.x + b2 * b.start.y;
-
-    double determinant = a1 * b2 - a2 * b1;
-
-    if (determinant == 0) {
-        // Lines are parallel.
-        return nullptr;
-    }
-
-    std::shared_ptr<Point<double>> c_out = std::make_shared<Point<double>>();
-    c_out->x = (b2 * c1 - b1 * c2) / determinant;
-    c_out->y = (a1 * c2 - a2 * c1) / determinant;
-
-    // Ok, now we're sure that there is an intersection point - somewhere.
-    // Let's see if it is within the start- and endpoints of both lines.
-    if (osm::utils::IsOnLine(a, *c_out) && osm::utils::IsOnLine(b, *c_out)) {
-        return c_out;
-    }
-
-    return nullptr;
-}
-
 }  // namespace osm
@@ -1,57 +1,14 @@
 #ifndef OCEANLANDMASSFACTORY_H
 #define OCEANLANDMASSFACTORY_H
 
+#include "constants.h"
 #include "objects.h"
 #include "types.h"
 
-#include <functional>
-#include <map>
 #include <memory>
-#include <set>
 #include <sstream>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
-/*
- PSEUDO CODE ALGORITHM FOR COASTLINE POLYGONS:
-
- 1) Calculate the border intersection points BIPs (DONE)
-
- 2) Put in queue q clockwise beginning at the top border
-     If first element is E, then remove from front and add to back
- queue q;
- for all BIP on top: add BIP to q
- for all BIP on right: add BIP to q
- for all BIP on bottom: add BIP to q
- for all BIP on left: add BIP to q
- if q.front is E: remove q.front and add to q.back
-
- 3) Then run the algorithm:
- stack<path> s;
- while (!q.isempty())
-    BIP = q.front
-    check if BIP is A of tail of s.top
-        no: s.push(new path); s.top.append(BIP)
-        yes: s.top.append(BIP)
-    check if BIP is E of head of s.top
-        no: s.top.append(BIP)
-        yes: s.top.append(BIP), close s.top, pop s.top
-
- path is just a vector of BIPs
-
- close-function:
- polygon p;
- for i=0 to i=path.size
-    if i==0: p.add(path[i])
-    else if i>0 && path[i]==E:
-        if path[i-1] and path[i] different borders, then p.add(corner) && p.add(path[i])
-        else: p.add(path[i]);
-    else if i>0 && path[i]==A: p.add(all points of way between path[i] and path[i-1]
-    else if i==path.size: p.add(all points of way between path[0] and path[i]
-
-*/
-
 namespace osm
 {
 
@@ -59,53 +16,32 @@ enum BorderType { kTop = 0, kRight = 1, kBottom = 2, kLeft = 3, kBorderTypeDefau
 enum PointType { kStart = 0, kEnd = 1, kPointTypeDefault = -1 };
 struct BorderIntersectionPoint
 {
-    std::shared_ptr<Point<double>> p;
-    //Point<double> p;
+    Point<double> p;
     PointType point_type;
     Way* w;
     BorderType border_type;
-    Line<double> border;  // top, right, bottom, left.
+    // The clockwise distance along the border from the top left corner.
+    double perimeter_position;
 
     BorderIntersectionPoint()
     {
         point_type = PointType::kPointTypeDefault;
         border_type = BorderType::kBorderTypeDefault;
-        p = nullptr;
+        p.x = p.y = 0;
         w = nullptr;
+        perimeter_position = 0;
     }
 
     std::string to_string() const
     {
         std::stringstream ss;
         ss << "Point: type=" << (point_type == PointType::kStart ? "start" : "end");
-        if (p != nullptr) {
-            ss << " x=" << p->x << ",y=" << p->y;
-        }
+        ss << " x=" << p.x << ",y=" << p.y;
         if (w != nullptr) {
             ss << " way=" << w->id << " <" << w << ">";
         }
         return ss.str();
     }
-
-    // TODO: Check for way and x and y, too. Two different ways could go through the same coordinates at the same border.
-    bool operator<(const BorderIntersectionPoint& p)  const {
-        // If you would need to store the points for multiple border types
-        // in one container, then you should use the following comparison:
-        // return (border_type < p.border_type) || ((border_type == p.border_type) && (this->p < p.p)); //(point_type < p.point_type));
-        // If you are only interested in the geographical order, then just compare the points.
-
-        return (*this->p.get() < *p.p.get());
-    }
-
-    // TODO: Check for way and x and y, too. Two different ways could go through the same coordinates at the same border.
-    bool operator==(const BorderIntersectionPoint& p)  const {
-        // If you would need to store the points for multiple border types
-        // in one container, then you should use the following comparison:
-        // return p.border_type == border_type && p.p == this->p;//p.point_type == point_type;
-        // If you are only interested in the geographical order, then just compare the points.
-
-        return *p.p.get() == *this->p.get();
-    }
 };
 
 struct CoastlinePath
@@ -123,85 +59,82 @@ struct CoastlinePath
         return ss.str();
     }
 };
-}
-
-namespace std {
-template <>
-struct hash<osm::BorderIntersectionPoint>
-{
-    size_t operator() (const osm::BorderIntersectionPoint &bip) const
-    {
-        return ((uint64_t)bip.p->x)<<32 | (uint64_t)bip.p->y;
-    }
-};
-}
-
-namespace osm
-{
 
 // Computes the landmass polygons from the coastline ways.
-// The polygon coordinates are already mapped from lat/lon to the screen space, and
-// therefore don't need to be mapped again when drawing.
-// Remember to subclass the OsmObjCollection and its RenderPoints method.
+// The polygon coordinates are mapped from lat/lon to the unit square of the bbox
+// (x to the right, y down), so they only need to be scaled to the canvas size when drawing.
+// The connected coastlines are kept between the builds: keep one factory per dataset, and
+// only the clipping and the ring closing are redone for another bbox.
 class OceanLandmassFactory
 {
 public:
     explicit OceanLandmassFactory() = default;
-    OceanLandmassFactory(osm::Objects* coastline_objects,
-                         int window_width, int window_height,
-                         float render_scale, osm::Point<int> render_offset,
-                         const BoundingBox& bbox);
-    void Build();
+    explicit OceanLandmassFactory(osm::Objects* coastline_objects);
+    void Build(const BoundingBox& bbox);
+    // Only connects the coastlines into the WorkSetWays() (i.e. for the CoastlineRasterizer).
+    void BuildChains();
 
-    std::set<Way*>& WorkSetWays() { return work_set_; }
-    std::set<std::vector<osm::Point<double>>>& CoastlinePolygon() { return coastline_polygons_; }
+    // Coastline ends which are closer than this are connected by the second pass (default: kCoastlineGapToleranceKm).
+    void GapTolerance(double km);
+    double GapTolerance() const { return gap_tolerance_km_; }
+
+    std::vector<Way*>& WorkSetWays() { return work_set_; }
+    std::vector<std::vector<osm::Point<double>>>& CoastlinePolygon() { return coastline_polygons_; }
 
 private:
-    // Get the way of which the startpoint is not equal to any other endpoint ("single startpoint").
+    // Links the coastline ways which share their end- and startpoint into chains (in linear time).
     void FirstPass();
     // Now try to connect lines with not the same start- and endpoint IDs, but very close locations.
+    // The startpoints are put into a grid hash, so that each endpoint is only compared with the
+    // startpoints nearby; then the smallest gaps within the tolerance are closed first.
     void SecondPass();
-    // This pass calculates the intersections of the connected ways with the bounding box.
+    // Copies each linked chain into one way.
+    void MaterializeChains();
+    // This pass calculates the intersections of the connected ways with the bounding box,
+    // and splits them into the coastline paths inside of it.
     void ThirdPass();
     // Creates polygons from the generated coastlines and the found intersection points with the borders.
+    // Coastlines which end inside of the bbox are continued to the nearest border first.
     void FourthPass();
 
-    std::vector<osm::Point<double>> CloseCoastlinePath(std::vector<BorderIntersectionPoint>& path);
-    std::vector<osm::Point<double>> GetCornerPoints(BorderIntersectionPoint& start, BorderIntersectionPoint& end);
-    osm::Point<double> GetNextCorner(osm::Point<double> p);
+    // Returns the clockwise distance of a point on the given border from the top left corner.
+    double PerimeterPosition(const Point<double>& p, BorderType border_type) const;
+    // Returns the point on the border which is nearest to a point inside of the bbox.
+    BorderIntersectionPoint NearestBorderPoint(const Point<double>& p, PointType point_type) const;
+    // Adds the corners between the two perimeter positions, walking counterclockwise from "from" to "to".
+    void AddCornersCounterclockwise(double from, double to, std::vector<Point<double>>& ring) const;
 
-    void GetClosestPoint(const Way* const way);
     // Returns the distance in KM.
     double Distance(double a_lat, double a_lon, double b_lat, double b_lon);
-    //bool Intersection(const Line<int>& a, const Line<int>& b, Point<double>& c_out);
-    std::shared_ptr<Point<double>> Intersection(const Line<double>& a, const Line<double>& b);
-    void SetIntersectionPointType(BorderIntersectionPoint& border_ip, const Point<double>& node_im1, const Point<double>& node_i);
+    // Returns the outcode of the point (see ThirdPass()); 0 means inside or on the border.
+    int OutCode(const Point<double>& p) const;
 
 private:
-    int render_width_;
-    int render_height_;
-    float render_scale_;
-    Point<int> render_offset_;
-    //std::set<Way*> ways_; // Working copy (TODO: not needed...)
-    BoundingBox bbox_;
+    BoundingBox bbox_ = {0, 0, 0, 0};
 
     /* rings */
     /* coastlines */
     /* unconnected_coastlines */
 
-    std::set<std::vector<osm::Point<double>>> coastline_polygons_;
+    // The landmass rings (the land is on the left of the coastline direction).
+    std::vector<std::vector<osm::Point<double>>> coastline_polygons_;
+
+    // First and second pass variables.
+    static const int32_t kNoSegment = -1;
+    std::vector<Way*> segments_;
+    std::vector<int32_t> next_;
+    std::vector<int32_t> prev_;
+    double gap_tolerance_km_ = kCoastlineGapToleranceKm;
+    bool chains_built_ = false;
 
-    // First pass variables.
-    std::set<Way*> work_set_;
-    osm::Objects* coastline_objects_;
+    // The connected coastlines (either original ways or ways owned by chains_).
+    std::vector<Way*> work_set_;
+    std::vector<std::unique_ptr<Way>> chains_;
+    osm::Objects* coastline_objects_ = nullptr;
 
     // Third pass variables.
-    std::unordered_map<BorderType, std::set<BorderIntersectionPoint>, std::hash<int>> border_type_to_intersection_point_;
-    //std::unordered_set<Point<double>, PointHashFunction<double>> intersection_points_;  // key = x, value = y; Used to avoid duplicates
-    std::unordered_map<Way*, std::vector<BorderIntersectionPoint>> way_to_border_intersection_point_;
-    std::unordered_map<BorderIntersectionPoint, Way*> border_intersection_point_to_way_;
-    //std::unordered_map<BorderIntersectionPoint, CoastlinePath> bip_to_coastlinepath_;
-    std::unordered_map<BorderIntersectionPoint, std::shared_ptr<CoastlinePath>> bip_to_coastlinepath_;
+    // The parts of the coastlines inside of the bbox.
+    std::vector<CoastlinePath> coastline_paths_;
 };
 
 }  // namespace osm
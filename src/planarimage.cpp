@@ -0,0 +1,117 @@
+#include "planarimage.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace effects {
+
+const int PlanarImage::kChannels;
+const int PlanarImage::kAlpha;
+
+PlanarImage::PlanarImage(int width, int height) : width_(width), height_(height)
+{
+}
+
+PlanarImage PlanarImage::FromImage(const QImage& image)
+{
+    if (image.format() == QImage::Format_Grayscale8) {
+        PlanarImage planar(image.width(), image.height());
+        planar.AllocatePlane(0);
+        for (int y = 0; y < image.height(); ++y) {
+            std::memcpy(planar.Plane(0) + static_cast<size_t>(y) * planar.width_, image.constScanLine(y), planar.width_);
+        }
+        planar.SharePlane(1, 0);
+        planar.SharePlane(2, 0);
+        return planar;
+    }
+
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    PlanarImage planar(rgba.width(), rgba.height());
+    for (int channel = 0; channel < kChannels; ++channel) {
+        planar.AllocatePlane(channel);
+    }
+    for (int y = 0; y < rgba.height(); ++y) {
+        const uint8_t* line = rgba.constScanLine(y);
+        size_t offset = static_cast<size_t>(y) * planar.width_;
+        for (int channel = 0; channel < kChannels; ++channel) {
+            uint8_t* plane = planar.Plane(channel) + offset;
+            for (int x = 0; x < planar.width_; ++x) {
+                plane[x] = line[kChannels * x + channel];
+            }
+        }
+    }
+    // The layers are rendered in black and white, so the color channels are usually equal.
+    size_t bytes = planar.PixelsCount();
+    for (int channel = 1; channel < 3; ++channel) {
+        if (std::memcmp(planar.Plane(0), planar.Plane(channel), bytes) == 0) {
+            planar.SharePlane(channel, 0);
+        }
+    }
+    const uint8_t* alpha = planar.Plane(kAlpha);
+    if (std::all_of(alpha, alpha + bytes, [](uint8_t value) { return value == 255; })) {
+        planar.planes_[kAlpha].reset();
+    }
+    return planar;
+}
+
+QImage PlanarImage::ToImage() const
+{
+    QImage image(width_, height_, QImage::Format_RGBA8888);
+    const int channels = Opaque() ? kAlpha : kChannels;
+    for (int y = 0; y < height_; ++y) {
+        uint8_t* line = image.scanLine(y);
+        size_t offset = static_cast<size_t>(y) * width_;
+        for (int channel = 0; channel < channels; ++channel) {
+            const uint8_t* plane = Plane(channel) + offset;
+            for (int x = 0; x < width_; ++x) {
+                line[kChannels * x + channel] = plane[x];
+            }
+        }
+        if (Opaque()) {
+            for (int x = 0; x < width_; ++x) {
+                line[kChannels * x + kAlpha] = 255;
+            }
+        }
+    }
+    return image;
+}
+
+uint8_t* PlanarImage::Plane(int channel)
+{
+    return const_cast<uint8_t*>(static_cast<const PlanarImage*>(this)->Plane(channel));
+}
+
+const uint8_t* PlanarImage::Plane(int channel) const
+{
+    if (channel == kAlpha && !planes_[kAlpha]) {
+        planes_[kAlpha] = std::make_shared<std::vector<uint8_t>>(PixelsCount(), 255);
+    }
+    return planes_[channel]->data();
+}
+
+void PlanarImage::AllocatePlane(int channel)
+{
+    planes_[channel] = std::make_shared<std::vector<uint8_t>>(PixelsCount());
+}
+
+void PlanarImage::SharePlane(int channel, int source_channel)
+{
+    planes_[channel] = planes_[source_channel];
+}
+
+int PlanarImage::PlaneOwner(int channel) const
+{
+    for (int other = 0; other < channel; ++other) {
+        if (planes_[other] == planes_[channel]) {
+            return other;
+        }
+    }
+    return channel;
+}
+
+void PlanarImage::Fill(int channel, uint8_t value)
+{
+    std::fill(Plane(channel), Plane(channel) + PixelsCount(), value);
+}
+
+}  // namespace effects
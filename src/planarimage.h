@@ -0,0 +1,61 @@
+#ifndef PLANARIMAGE_H
+#define PLANARIMAGE_H
+
+#include <QImage>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace effects {
+
+// An RGBA image with 8 bits per channel, stored as one plane per channel (for the CPU
+// implementation of the render passes). Channels with equal content can share their
+// plane (i.e. the color channels of a grey image), so that they are only processed once.
+// An opaque image has no alpha plane, so a black and white layer is a single 8 bit
+// coverage plane until it is colorized.
+class PlanarImage
+{
+public:
+    static const int kChannels = 4;
+    static const int kAlpha = 3;
+
+    PlanarImage() = default;
+    // The planes are not allocated yet, see AllocatePlane() and SharePlane(). Without an
+    // alpha plane, the image is opaque.
+    PlanarImage(int width, int height);
+
+    // Converts the image; color channels which are equal share one plane, and the alpha plane
+    // is left out if the image is opaque. Grayscale8 images are copied as one plane.
+    static PlanarImage FromImage(const QImage& image);
+    QImage ToImage() const;
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    size_t PixelsCount() const { return static_cast<size_t>(width_) * height_; }
+    bool IsNull() const { return width_ == 0 || height_ == 0; }
+    bool Opaque() const { return !planes_[kAlpha]; }
+
+    // The pixels of the channel, row by row (the stride is the width).
+    // Writing to a shared plane changes all channels which share it. The alpha plane of
+    // an opaque image is created (filled with 255) when it is accessed.
+    uint8_t* Plane(int channel);
+    const uint8_t* Plane(int channel) const;
+    void AllocatePlane(int channel);
+    // Makes the channel share the plane of another channel.
+    void SharePlane(int channel, int source_channel);
+    // Returns the first channel which has the same plane as the given one.
+    int PlaneOwner(int channel) const;
+    void Fill(int channel, uint8_t value);
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+    // Mutable for the alpha plane of opaque images.
+    mutable std::shared_ptr<std::vector<uint8_t>> planes_[kChannels];
+};
+
+}  // namespace effects
+
+#endif // PLANARIMAGE_H
@@ -0,0 +1,54 @@
+#include "polygonobjects.h"
+#include "triangulator.h"
+
+namespace osm {
+
+void PolygonRings::Triangulate()
+{
+    triangles.clear();
+    triangle_offsets.clear();
+    triangle_offsets.reserve(PolygonsCount() + 1);
+    triangle_offsets.push_back(0);
+
+    Triangulator triangulator;
+    std::vector<uint32_t> hole_starts;
+    for (size_t polygon = 0; polygon < PolygonsCount(); ++polygon) {
+        uint32_t first_ring = polygon_offsets[polygon];
+        uint32_t last_ring = polygon_offsets[polygon + 1];
+        uint32_t start = ring_offsets[first_ring];
+        hole_starts.clear();
+        for (uint32_t ring = first_ring + 1; ring < last_ring; ++ring) {
+            hole_starts.push_back(ring_offsets[ring] - start);
+        }
+        triangulator.Triangulate(points.data() + start, ring_offsets[last_ring] - start,
+                                 hole_starts, start, triangles);
+        triangle_offsets.push_back(triangles.size());
+    }
+}
+
+PolygonObjects::PolygonObjects(const std::string& name, ObjectsTypes type)
+    : Objects(name, {}, type)
+{
+}
+
+PolygonObjects::~PolygonObjects()
+{
+
+}
+
+int PolygonObjects::Size()
+{
+    if (land_mask_) {
+        return 1;
+    }
+    return rings_ ? rings_->PolygonsCount() : 0;
+}
+
+void PolygonObjects::Clear()
+{
+    Objects::Clear();
+    rings_ = nullptr;
+    land_mask_ = nullptr;
+}
+
+}  // namespace osm
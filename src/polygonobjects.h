@@ -0,0 +1,64 @@
+#ifndef POLYGONOBJECTS_H
+#define POLYGONOBJECTS_H
+
+#include "objects.h"
+#include "types.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace osm
+{
+
+// Generated polygons (i.e. ocean and landmass), stored contiguously.
+// Ring i consists of the points [ring_offsets[i], ring_offsets[i+1]).
+// Polygon j consists of the rings [polygon_offsets[j], polygon_offsets[j+1]),
+// where the first ring is the outer ring and all others are holes.
+// The points are in canvas coordinates of a canvas with the size width x height.
+// After Triangulate(), the fill of polygon j consists of the triangles
+// [triangle_offsets[j], triangle_offsets[j+1]) in triangles (indices into points).
+struct PolygonRings
+{
+    std::vector<Point<float>> points;
+    std::vector<uint32_t> ring_offsets;
+    std::vector<uint32_t> polygon_offsets;
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> triangle_offsets;
+    float width;
+    float height;
+
+    void Triangulate();
+
+    size_t RingsCount() const { return ring_offsets.empty() ? 0 : ring_offsets.size() - 1; }
+    size_t PolygonsCount() const { return polygon_offsets.empty() ? 0 : polygon_offsets.size() - 1; }
+};
+
+class CoastlineRasterizer;
+
+// An objects layer which does not grab any ways from the map data, but consists of
+// generated polygons instead. The rings can be shared between several layers
+// (i.e. ocean and landmass are drawn from the same rings).
+// Instead of the rings, the land can also be given as a raster (see CoastlineRasterizer).
+class PolygonObjects : public Objects
+{
+public:
+    PolygonObjects(const std::string& name, ObjectsTypes type);
+    virtual ~PolygonObjects();
+
+    std::shared_ptr<const PolygonRings> Rings() const { return rings_; }
+    void Rings(std::shared_ptr<const PolygonRings> rings) { rings_ = rings; }
+    std::shared_ptr<const CoastlineRasterizer> LandMask() const { return land_mask_; }
+    void LandMask(std::shared_ptr<const CoastlineRasterizer> land_mask) { land_mask_ = land_mask; }
+
+    virtual int Size() override;
+    virtual void Clear() override;
+
+private:
+    std::shared_ptr<const PolygonRings> rings_;
+    std::shared_ptr<const CoastlineRasterizer> land_mask_;
+};
+
+}  // namespace osm
+
+#endif // POLYGONOBJECTS_H
@@ -18,9 +18,17 @@
 
 #include "qnoise.h"
 
+#include "cpukernels.h"
+
+#include <algorithm>
 #include <numeric>
 #include <cmath>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QNOISE_X86
+#include <immintrin.h>
+#endif
+
 static const double STRETCH_CONSTANT_2D = -0.211324865405187;    //(1/Math.sqrt(2+1)-1)/2;
 static const double SQUISH_CONSTANT_2D = 0.366025403784439;      //(Math.sqrt(2+1)-1)/2;
 static const double NORM_CONSTANT_2D = 47;
@@ -82,6 +90,7 @@ QNoise::QNoise(const std::vector<short> &permutation)
     for( short s(0), length(gradients3D.size()/ 3); s < 256; s++) {
         m_permGradIndex3D[s] = (m_permutation.at(s) % length) * 3;
     }
+    prepare_batch_tables();
 }
 
 //Generates a permutation array from a 64 bit seed
@@ -90,11 +99,15 @@ QNoise::QNoise(int64_t seed)
     setSeed(seed);
 }
 
-QImage QNoise::create_noise_image(int width, int height, double scale_factor)
+QImage QNoise::create_noise_image(int width, int height, double scale_factor, int octaves, int64_t seed)
+{
+    return create_noise_image(QRect(0, 0, width, height), width, scale_factor, octaves, seed);
+}
+
+QImage QNoise::create_noise_image(const QRect& region, int world_width, double scale_factor, int octaves, int64_t seed)
 {
     //Increasing the img size only increases the noise resolution, does not the scale the resulting image
-    //400 x 400 is decently fast, < 50ms in my tests
-    QImage img(width, height, QImage::Format_RGB888);
+    QImage img(region.width(), region.height(), QImage::Format_Grayscale8);
 
     if (scale_factor == 0) {
         img.fill(Qt::black);
@@ -102,29 +115,27 @@ QImage QNoise::create_noise_image(int width, int height, double scale_factor)
     }
 
     //double scaleFactor = 5 + 20; // + 50.0;
-    double zPane(0), offSetX(0), offSetY(0);
-
-    QNoise noise(2437);
-    for(uint i(0), h(height); i < h; i++) {
-        uchar *index = img.scanLine(i);
-        for(uint j(0), bpl(img.bytesPerLine()); j < bpl; j+=3){
-            // x and y for NoiseMap
-            double x = j/static_cast<double>(bpl);
-            double y = i/static_cast<double>(h);
-
-            double noiseValue(0);
-
-            noiseValue = noise.noise(scale_factor * x + offSetX, scale_factor * y + offSetY, zPane);
-            //Constrains the noise value, that is between -1 and 1 to 0 and 1
-            noiseValue = (noiseValue + 1) /2;
-
-            uchar grey = std::floor(255 * noiseValue); // Smooth
-            //uchar grey = noiseValue < 0.82 ? 0 : 255; // High contrast  (orig: noiseValue < 0.5), 0.92 looks good
-
-            for(int a(0); a < 3; a++)
-                memcpy(index+j+a, &grey, 1);
+    double offSetY(0);
+
+    QNoise noise(seed);
+    // x and y for NoiseMap, in units of the world width.
+    const double dx = scale_factor / world_width;
+    const int width = region.width();
+    const int bpl = img.bytesPerLine();
+    uchar* bits = img.bits();
+    effects::cpu::ParallelFor(region.height(), [&](int begin, int end) {
+        std::vector<float> values(width);
+        for (int i = begin; i < end; ++i) {
+            // The 2D noise: a plane of the 3D noise would sum up 26 instead of 8 lattice vertices.
+            noise.noise_row(values.data(), region.x(), width, dx, dx * (region.y() + i) + offSetY, octaves);
+            uchar* index = bits + static_cast<size_t>(i) * bpl;
+            for (int j = 0; j < width; ++j) {
+                //Constrains the noise value, that is between -1 and 1 to 0 and 1
+                float noiseValue = (values[j] + 1) / 2;
+                index[j] = std::min(255.0f, std::floor(255 * noiseValue)); // Smooth
+            }
         }
-    }
+    }, 16);
 
     return img;
 }
@@ -153,6 +164,7 @@ void QNoise::setSeed(int64_t seed)
         m_permGradIndex3D[i] = static_cast<short>((m_permutation.at(i) % length) * 3);
         source[r] = source.at(i);
     }
+    prepare_batch_tables();
 }
 
 //2d OpenSimplex Noise
@@ -2165,19 +2177,339 @@ double QNoise::noise(double x, double y, double z, double w)
 
 double QNoise::extrapolate(int xsb, int ysb, double dx, double dy)
 {
-    int index = m_permutation.at((m_permutation.at(xsb & 0xFF) + ysb) & 0xFF) & 0x0E;
-    return gradients2D.at(index) * dx + gradients2D.at(index + 1) * dy;
+    //The indices are masked into the tables, so they aren't checked with at().
+    int index = m_permutation[(m_permutation[xsb & 0xFF] + ysb) & 0xFF] & 0x0E;
+    return gradients2D[index] * dx + gradients2D[index + 1] * dy;
 }
 
 double QNoise::extrapolate(int xsb, int ysb, int zsb, double dx, double dy, double dz)
 {
-    int index = m_permGradIndex3D.at((m_permutation.at((m_permutation.at(xsb & 0xFF) + ysb) & 0xFF) + zsb) & 0xFF);
-    return gradients3D.at(index) * dx + gradients3D.at(index + 1) * dy + gradients3D.at(index + 2) * dz;
+    int index = m_permGradIndex3D[(m_permutation[(m_permutation[xsb & 0xFF] + ysb) & 0xFF] + zsb) & 0xFF];
+    return gradients3D[index] * dx + gradients3D[index + 1] * dy + gradients3D[index + 2] * dz;
 }
 
 double QNoise::extrapolate(int xsb, int ysb, int zsb, int wsb, double dx, double dy, double dz, double dw)
 {
-    int index = m_permutation.at((m_permutation.at((m_permutation.at((m_permutation.at(xsb & 0xFF) + ysb) & 0xFF) + zsb) & 0xFF) + wsb) & 0xFF) & 0xFC;
+    int index = m_permutation[(m_permutation[(m_permutation[(m_permutation[xsb & 0xFF] + ysb) & 0xFF] + zsb) & 0xFF] + wsb) & 0xFF] & 0xFC;
     return gradients4D[index] * dx + gradients4D[index + 1] * dy
             + gradients4D[index + 2] * dz + gradients4D[index + 3] * dw;
 }
+
+//Batch evaluation (noise_row)
+
+namespace {
+
+//The lattice vertices which can contribute to a point, relative to the origin of its
+//stretched cell (the other vertices are too far away for any point of the cell).
+//noise() picks the 3 to 4 (2D) or 6 to 9 (3D) vertices of the region of the point; the
+//batches sum all of them, masked by their attenuation, so that all lanes do the same.
+const int kBatchVertices2D[8][3] = {
+    {-1, 1, 0}, {0, 0, 0}, {0, 1, 0}, {0, 2, 0}, {1, -1, 0}, {1, 0, 0}, {1, 1, 0}, {2, 0, 0},
+};
+const int kBatchVertices3D[26][3] = {
+    {-1, 0, 1}, {-1, 1, 0}, {-1, 1, 1}, {0, -1, 1}, {0, 0, 0}, {0, 0, 1}, {0, 0, 2},
+    {0, 1, -1}, {0, 1, 0}, {0, 1, 1}, {0, 1, 2}, {0, 2, 0}, {0, 2, 1}, {1, -1, 0},
+    {1, -1, 1}, {1, 0, -1}, {1, 0, 0}, {1, 0, 1}, {1, 0, 2}, {1, 1, -1}, {1, 1, 0},
+    {1, 1, 1}, {1, 2, 0}, {2, 0, 0}, {2, 0, 1}, {2, 1, 0},
+};
+
+//The lanes are padded to a multiple of this.
+const int kBatchLanes = 8;
+
+//std::floor() is a library call without SSE4.1.
+inline int fastFloor(double x)
+{
+    int xi = static_cast<int>(x);
+    return x < xi ? xi - 1 : xi;
+}
+
+//The vertices of the batches, and their offsets from the unstretched cell origin.
+template <int Dimensions>
+struct BatchVertices
+{
+    BatchVertices()
+    {
+        const double squish = Dimensions == 2 ? SQUISH_CONSTANT_2D : SQUISH_CONSTANT_3D;
+        for (int n = 0; n < count; ++n) {
+            const int* vertex = Dimensions == 2 ? kBatchVertices2D[n] : kBatchVertices3D[n];
+            int sum = 0;
+            for (int c = 0; c < Dimensions; ++c) {
+                cells[n][c] = vertex[c];
+                sum += vertex[c];
+            }
+            for (int c = 0; c < Dimensions; ++c) {
+                offsets[n][c] = static_cast<float>(vertex[c] + sum * squish);
+            }
+        }
+    }
+
+    static const int count = Dimensions == 2 ? 8 : 26;
+    int cells[count][Dimensions];
+    float offsets[count][Dimensions];
+};
+
+template <int Dimensions>
+const BatchVertices<Dimensions>& Vertices()
+{
+    static const BatchVertices<Dimensions> vertices;
+    return vertices;
+}
+
+//The input of the batch kernels: per lane, the origin of the stretched cell (cells[c]) and
+//the position relative to its unstretched origin (positions[c]), for each dimension c.
+typedef void (*BatchKernel)(const int32_t* permutation, const float* gradients,
+                            const int32_t* const cells[3], const float* const positions[3],
+                            float weight, float* out, int count);
+
+//out[i] += weight * the sum of the contributions of the vertices (count is a multiple of
+//kBatchLanes). The hash of a vertex permutes its coordinates one after another, like
+//extrapolate(); the gradient tables are indexed by the last one.
+template <int Dimensions>
+void BatchNoiseScalar(const int32_t* permutation, const float* gradients,
+                      const int32_t* const cells[3], const float* const positions[3],
+                      float weight, float* out, int count)
+{
+    const BatchVertices<Dimensions>& vertices = Vertices<Dimensions>();
+    for (int i = 0; i < count; ++i) {
+        float value = 0;
+        for (int n = 0; n < vertices.count; ++n) {
+            float d[Dimensions];
+            float attn = 2;
+            for (int c = 0; c < Dimensions; ++c) {
+                d[c] = positions[c][i] - vertices.offsets[n][c];
+                attn -= d[c] * d[c];
+            }
+            if (attn <= 0) {
+                continue;
+            }
+            int hash = (cells[0][i] + vertices.cells[n][0]) & 0xFF;
+            for (int c = 1; c < Dimensions; ++c) {
+                hash = (permutation[hash] + cells[c][i] + vertices.cells[n][c]) & 0xFF;
+            }
+            float extrapolation = 0;
+            for (int c = 0; c < Dimensions; ++c) {
+                extrapolation += gradients[c * 256 + hash] * d[c];
+            }
+            attn *= attn;
+            value += attn * attn * extrapolation;
+        }
+        out[i] += weight * value;
+    }
+}
+
+#ifdef QNOISE_X86
+
+//SSE2 has no gathers, so the tables are read lane by lane.
+template <int Dimensions>
+__attribute__((target("sse2")))
+void BatchNoiseSse2(const int32_t* permutation, const float* gradients,
+                    const int32_t* const cells[3], const float* const positions[3],
+                    float weight, float* out, int count)
+{
+    const BatchVertices<Dimensions>& vertices = Vertices<Dimensions>();
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < count; i += 4) {
+        __m128i cell[Dimensions];
+        __m128 position[Dimensions];
+        for (int c = 0; c < Dimensions; ++c) {
+            cell[c] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells[c] + i));
+            position[c] = _mm_loadu_ps(positions[c] + i);
+        }
+        __m128 value = zero;
+        for (int n = 0; n < vertices.count; ++n) {
+            __m128 d[Dimensions];
+            __m128 attn = _mm_set1_ps(2);
+            for (int c = 0; c < Dimensions; ++c) {
+                d[c] = _mm_sub_ps(position[c], _mm_set1_ps(vertices.offsets[n][c]));
+                attn = _mm_sub_ps(attn, _mm_mul_ps(d[c], d[c]));
+            }
+            const __m128 active = _mm_cmpgt_ps(attn, zero);
+            if (_mm_movemask_ps(active) == 0) {
+                continue;
+            }
+            alignas(16) int32_t hash[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(hash),
+                            _mm_and_si128(_mm_add_epi32(cell[0], _mm_set1_epi32(vertices.cells[n][0])), mask));
+            for (int c = 1; c < Dimensions; ++c) {
+                const __m128i permuted = _mm_setr_epi32(permutation[hash[0]], permutation[hash[1]],
+                                                        permutation[hash[2]], permutation[hash[3]]);
+                _mm_store_si128(reinterpret_cast<__m128i*>(hash),
+                                _mm_and_si128(_mm_add_epi32(permuted, _mm_add_epi32(cell[c], _mm_set1_epi32(vertices.cells[n][c]))), mask));
+            }
+            __m128 extrapolation = zero;
+            for (int c = 0; c < Dimensions; ++c) {
+                const float* gradient = gradients + c * 256;
+                const __m128 g = _mm_setr_ps(gradient[hash[0]], gradient[hash[1]], gradient[hash[2]], gradient[hash[3]]);
+                extrapolation = _mm_add_ps(extrapolation, _mm_mul_ps(g, d[c]));
+            }
+            attn = _mm_mul_ps(attn, attn);
+            value = _mm_add_ps(value, _mm_and_ps(active, _mm_mul_ps(_mm_mul_ps(attn, attn), extrapolation)));
+        }
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_set1_ps(weight), value)));
+    }
+}
+
+template <int Dimensions>
+__attribute__((target("avx2")))
+void BatchNoiseAvx2(const int32_t* permutation, const float* gradients,
+                    const int32_t* const cells[3], const float* const positions[3],
+                    float weight, float* out, int count)
+{
+    const BatchVertices<Dimensions>& vertices = Vertices<Dimensions>();
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256 zero = _mm256_setzero_ps();
+    for (int i = 0; i < count; i += 8) {
+        __m256i cell[Dimensions];
+        __m256 position[Dimensions];
+        for (int c = 0; c < Dimensions; ++c) {
+            cell[c] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells[c] + i));
+            position[c] = _mm256_loadu_ps(positions[c] + i);
+        }
+        __m256 value = zero;
+        for (int n = 0; n < vertices.count; ++n) {
+            __m256 d[Dimensions];
+            __m256 attn = _mm256_set1_ps(2);
+            for (int c = 0; c < Dimensions; ++c) {
+                d[c] = _mm256_sub_ps(position[c], _mm256_set1_ps(vertices.offsets[n][c]));
+                attn = _mm256_sub_ps(attn, _mm256_mul_ps(d[c], d[c]));
+            }
+            const __m256 active = _mm256_cmp_ps(attn, zero, _CMP_GT_OQ);
+            if (_mm256_movemask_ps(active) == 0) {
+                continue;
+            }
+            __m256i hash = _mm256_and_si256(_mm256_add_epi32(cell[0], _mm256_set1_epi32(vertices.cells[n][0])), mask);
+            for (int c = 1; c < Dimensions; ++c) {
+                const __m256i permuted = _mm256_i32gather_epi32(reinterpret_cast<const int*>(permutation), hash, 4);
+                hash = _mm256_and_si256(_mm256_add_epi32(permuted, _mm256_add_epi32(cell[c], _mm256_set1_epi32(vertices.cells[n][c]))), mask);
+            }
+            __m256 extrapolation = zero;
+            for (int c = 0; c < Dimensions; ++c) {
+                const __m256 g = _mm256_i32gather_ps(gradients + c * 256, hash, 4);
+                extrapolation = _mm256_add_ps(extrapolation, _mm256_mul_ps(g, d[c]));
+            }
+            attn = _mm256_mul_ps(attn, attn);
+            value = _mm256_add_ps(value, _mm256_and_ps(active, _mm256_mul_ps(_mm256_mul_ps(attn, attn), extrapolation)));
+        }
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_set1_ps(weight), value)));
+    }
+}
+
+#endif
+
+struct BatchKernels
+{
+    BatchKernel noise_2d;
+    BatchKernel noise_3d;
+};
+
+BatchKernels DetectBatchKernels()
+{
+    BatchKernels kernels = {BatchNoiseScalar<2>, BatchNoiseScalar<3>};
+#ifdef QNOISE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels = {BatchNoiseAvx2<2>, BatchNoiseAvx2<3>};
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels = {BatchNoiseSse2<2>, BatchNoiseSse2<3>};
+    }
+#endif
+    return kernels;
+}
+
+const BatchKernels& SelectedBatchKernels()
+{
+    static const BatchKernels kernels = DetectBatchKernels();
+    return kernels;
+}
+
+}  // namespace
+
+void QNoise::prepare_batch_tables()
+{
+    m_batchPermutation.assign(m_permutation.begin(), m_permutation.end());
+    m_batchGradients2D.resize(2 * 256);
+    m_batchGradients3D.resize(3 * 256);
+    for (int hash = 0; hash < 256; hash++) {
+        //See extrapolate().
+        int index2D = m_permutation.at(hash) & 0x0E;
+        int index3D = m_permGradIndex3D.at(hash);
+        for (int c = 0; c < 2; c++)
+            m_batchGradients2D[c * 256 + hash] = gradients2D[index2D + c];
+        for (int c = 0; c < 3; c++)
+            m_batchGradients3D[c * 256 + hash] = gradients3D[index3D + c];
+    }
+}
+
+void QNoise::noise_row(float* out, int first, int count, double step, double y, int octaves) const
+{
+    const double yz[2] = {y, 0};
+    batch_noise_row<2>(out, first, count, step, yz, octaves);
+}
+
+void QNoise::noise_row(float* out, int first, int count, double step, double y, double z, int octaves) const
+{
+    const double yz[2] = {y, z};
+    batch_noise_row<3>(out, first, count, step, yz, octaves);
+}
+
+template <int Dimensions>
+void QNoise::batch_noise_row(float* out, int first, int count, double step, const double yz[2], int octaves) const
+{
+    if (count <= 0) {
+        return;
+    }
+    const double stretch = Dimensions == 2 ? STRETCH_CONSTANT_2D : STRETCH_CONSTANT_3D;
+    const double squish = Dimensions == 2 ? SQUISH_CONSTANT_2D : SQUISH_CONSTANT_3D;
+    const double norm = Dimensions == 2 ? NORM_CONSTANT_2D : NORM_CONSTANT_3D;
+    const BatchKernel kernel = Dimensions == 2 ? SelectedBatchKernels().noise_2d : SelectedBatchKernels().noise_3d;
+    const float* gradients = Dimensions == 2 ? m_batchGradients2D.data() : m_batchGradients3D.data();
+
+    const int padded = (count + kBatchLanes - 1) / kBatchLanes * kBatchLanes;
+    std::vector<int32_t> cells(Dimensions * padded);
+    std::vector<float> positions(Dimensions * padded);
+    std::vector<float> values(padded, 0.0f);
+    const int32_t* cell_planes[3] = {};
+    const float* position_planes[3] = {};
+    for (int c = 0; c < Dimensions; c++) {
+        cell_planes[c] = cells.data() + c * padded;
+        position_planes[c] = positions.data() + c * padded;
+    }
+
+    double frequency = 1;
+    float amplitude = 1;
+    float amplitudes = 0;
+    for (int octave = 0; octave < std::max(1, octaves); octave++) {
+        //The cells and the positions in double precision, like noise(); the kernels only
+        //work with the small offsets from the cell origins.
+        for (int i = 0; i < padded; i++) {
+            double p[3];
+            p[0] = (first + std::min(i, count - 1)) * step * frequency;
+            for (int c = 1; c < Dimensions; c++)
+                p[c] = yz[c - 1] * frequency;
+            double stretchOffset = 0;
+            for (int c = 0; c < Dimensions; c++)
+                stretchOffset += p[c];
+            stretchOffset *= stretch;
+            int sum = 0;
+            int sb[3];
+            for (int c = 0; c < Dimensions; c++) {
+                sb[c] = fastFloor(p[c] + stretchOffset);
+                sum += sb[c];
+            }
+            double squishOffset = sum * squish;
+            for (int c = 0; c < Dimensions; c++) {
+                cells[c * padded + i] = sb[c];
+                positions[c * padded + i] = static_cast<float>(p[c] - sb[c] - squishOffset);
+            }
+        }
+        kernel(m_batchPermutation.data(), gradients, cell_planes, position_planes,
+               static_cast<float>(amplitude / norm), values.data(), padded);
+        amplitudes += amplitude;
+        amplitude /= 2;
+        frequency *= 2;
+    }
+    for (int i = 0; i < count; i++) {
+        out[i] = values[i] / amplitudes;
+    }
+}
@@ -19,6 +19,7 @@
 */
 
 #include <QImage>
+#include <QRect>
 
 #include <cstdint>
 #include <vector>
@@ -36,10 +37,35 @@ public:
     double noise(double x, double y, double z);
     double noise(double x, double y, double z, double w);
 
+    // Batch evaluation on a grid: out[i] = the noise at ((first + i) * step, y) or at
+    // ((first + i) * step, y, z) for count values, with SIMD lanes where the CPU has them. The
+    // positions only depend on first + i, so the rows of adjacent regions fit together exactly.
+    // The values are those of noise() up to float precision; in 3D, noise() leaves out some
+    // vertices with tiny contributions, so they can differ by up to 1e-4. With more than one
+    // octave, this is fBm: every octave has twice the frequency and half the amplitude of the
+    // previous one, and the sum is normalized to -1..1.
+    // Unlike noise(), these don't change the object, so threads can share it.
+    void noise_row(float* out, int first, int count, double step, double y, int octaves = 1) const;
+    void noise_row(float* out, int first, int count, double step, double y, double z, int octaves = 1) const;
+
     // This method was added by Daniel Koitzsch on 2020-01-15
-    static QImage create_noise_image(int width, int height, double scale_factor = 5);
+    // A Grayscale8 image; the rows are computed in parallel bands with the 2D noise_row().
+    static QImage create_noise_image(int width, int height, double scale_factor = 5, int octaves = 1,
+                                     int64_t seed = kDefaultSeed);
+    // The region of the noise of a world (e.g. a whole map) which is world_width pixels wide: the
+    // pixel (x, y) of the world has the noise at scale_factor * (x, y) / world_width, in both
+    // directions, so that the regions (tiles) of a world fit together seamlessly.
+    static QImage create_noise_image(const QRect& region, int world_width, double scale_factor = 5,
+                                     int octaves = 1, int64_t seed = kDefaultSeed);
+    // The seed of the noise images which were created before the seed was a parameter.
+    static const int64_t kDefaultSeed = 2437;
 
 private:
+    // The tables of noise_row(), indexed like the permutation.
+    void prepare_batch_tables();
+    template <int Dimensions>
+    void batch_noise_row(float* out, int first, int count, double step, const double yz[2], int octaves) const;
+
     double extrapolate(int xsb, int ysb, double dx, double dy);
     double extrapolate(int xsb, int ysb, int zsb, double dx, double dy, double dz);
     double extrapolate(int xsb, int ysb, int zsb, int wsb, double dx, double dy, double dz, double dw);
@@ -48,6 +74,11 @@ private:
 
     std::vector<short> m_permutation;
     std::vector<short> m_permGradIndex3D;
+    // The permutation as 32 bit integers (for SIMD gathers), and the components of the
+    // gradient of each permuted hash (x, y and z blocks of 256 values).
+    std::vector<int32_t> m_batchPermutation;
+    std::vector<float> m_batchGradients2D;
+    std::vector<float> m_batchGradients3D;
 };
 
 #endif // QNOISE_H
@@ -21,7 +21,7 @@ QOpenGLBuffer* RenderPass::vertex_buf_ = nullptr;
 QOpenGLBuffer* RenderPass::index_buf_ = nullptr;
 bool RenderPass::initialized_ = false;
 
-RenderPass::RenderPass() : program_(nullptr) //, context_(nullptr), fbo_(nullptr), surface_(nullptr), initialized_(false)
+RenderPass::RenderPass() : program_(nullptr), backend_(BACKEND_GL) //, context_(nullptr), fbo_(nullptr), surface_(nullptr), initialized_(false)
 {
 }
 
@@ -70,12 +70,19 @@ void RenderPass::Destroy()
         gl_textures_[i] = nullptr;
     }
 
-    fbo_->release();
-    down_fbo_->release();
-    vertex_buf_->release();
-    index_buf_->release();
-    vertex_buf_->destroy();
-    index_buf_->destroy();
+    // Nothing has been set up if all passes were rendered on the CPU.
+    if (fbo_) {
+        fbo_->release();
+        down_fbo_->release();
+    }
+    if (vertex_buf_) {
+        vertex_buf_->release();
+        vertex_buf_->destroy();
+    }
+    if (index_buf_) {
+        index_buf_->release();
+        index_buf_->destroy();
+    }
     //program_->release();
     delete fbo_;
     delete down_fbo_;
@@ -105,11 +112,23 @@ QImage RenderPass::Combine(QList<QImage> textures, const QColor& mask_color)
     if (textures.length() < 2) {
         throw std::logic_error("At least two textures need to be provided for combination.");
     }
+    if (backend_ == BACKEND_CPU) {
+        std::vector<PlanarImage> layers;
+        layers.reserve(textures.length());
+        for (const QImage& texture : textures) {
+            layers.push_back(PlanarImage::FromImage(texture));
+        }
+        return cpu::MaskedOverlay(layers, mask_color).ToImage();
+    }
+    // One draw per kMaxShaderOverlayLayers layers; the result of a draw is the top layer of the next one.
     QImage combined = textures.at(0);
-    for (int i = 1; i < textures.length(); ++i) {
-        combined = MaskedOverlay(combined, textures.at(i),
-                                  combined.width(), combined.height(),
-                                  mask_color);
+    int next = 1;
+    while (next < textures.length()) {
+        QList<QImage> layers = {combined};
+        while (next < textures.length() && layers.length() < kMaxShaderOverlayLayers) {
+            layers.append(textures.at(next++));
+        }
+        combined = LayeredOverlay(layers, mask_color);
     }
 
     return combined;
@@ -135,30 +154,39 @@ QImage RenderPass::Blur(const QImage& texture, const QVector2D& direction, const
     });
 }
 
-QImage RenderPass::Erode(const QImage& texture, int erosion_size)
+QImage RenderPass::Erode(const QImage& texture, int erosion_size, cpu::MorphologyShape shape)
 {
-    return PostProcess({texture},
-                        texture.width(), texture.height(),
-                        ":/shaders/default.vert",
-                        ":/shaders/erosion.frag",
-                        [texture, erosion_size](QOpenGLShaderProgram* program) {
-        program->setUniformValue("texture_width", static_cast<float>(texture.width()));
-        program->setUniformValue("texture_height", static_cast<float>(texture.height()));
-        program->setUniformValue("erosion_size", erosion_size);
-    });
+    return Morphology(texture, erosion_size, shape, true);
 }
 
-QImage RenderPass::Dilate(const QImage& texture, int dilation_size)
+QImage RenderPass::Dilate(const QImage& texture, int dilation_size, cpu::MorphologyShape shape)
 {
-    return PostProcess({texture},
-                        texture.width(), texture.height(),
-                        ":/shaders/default.vert",
-                        ":/shaders/dilation.frag",
-                        [texture, dilation_size](QOpenGLShaderProgram* program) {
-        program->setUniformValue("texture_width", static_cast<float>(texture.width()));
-        program->setUniformValue("texture_height", static_cast<float>(texture.height()));
-        program->setUniformValue("dilation_size", dilation_size);
-    });
+    return Morphology(texture, dilation_size, shape, false);
+}
+
+QImage RenderPass::Morphology(const QImage& texture, int size, cpu::MorphologyShape shape, bool erode)
+{
+    // The shaders only do squares up to their maximum radius, in a horizontal and a vertical pass.
+    if (backend_ == BACKEND_CPU || shape != cpu::MORPHOLOGY_SQUARE || size / 2 > kMaxShaderMorphologyRadius) {
+        PlanarImage image = PlanarImage::FromImage(texture);
+        return (erode ? cpu::Erode(image, size / 2, shape) : cpu::Dilate(image, size / 2, shape)).ToImage();
+    }
+    const QString fragment_shader = erode ? ":/shaders/erosion.frag" : ":/shaders/dilation.frag";
+    const char* size_name = erode ? "erosion_size" : "dilation_size";
+    QImage result = texture;
+    for (const QVector2D& direction : {QVector2D(1.0, 0.0), QVector2D(0.0, 1.0)}) {
+        result = PostProcess({result},
+                             texture.width(), texture.height(),
+                             ":/shaders/default.vert",
+                             fragment_shader,
+                             [texture, size, size_name, direction](QOpenGLShaderProgram* program) {
+            program->setUniformValue("texture_width", static_cast<float>(texture.width()));
+            program->setUniformValue("texture_height", static_cast<float>(texture.height()));
+            program->setUniformValue(size_name, size);
+            program->setUniformValue("direction", direction);
+        });
+    }
+    return result;
 }
 
 QImage RenderPass::Blend(const QImage& texture_0, const QImage& texture_1,
@@ -173,6 +201,18 @@ QImage RenderPass::Blend(const QImage& texture_0, const QImage& texture_1,
     });
 }
 
+QImage RenderPass::Darken(const QImage& image, const QImage& shade,
+                           const int& width, const int& height, const float& strength)
+{
+    return PostProcess({image, shade},
+                        width, height,
+                        ":/shaders/default.vert",
+                        ":/shaders/darken.frag",
+                        [strength](QOpenGLShaderProgram* program) {
+        program->setUniformValue("alpha", strength);
+    });
+}
+
 QImage RenderPass::MaskedOverlay(const QImage& texture_0, const QImage& texture_1,
                                    const int& width, const int& height, const QColor& mask_color)
 {
@@ -188,6 +228,22 @@ QImage RenderPass::MaskedOverlay(const QImage& texture_0, const QImage& texture_
     });
 }
 
+QImage RenderPass::LayeredOverlay(const QList<QImage>& textures, const QColor& mask_color)
+{
+    const int layers_count = textures.length();
+    return PostProcess(textures,
+                        textures.at(0).width(), textures.at(0).height(),
+                        ":/shaders/default.vert",
+                        ":/shaders/layered_overlay.frag",
+                        [mask_color, layers_count](QOpenGLShaderProgram* program) {
+        program->setUniformValue("layers_count", layers_count);
+        program->setUniformValue(
+                    "mask_color",
+                    QVector3D(mask_color.red(), mask_color.green(), mask_color.blue())
+                );
+    });
+}
+
 QImage RenderPass::PostProcess(const QList<QImage>& textures,
                     const int& width, const int& height,
                     const QString& vertex_shader,
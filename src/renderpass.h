@@ -1,6 +1,8 @@
 #ifndef RENDERPASS_H
 #define RENDERPASS_H
 
+#include "cpupostprocess.h"
+
 #include <QImage>
 #include <QList>
 #include <QOffscreenSurface>
@@ -36,17 +38,35 @@ public:
         BLURSIZE_9, BLURSIZE_13
     };
 
+    // Where the passes are rendered: with OpenGL (on the GPU, if there is one), or with the
+    // SIMD kernels on the CPU (see cpupostprocess.h).
+    enum BACKEND {
+        BACKEND_GL, BACKEND_CPU
+    };
+    void Backend(BACKEND backend) { backend_ = backend; }
+    BACKEND Backend() const { return backend_; }
+
 protected:
     QImage Blur(const QImage& texture, const QVector2D& direction, const BLURSIZE blur_size = BLURSIZE_9);
-    QImage Erode(const QImage& texture, int erosion_size = 5);
-    QImage Dilate(const QImage& texture, int dilation_size = 5);
+    // Shrinks (or grows) the black shapes within the square or the disc of the given size.
+    // Discs and sizes beyond the shaders are computed on the CPU.
+    QImage Erode(const QImage& texture, int erosion_size = 5,
+                 cpu::MorphologyShape shape = cpu::MORPHOLOGY_SQUARE);
+    QImage Dilate(const QImage& texture, int dilation_size = 5,
+                  cpu::MorphologyShape shape = cpu::MORPHOLOGY_SQUARE);
     QImage Blend(const QImage& texture_0, const QImage& texture_1,
                  const int& width, const int& height, const float& alpha);
+    // Multiplies the colors of the image with the grey of the shade, with the given strength
+    // (0: unchanged, 1: the full shade).
+    QImage Darken(const QImage& image, const QImage& shade,
+                  const int& width, const int& height, const float& strength);
     // Overlays two textures in the way that the color from texture 1 is only taken,
     // if the color of texture 0 has the specified "mask_color".
     // In other words: mask_color says "please take the color of the other texture" ;-)
     QImage MaskedOverlay(const QImage& texture_0, const QImage& texture_1,
                           const int& width, const int& height, const QColor& mask_color);
+    // MaskedOverlay() of 2 to kMaxShaderOverlayLayers textures in one draw (the first one on top).
+    QImage LayeredOverlay(const QList<QImage>& textures, const QColor& mask_color);
     QImage PostProcess(const QList<QImage>& textures,
                         const int& width, const int& height,
                         const QString& vertex_shader,
@@ -66,8 +86,15 @@ protected:
     QString vertex_shader_;
     QString fragment_shader_;
     static bool initialized_;
+    BACKEND backend_;
 
 private:
+    // kMaxRadius of erosion.frag and dilation.frag.
+    static const int kMaxShaderMorphologyRadius = 128;
+    // The samplers of layered_overlay.frag.
+    static const int kMaxShaderOverlayLayers = 8;
+
+    QImage Morphology(const QImage& texture, int size, cpu::MorphologyShape shape, bool erode);
     bool SetupGl(const int& width,
                   const int& height,
                   const QString& vertex_shader,
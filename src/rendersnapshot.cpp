@@ -0,0 +1,47 @@
+#include "rendersnapshot.h"
+
+namespace osm {
+
+RenderSnapshot::RenderSnapshot(QVector<RenderLayer> layers)
+{
+    for (auto it = layers.begin(); it != layers.end(); ++it) {
+        RenderLayer& layer = *it;
+        layer.style.outline_pen = QPen(layer.style.outline_color);
+        layer.style.outline_pen.setWidth(layer.style.line_width);
+        layer.style.fill_brush = QBrush(layer.style.fill_color);
+    }
+    layers_ = std::make_shared<const QVector<RenderLayer>>(std::move(layers));
+}
+
+const QVector<RenderLayer>& RenderSnapshot::Layers() const
+{
+    static const QVector<RenderLayer> kNoLayers;
+    return layers_ ? *layers_ : kNoLayers;
+}
+
+const RenderLayer* RenderSnapshot::Layer(const QString& name) const
+{
+    for (auto it = Layers().begin(); it != Layers().end(); ++it) {
+        if (it->name == name) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+RenderSnapshot RenderSnapshot::Solo(const QString& name, const QColor& color) const
+{
+    QVector<RenderLayer> layers = Layers();
+    for (auto it = layers.begin(); it != layers.end(); ++it) {
+        if (it->name == name) {
+            it->style.enabled = true;
+            it->style.fill_color = color;
+            it->style.outline_color = color;
+        } else {
+            it->style.enabled = false;
+        }
+    }
+    return RenderSnapshot(layers);
+}
+
+}  // namespace osm
@@ -0,0 +1,66 @@
+#ifndef RENDERSNAPSHOT_H
+#define RENDERSNAPSHOT_H
+
+#include "objects.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QPen>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+
+namespace osm {
+
+// The style of a layer at the time a snapshot was taken (see ObjectsConfiguration).
+struct LayerStyle
+{
+    bool enabled;
+    int line_width;
+    QColor outline_color;
+    bool outlined;
+    QColor fill_color;
+    bool filled;
+    // Built from the values above by the snapshot, so painting doesn't create them per way.
+    QPen outline_pen;
+    QBrush fill_brush;
+};
+
+// One layer of a snapshot. The objects are not copied; they must not be changed
+// while a render is running (they only change when a new file is opened).
+struct RenderLayer
+{
+    QString name;
+    osm::Objects* objects;
+    LayerStyle style;
+};
+
+// An immutable view of the layers (in painting order) and their styles, which a
+// render consumes instead of the live ObjectsRepository/ObjectsConfiguration.
+// Copies are cheap (the layers are shared), so a snapshot can be handed to any
+// number of renders, and GUI edits create a new snapshot instead of changing this one.
+class RenderSnapshot
+{
+public:
+    explicit RenderSnapshot() = default;
+    // Builds the pens and brushes of the styles.
+    explicit RenderSnapshot(QVector<RenderLayer> layers);
+
+    const QVector<RenderLayer>& Layers() const;
+    int Size() const { return layers_ ? layers_->size() : 0; }
+    bool Empty() const { return Size() == 0; }
+    // Returns nullptr if there is no layer with this name.
+    const RenderLayer* Layer(const QString& name) const;
+
+    // Returns a snapshot in which only the given layer is enabled, drawn in the given color
+    // (i.e. the black and white input for an effect).
+    RenderSnapshot Solo(const QString& name, const QColor& color) const;
+
+private:
+    std::shared_ptr<const QVector<RenderLayer>> layers_;
+};
+
+}  // namespace osm
+
+#endif // RENDERSNAPSHOT_H
@@ -0,0 +1,386 @@
+#include "scanlinerasterizer.h"
+
+#include "cpukernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace osm
+{
+
+ScanlineRasterizer::ScanlineRasterizer(FillRule fill_rule) : fill_rule_(fill_rule)
+{
+}
+
+void ScanlineRasterizer::AddPolygon(const QPolygonF& polygon)
+{
+    AddPolygon(polygon.constData(), polygon.size(), fill_rule_ == FILL_NONZERO ? 1 : 0);
+}
+
+void ScanlineRasterizer::AddPolyline(const QPolygonF& polyline, qreal width)
+{
+    if (fill_rule_ != FILL_NONZERO) {
+        throw std::logic_error("Strokes need the nonzero fill rule.");
+    }
+    std::vector<QPointF> points;
+    points.reserve(polyline.size());
+    for (const QPointF& point : polyline) {
+        if (points.empty() || point != points.back()) {
+            points.push_back(point);
+        }
+    }
+    if (points.size() < 2) {
+        return;
+    }
+
+    // Every segment is a quad, and the joins are the triangles between the corners of the quads.
+    const qreal half_width = width / 2;
+    QPointF previous_normal;
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        const QPointF delta = points[i + 1] - points[i];
+        const QPointF direction = delta * (half_width / std::hypot(delta.x(), delta.y()));
+        const QPointF normal(-direction.y(), direction.x());
+        // The square caps extend the first and the last segment by half the width.
+        const QPointF start = i == 0 ? points[i] - direction : points[i];
+        const QPointF end = i + 2 == points.size() ? points[i + 1] + direction : points[i + 1];
+        const QPointF quad[4] = {start + normal, end + normal, end - normal, start - normal};
+        AddPolygon(quad, 4, 1);
+        if (i > 0) {
+            const QPointF& joint = points[i];
+            const QPointF left[3] = {joint, joint + previous_normal, joint + normal};
+            const QPointF right[3] = {joint, joint - previous_normal, joint - normal};
+            AddPolygon(left, 3, 1);
+            AddPolygon(right, 3, 1);
+        }
+        previous_normal = normal;
+    }
+}
+
+void ScanlineRasterizer::AddTriangles(const std::vector<QPointF>& points, const uint32_t* indices, size_t count)
+{
+    if (fill_rule_ != FILL_NONZERO) {
+        throw std::logic_error("Triangles need the nonzero fill rule.");
+    }
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        // Turned the same way round, so that the shared edges have opposite directions.
+        const QPointF triangle[3] = {points[indices[i]], points[indices[i + 1]], points[indices[i + 2]]};
+        AddPolygon(triangle, 3, 1);
+    }
+}
+
+void ScanlineRasterizer::AddPolygon(const QPointF* points, int count, int orientation)
+{
+    if (count < 3) {
+        return;
+    }
+    double area = 0;
+    for (int i = 0; i < count; ++i) {
+        const QPointF& a = points[i];
+        const QPointF& b = points[(i + 1) % count];
+        area += a.x() * b.y() - b.x() * a.y();
+    }
+    const float turn = orientation != 0 && area != 0 && (area > 0) != (orientation > 0) ? -1 : 1;
+    const size_t first_edge = edges_.size();
+    for (int i = 0; i < count; ++i) {
+        const QPointF& a = points[i];
+        const QPointF& b = points[(i + 1) % count];
+        // Horizontal edges don't change the winding number.
+        if (a.y() == b.y()) {
+            continue;
+        }
+        if (a.y() < b.y()) {
+            edges_.push_back({static_cast<float>(a.x()), static_cast<float>(a.y()),
+                              static_cast<float>(b.x()), static_cast<float>(b.y()), turn});
+        } else {
+            edges_.push_back({static_cast<float>(b.x()), static_cast<float>(b.y()),
+                              static_cast<float>(a.x()), static_cast<float>(a.y()), -turn});
+        }
+    }
+    if (edges_.size() == first_edge) {
+        return;
+    }
+    Shape shape = {edges_[first_edge].x0, edges_[first_edge].y0, edges_[first_edge].x0, edges_[first_edge].y0,
+                   static_cast<uint32_t>(first_edge), static_cast<uint32_t>(edges_.size())};
+    for (size_t i = first_edge; i < edges_.size(); ++i) {
+        const Edge& edge = edges_[i];
+        shape.x0 = std::min({shape.x0, edge.x0, edge.x1});
+        shape.x1 = std::max({shape.x1, edge.x0, edge.x1});
+        shape.y0 = std::min(shape.y0, edge.y0);
+        shape.y1 = std::max(shape.y1, edge.y1);
+    }
+    shapes_.push_back(shape);
+    indexed_ = false;
+}
+
+void ScanlineRasterizer::AddRowSpan(std::vector<Cell>& cells, float x_top, float x_bottom, float dy, int width)
+{
+    float x0 = std::min(x_top, x_bottom);
+    const float x1 = std::max(x_top, x_bottom);
+    if (x1 <= 0) {
+        cells.push_back({0, dy, dy});
+        return;
+    }
+    if (x0 >= width) {
+        return;
+    }
+    if (x0 == x1) {
+        const int x = static_cast<int>(x0);
+        cells.push_back({x, dy * (x + 1 - x0), dy});
+        return;
+    }
+
+    // The part of dy per unit of x. The area on the right of the edge within a pixel is the
+    // part of dy in the pixel times the distance of the middle of the edge to its right side.
+    const float slope = dy / (x1 - x0);
+    if (x0 < 0) {
+        cells.push_back({0, -x0 * slope, -x0 * slope});
+        x0 = 0;
+    }
+    const float end = std::min(x1, static_cast<float>(width));
+    while (x0 < end) {
+        const int x = static_cast<int>(x0);
+        const float next = std::min(static_cast<float>(x + 1), end);
+        const float part = (next - x0) * slope;
+        cells.push_back({x, part * (x + 1 - (x0 + next) / 2), part});
+        x0 = next;
+    }
+}
+
+uint8_t ScanlineRasterizer::Value(float winding) const
+{
+    float coverage = std::fabs(winding);
+    if (fill_rule_ == FILL_EVEN_ODD) {
+        coverage = std::fmod(coverage, 2.0f);
+        if (coverage > 1) {
+            coverage = 2 - coverage;
+        }
+    } else {
+        coverage = std::min(coverage, 1.0f);
+    }
+    return static_cast<uint8_t>(255 - static_cast<int>(coverage * 255 + 0.5f));
+}
+
+void ScanlineRasterizer::SortCells(std::vector<Cell>& cells, std::vector<Cell>& scratch, int width)
+{
+    if (cells.size() < 64) {
+        std::sort(cells.begin(), cells.end(), [](const Cell& a, const Cell& b) { return a.x < b.x; });
+        return;
+    }
+    // A stable radix sort by the bytes of x, which is less than the width.
+    scratch.resize(cells.size());
+    for (int shift = 0; (width - 1) >> shift; shift += 8) {
+        size_t offsets[257] = {};
+        for (const Cell& cell : cells) {
+            ++offsets[((cell.x >> shift) & 0xFF) + 1];
+        }
+        for (int digit = 0; digit < 256; ++digit) {
+            offsets[digit + 1] += offsets[digit];
+        }
+        for (const Cell& cell : cells) {
+            scratch[offsets[(cell.x >> shift) & 0xFF]++] = cell;
+        }
+        cells.swap(scratch);
+    }
+}
+
+void ScanlineRasterizer::BuildIndex() const
+{
+    index_ = Index();
+    if (shapes_.empty()) {
+        index_.columns = index_.rows = 0;
+        return;
+    }
+    float right = shapes_[0].x1;
+    float bottom = shapes_[0].y1;
+    index_.left = shapes_[0].x0;
+    index_.top = shapes_[0].y0;
+    for (const Shape& shape : shapes_) {
+        index_.left = std::min(index_.left, shape.x0);
+        index_.top = std::min(index_.top, shape.y0);
+        right = std::max(right, shape.x1);
+        bottom = std::max(bottom, shape.y1);
+    }
+    // Larger cells for planes with shapes far away from the others.
+    index_.cell_size = std::max<float>(kIndexCellSize, std::max(right - index_.left, bottom - index_.top) / kIndexMaxCells);
+    index_.columns = static_cast<int>((right - index_.left) / index_.cell_size) + 1;
+    index_.rows = static_cast<int>((bottom - index_.top) / index_.cell_size) + 1;
+
+    // Counts the shapes of the cells, and then places them, like the edges in Mask().
+    const auto cells = [this](const Shape& shape, int& column0, int& row0, int& column1, int& row1) {
+        column0 = static_cast<int>((shape.x0 - index_.left) / index_.cell_size);
+        row0 = static_cast<int>((shape.y0 - index_.top) / index_.cell_size);
+        column1 = std::min(index_.columns - 1, static_cast<int>((shape.x1 - index_.left) / index_.cell_size));
+        row1 = std::min(index_.rows - 1, static_cast<int>((shape.y1 - index_.top) / index_.cell_size));
+    };
+    index_.offsets.assign(static_cast<size_t>(index_.columns) * index_.rows + 1, 0);
+    int column0, row0, column1, row1;
+    for (const Shape& shape : shapes_) {
+        cells(shape, column0, row0, column1, row1);
+        for (int row = row0; row <= row1; ++row) {
+            for (int column = column0; column <= column1; ++column) {
+                ++index_.offsets[static_cast<size_t>(row) * index_.columns + column + 1];
+            }
+        }
+    }
+    for (size_t i = 1; i < index_.offsets.size(); ++i) {
+        index_.offsets[i] += index_.offsets[i - 1];
+    }
+    index_.shapes.resize(index_.offsets.back());
+    std::vector<uint32_t> positions(index_.offsets.begin(), index_.offsets.end() - 1);
+    for (size_t i = 0; i < shapes_.size(); ++i) {
+        cells(shapes_[i], column0, row0, column1, row1);
+        for (int row = row0; row <= row1; ++row) {
+            for (int column = column0; column <= column1; ++column) {
+                index_.shapes[positions[static_cast<size_t>(row) * index_.columns + column]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> ScanlineRasterizer::ShapesWithin(const QRect& rect) const
+{
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        if (!indexed_) {
+            BuildIndex();
+            indexed_ = true;
+        }
+    }
+    std::vector<uint32_t> shapes;
+    const float left = rect.x();
+    const float top = rect.y();
+    const float right = left + rect.width();
+    const float bottom = top + rect.height();
+    if (index_.columns == 0 || right <= index_.left || bottom <= index_.top) {
+        return shapes;
+    }
+    const int column0 = std::max(0, static_cast<int>((left - index_.left) / index_.cell_size));
+    const int row0 = std::max(0, static_cast<int>((top - index_.top) / index_.cell_size));
+    const int column1 = std::min<float>(index_.columns - 1, (right - index_.left) / index_.cell_size);
+    const int row1 = std::min<float>(index_.rows - 1, (bottom - index_.top) / index_.cell_size);
+    for (int row = row0; row <= row1; ++row) {
+        for (int column = column0; column <= column1; ++column) {
+            const size_t cell = static_cast<size_t>(row) * index_.columns + column;
+            for (uint32_t i = index_.offsets[cell]; i < index_.offsets[cell + 1]; ++i) {
+                const Shape& shape = shapes_[index_.shapes[i]];
+                if (shape.x1 <= left || shape.x0 >= right || shape.y1 <= top || shape.y0 >= bottom) {
+                    continue;
+                }
+                // A shape in several cells is taken from the first of them within the rect.
+                const int first_column = std::max(column0, static_cast<int>((shape.x0 - index_.left) / index_.cell_size));
+                const int first_row = std::max(row0, static_cast<int>((shape.y0 - index_.top) / index_.cell_size));
+                if (first_column == column && first_row == row) {
+                    shapes.push_back(index_.shapes[i]);
+                }
+            }
+        }
+    }
+    // The cells are visited by rows, but the cells of the rows of a mask should follow the order
+    // of the shapes, so that the sums of the areas don't depend on the rect.
+    std::sort(shapes.begin(), shapes.end());
+    return shapes;
+}
+
+QImage ScanlineRasterizer::Mask(const QRect& rect) const
+{
+    QImage mask(rect.size(), QImage::Format_Grayscale8);
+    if (rect.isEmpty()) {
+        return mask;
+    }
+    uchar* bits = mask.bits();
+    const int bytes_per_line = mask.bytesPerLine();
+    const int width = rect.width();
+    const int height = rect.height();
+    const float left = rect.x();
+    const float top = rect.y();
+
+    // The edges of the shapes near the rect within its rows by their first row (the edges above
+    // the rect are in row 0), so that the strips only visit the edges which cross them.
+    std::vector<uint32_t> edges;
+    std::vector<int> first_rows;
+    std::vector<uint32_t> row_offsets(height + 1);
+    for (uint32_t shape : ShapesWithin(rect)) {
+        for (uint32_t i = shapes_[shape].first_edge; i < shapes_[shape].end_edge; ++i) {
+            const Edge& edge = edges_[i];
+            if (edge.y1 <= top || edge.y0 >= top + height) {
+                continue;
+            }
+            edges.push_back(i);
+            first_rows.push_back(static_cast<int>(std::max(0.0f, std::floor(edge.y0 - top))));
+            ++row_offsets[first_rows.back() + 1];
+        }
+    }
+    for (int row = 0; row < height; ++row) {
+        row_offsets[row + 1] += row_offsets[row];
+    }
+    std::vector<uint32_t> order(row_offsets[height]);
+    {
+        std::vector<uint32_t> positions(row_offsets.begin(), row_offsets.end() - 1);
+        for (size_t i = 0; i < edges.size(); ++i) {
+            order[positions[first_rows[i]]++] = edges[i];
+        }
+    }
+
+    effects::cpu::ParallelFor(height, [&](int begin, int end) {
+        // The edges which cross the current strip.
+        std::vector<uint32_t> active;
+        for (uint32_t i = 0; i < row_offsets[begin]; ++i) {
+            if (edges_[order[i]].y1 > top + begin) {
+                active.push_back(order[i]);
+            }
+        }
+        std::vector<std::vector<Cell>> rows(kStripRows);
+        std::vector<Cell> scratch;
+
+        for (int strip = begin; strip < end; strip += kStripRows) {
+            const int strip_end = std::min(end, strip + kStripRows);
+            active.erase(std::remove_if(active.begin(), active.end(), [&](uint32_t edge) {
+                return edges_[edge].y1 <= top + strip;
+            }), active.end());
+            active.insert(active.end(), order.begin() + row_offsets[strip], order.begin() + row_offsets[strip_end]);
+
+            for (uint32_t index : active) {
+                const Edge& edge = edges_[index];
+                const float dx_dy = (edge.x1 - edge.x0) / (edge.y1 - edge.y0);
+                const int first = static_cast<int>(std::max<float>(strip, std::floor(edge.y0 - top)));
+                const int last = static_cast<int>(std::min<float>(strip_end, std::ceil(edge.y1 - top)));
+                for (int row = first; row < last; ++row) {
+                    const float y_top = std::max(edge.y0, top + row);
+                    const float y_bottom = std::min(edge.y1, top + row + 1);
+                    if (y_bottom <= y_top) {
+                        continue;
+                    }
+                    AddRowSpan(rows[row - strip], edge.x0 + (y_top - edge.y0) * dx_dy - left,
+                               edge.x0 + (y_bottom - edge.y0) * dx_dy - left, (y_bottom - y_top) * edge.winding, width);
+                }
+            }
+
+            for (int row = strip; row < strip_end; ++row) {
+                std::vector<Cell>& cells = rows[row - strip];
+                SortCells(cells, scratch, width);
+                uchar* line = bits + static_cast<size_t>(row) * bytes_per_line;
+                float winding = 0;
+                int x = 0;
+                for (size_t i = 0; i < cells.size();) {
+                    const int cell_x = cells[i].x;
+                    std::fill(line + x, line + cell_x, Value(winding));
+                    float area = 0;
+                    float cover = 0;
+                    for (; i < cells.size() && cells[i].x == cell_x; ++i) {
+                        area += cells[i].area;
+                        cover += cells[i].cover;
+                    }
+                    line[cell_x] = Value(winding + area);
+                    winding += cover;
+                    x = cell_x + 1;
+                }
+                std::fill(line + x, line + width, Value(winding));
+                cells.clear();
+            }
+        }
+    }, kStripRows);
+    return mask;
+}
+
+}  // namespace osm
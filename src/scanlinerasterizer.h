@@ -0,0 +1,121 @@
+#ifndef SCANLINERASTERIZER_H
+#define SCANLINERASTERIZER_H
+
+#include <QImage>
+#include <QPointF>
+#include <QPolygonF>
+#include <QRect>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace osm
+{
+
+// Rasterizes polygons and stroked polylines into an 8 bit coverage mask with the exact area of
+// every pixel which they cover (instead of the samples of MSAA). The edges only leave cells at
+// the pixels which they cross: the area of the pixel on the right of the edge and the change of
+// the winding number for the pixels after it. The cells of a row are sorted, and a sweep fills
+// the spans between them, so the memory is linear in the length of the edges rather than in the
+// number of pixels and samples. The rows are rendered in bands on the hardware threads.
+// Where shapes overlap within a pixel, their areas add up (to full coverage at most), so the
+// edges of overlapping shapes can be a little darker than with MSAA.
+// The shapes are indexed by a grid, so that Mask() only visits the shapes near its rect, and
+// the rasterizer of a large plane can be shared by the renders of its tiles.
+class ScanlineRasterizer
+{
+public:
+    enum FillRule {
+        FILL_NONZERO, FILL_EVEN_ODD
+    };
+
+    explicit ScanlineRasterizer(FillRule fill_rule = FILL_NONZERO);
+
+    FillRule Rule() const { return fill_rule_; }
+    bool Empty() const { return edges_.empty(); }
+
+    // Adds a closed polygon (the last point is connected to the first one). With the nonzero
+    // rule, the polygons are turned the same way round, so that they are unified like separate
+    // fills of QPainter (except where a polygon crosses itself).
+    void AddPolygon(const QPolygonF& polygon);
+    // Adds the area which a QPen of the given width covers along the polyline, with its default
+    // square caps and bevel joins. The segments of a stroke overlap, so this needs the nonzero rule.
+    void AddPolyline(const QPolygonF& polyline, qreal width);
+    // Adds a triangulated area (e.g. a polygon with holes), given as the indices of the corners of
+    // its triangles, three per triangle. The edges between neighbouring triangles cancel out, so
+    // the area is filled without seams. This needs the nonzero rule.
+    void AddTriangles(const std::vector<QPointF>& points, const uint32_t* indices, size_t count);
+
+    // Renders the rect of the plane into a Grayscale8 image: the shapes in black on white (like
+    // a layer painted in black). The shapes beyond the rect are cut off. This may be called from
+    // several threads, but not while shapes are added.
+    QImage Mask(const QRect& rect) const;
+
+private:
+    // The rows which are rasterized at once (the cells of a strip are in the cache).
+    static const int kStripRows = 16;
+    // The size of the cells of the index, and the most cells along a side of it.
+    static const int kIndexCellSize = 128;
+    static const int kIndexMaxCells = 1024;
+
+    // y0 < y1; the winding is +1 if the edge points down, else -1.
+    struct Edge
+    {
+        float x0, y0, x1, y1;
+        float winding;
+    };
+    // The partial coverage of a pixel, and the change of the winding number after it.
+    struct Cell
+    {
+        int x;
+        float area;
+        float cover;
+    };
+    // A closed polygon (a part of a stroke, a triangle, ...) with its bounding rect. Its edges
+    // are [first_edge, end_edge). The winding of a closed polygon adds up to zero outside of
+    // its bounding rect, so the rect of a mask only needs the shapes which reach into it.
+    struct Shape
+    {
+        float x0, y0, x1, y1;
+        uint32_t first_edge, end_edge;
+    };
+    // The shapes by the cells of a grid over their bounds. The shapes of the cell (column, row)
+    // are shapes[offsets[row * columns + column], offsets[row * columns + column + 1]).
+    struct Index
+    {
+        float left, top, cell_size;
+        int columns, rows;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> shapes;
+    };
+
+    // Adds the edges of the polygon, turned round if the sign of its area is not the given one
+    // (0: as it is).
+    void AddPolygon(const QPointF* points, int count, int orientation);
+    // Adds the part of the edge within a row, from x_top to x_bottom and dy (with the winding)
+    // high, to the cells of the row, which is width pixels wide. The part left of the row is
+    // moved onto its first pixel, so that the winding stays the same, and the part right of it
+    // is dropped.
+    static void AddRowSpan(std::vector<Cell>& cells, float x_top, float x_bottom, float dy, int width);
+    // Sorts the cells of a row by x (0 <= x < width).
+    static void SortCells(std::vector<Cell>& cells, std::vector<Cell>& scratch, int width);
+    // The shapes whose bounding rects intersect the rect, in the order in which they were added.
+    // The index is built by the first call after shapes were added.
+    std::vector<uint32_t> ShapesWithin(const QRect& rect) const;
+    void BuildIndex() const;
+    // The gray value of the winding number.
+    uint8_t Value(float winding) const;
+
+    FillRule fill_rule_;
+    std::vector<Edge> edges_;
+    std::vector<Shape> shapes_;
+
+    mutable std::mutex index_mutex_;
+    mutable Index index_;
+    mutable bool indexed_ = false;
+};
+
+}  // namespace osm
+
+#endif // SCANLINERASTERIZER_H
@@ -1,11 +1,17 @@
 uniform sampler2D texture_0;
 uniform sampler2D texture_1;
+// The size of the image in units of the texture (see WatercolorPass::World()).
+uniform vec2 texture_scale;
 varying vec2 tex_coord;
 
 void main()
 {
     vec4 tex_color_0 = texture2D(texture_0, tex_coord);
-    vec4 tex_color_1 = texture2D(texture_1, tex_coord);
+    // The texture is mirrored at its edges (like GL_MIRRORED_REPEAT) from the top left corner
+    // of the image. The images are uploaded upside down, so y is mirrored from the top.
+    vec2 position = vec2(tex_coord.x, 1.0 - tex_coord.y) * texture_scale;
+    vec2 mirrored = 1.0 - abs(mod(position, 2.0) - 1.0);
+    vec4 tex_color_1 = texture2D(texture_1, vec2(mirrored.x, 1.0 - mirrored.y));
 
     // If the color is white at this coordinate, then use the original color.
     if (tex_color_0 == vec4(1.0)) {
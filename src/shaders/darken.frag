@@ -0,0 +1,14 @@
+uniform sampler2D texture_0;
+uniform sampler2D texture_1;
+uniform float alpha; // Default: 0.8
+
+varying vec2 tex_coord;
+
+void main()
+{
+    // Multiplies the color of texture_0 with the grey of texture_1, which is mixed with white
+    // by 1 - alpha (i.e. alpha is the strength of the shade).
+    vec4 t0 = texture2D(texture_0, tex_coord);
+    vec4 t1 = texture2D(texture_1, tex_coord);
+    gl_FragColor = vec4(t0.rgb * mix(1.0, t1.r, alpha), t0.a);
+}
@@ -2,43 +2,25 @@ uniform sampler2D texture_0;
 uniform float texture_width;
 uniform float texture_height;
 uniform int dilation_size;
+uniform vec2 direction;
 varying vec2 tex_coord;
 
+// The loop needs a constant bound.
+const int kMaxRadius = 128;
+
+// The layers are black shapes on white, so the shapes are dilated with the minimum of the
+// dilation_size pixels along the direction (a square needs a horizontal and a vertical pass).
 void main()
 {
-    float w = 1.0 / texture_width;
-    float h = 1.0 / texture_height;
-
-    vec2 tc = tex_coord.xy;
-
-            vec2 tc_ul = tc + vec2(-1.0, 1.0) * w;
-            vec2 tc_ur = tc + vec2(1.0, 1.0) * w;
-
-            vec2 tc_dl = tc + vec2(-1.0, -1.0) * w;
-            vec2 tc_dr = tc + vec2(1.0, -1.0) * w;
-
-
-    vec4 ul = texture2D(texture_0, tc_ul);
-            vec4 ur = texture2D(texture_0, tc_ur);
-            vec4 dl = texture2D(texture_0, tc_dl);
-            vec4 dr = texture2D(texture_0, tc_dr);
-
-    gl_FragColor = min(min(ul, ur), min(dl, dr));
-
-
-    /*int N = dilation_size;
-    int i = 0;
-    int j = 0;
-    vec3 maxValue = vec3(0.0);
-    vec3 tmp = vec3(0.0);
-    float step_w = 1.0 / texture_width;
-    float step_h = 1.0 / texture_height;
-
-    for (i = -(N-1)/2; i< (N+1)/2 ; i++) {
-        for (j = -(N-1)/2; j< (N+1)/2; j++) {
-            tmp = texture2D(texture_0, vec2 ( tex_coord.s + float(i)*step_w, tex_coord.t + float(j)*step_h ) ).rgb;
-            maxValue = max(tmp, maxValue);
+    vec2 step = direction / vec2(texture_width, texture_height);
+    int radius = dilation_size / 2;
+    vec4 color = texture2D(texture_0, tex_coord);
+    for (int i = 1; i <= kMaxRadius; ++i) {
+        if (i > radius) {
+            break;
         }
+        color = min(color, min(texture2D(texture_0, tex_coord + float(i) * step),
+                               texture2D(texture_0, tex_coord - float(i) * step)));
     }
-    gl_FragColor = vec4(maxValue, 1.0);*/
+    gl_FragColor = color;
 }
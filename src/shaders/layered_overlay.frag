@@ -0,0 +1,41 @@
+uniform sampler2D texture_0;
+uniform sampler2D texture_1;
+uniform sampler2D texture_2;
+uniform sampler2D texture_3;
+uniform sampler2D texture_4;
+uniform sampler2D texture_5;
+uniform sampler2D texture_6;
+uniform sampler2D texture_7;
+// The number of bound textures (2 to 8).
+uniform int layers_count;
+uniform vec3 mask_color;
+varying vec2 tex_coord;
+
+// masked_overlay.frag for up to eight layers in one draw: the color of the first texture
+// which doesn't have the "mask_color" (texture 0 is on top).
+void main()
+{
+    vec3 color = texture2D(texture_0, tex_coord).rgb;
+    if (color == mask_color) {
+        color = texture2D(texture_1, tex_coord).rgb;
+    }
+    if (color == mask_color && layers_count > 2) {
+        color = texture2D(texture_2, tex_coord).rgb;
+    }
+    if (color == mask_color && layers_count > 3) {
+        color = texture2D(texture_3, tex_coord).rgb;
+    }
+    if (color == mask_color && layers_count > 4) {
+        color = texture2D(texture_4, tex_coord).rgb;
+    }
+    if (color == mask_color && layers_count > 5) {
+        color = texture2D(texture_5, tex_coord).rgb;
+    }
+    if (color == mask_color && layers_count > 6) {
+        color = texture2D(texture_6, tex_coord).rgb;
+    }
+    if (color == mask_color && layers_count > 7) {
+        color = texture2D(texture_7, tex_coord).rgb;
+    }
+    gl_FragColor = vec4(color, 1.0);
+}
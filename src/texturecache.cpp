@@ -0,0 +1,91 @@
+#include "texturecache.h"
+
+#include <QDebug>
+#include <QHash>
+
+#include <algorithm>
+
+namespace effects {
+
+bool TextureCache::Key::operator==(const Key& other) const
+{
+    return path == other.path && width == other.width;
+}
+
+uint qHash(const TextureCache::Key& key, uint seed)
+{
+    seed = ::qHash(key.path, seed);
+    return ::qHash(key.width, seed) ^ (seed << 1);
+}
+
+TextureCache& TextureCache::Instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+TextureCache::TextureCache(int max_megabytes) : images_(max_megabytes * 1024), planes_(max_megabytes * 1024)
+{
+}
+
+QImage TextureCache::Texture(const QString& path, int width)
+{
+    const Key key = {path, std::max(0, width)};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (QImage* image = images_.object(key)) {
+            return *image;
+        }
+    }
+
+    // Decoded and scaled without the lock, so that other textures needn't wait.
+    QImage image;
+    if (key.width == 0) {
+        image = QImage(path).convertToFormat(QImage::Format_RGBA8888);
+    } else {
+        const QImage decoded = Texture(path);
+        if (!decoded.isNull()) {
+            const int height = std::max(1, qRound(static_cast<double>(decoded.height()) * key.width / decoded.width()));
+            image = decoded.scaled(key.width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+    }
+    if (image.isNull()) {
+        qDebug() << "Can't read the texture" << path;
+        return image;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    images_.insert(key, new QImage(image), std::max(1, image.bytesPerLine() * image.height() / 1024));
+    return image;
+}
+
+PlanarImage TextureCache::Planes(const QString& path, int width)
+{
+    const Key key = {path, std::max(0, width)};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (PlanarImage* planes = planes_.object(key)) {
+            return *planes;
+        }
+    }
+
+    const QImage image = Texture(path, width);
+    if (image.isNull()) {
+        return PlanarImage();
+    }
+    PlanarImage planes = PlanarImage::FromImage(image);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    planes_.insert(key, new PlanarImage(planes),
+                   std::max<int>(1, static_cast<int>(planes.PixelsCount() * PlanarImage::kChannels / 1024)));
+    return planes;
+}
+
+void TextureCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    images_.clear();
+    planes_.clear();
+}
+
+}  // namespace effects
@@ -0,0 +1,53 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "planarimage.h"
+
+#include <QCache>
+#include <QImage>
+#include <QString>
+
+#include <mutex>
+
+namespace effects {
+
+// The paper textures of the watercolor passes, by file (e.g. a resource) and width. The files
+// are only decoded when a texture is first used, and the textures are kept converted and
+// scaled for the passes (the least recently used ones are dropped beyond the memory limit),
+// so that repeated renders neither decode nor scale them again. This may be called from
+// several threads.
+class TextureCache
+{
+public:
+    // The cache which is shared by all passes.
+    static TextureCache& Instance();
+
+    explicit TextureCache(int max_megabytes = 128);
+
+    // The texture scaled to the width, keeping its aspect ratio (0: the size of the file), as
+    // RGBA8888. A null image if the file can't be read.
+    QImage Texture(const QString& path, int width = 0);
+    // The same for the CPU passes. The planes are shared with the cache, so they must not be
+    // written to.
+    PlanarImage Planes(const QString& path, int width);
+    void Clear();
+
+private:
+    struct Key
+    {
+        QString path;
+        int width;
+
+        bool operator==(const Key& other) const;
+    };
+    friend uint qHash(const Key& key, uint seed);
+
+    std::mutex mutex_;
+    // The costs are in kilobytes.
+    QCache<Key, QImage> images_;
+    QCache<Key, PlanarImage> planes_;
+};
+
+}  // namespace effects
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,645 @@
+#include "triangulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace osm {
+
+namespace {
+
+typedef float Coord;
+
+template <typename V>
+inline Coord Area(const V* p, const V* q, const V* r)
+{
+    return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+}
+
+template <typename V>
+inline bool Equals(const V* a, const V* b)
+{
+    return a->x == b->x && a->y == b->y;
+}
+
+inline int Sign(Coord v)
+{
+    return (v > 0) - (v < 0);
+}
+
+template <typename V>
+inline bool OnSegment(const V* p, const V* q, const V* r)
+{
+    return q->x <= std::max(p->x, r->x) && q->x >= std::min(p->x, r->x)
+            && q->y <= std::max(p->y, r->y) && q->y >= std::min(p->y, r->y);
+}
+
+// Checks whether the segments p1-q1 and p2-q2 intersect.
+template <typename V>
+bool Intersects(const V* p1, const V* q1, const V* p2, const V* q2)
+{
+    int o1 = Sign(Area(p1, q1, p2));
+    int o2 = Sign(Area(p1, q1, q2));
+    int o3 = Sign(Area(p2, q2, p1));
+    int o4 = Sign(Area(p2, q2, q1));
+
+    if (o1 != o2 && o3 != o4) return true;
+    if (o1 == 0 && OnSegment(p1, p2, q1)) return true;
+    if (o2 == 0 && OnSegment(p1, q2, q1)) return true;
+    if (o3 == 0 && OnSegment(p2, p1, q2)) return true;
+    if (o4 == 0 && OnSegment(p2, q1, q2)) return true;
+    return false;
+}
+
+inline bool PointInTriangle(Coord ax, Coord ay, Coord bx, Coord by, Coord cx, Coord cy, Coord px, Coord py)
+{
+    return (cx - px) * (ay - py) >= (ax - px) * (cy - py)
+            && (ax - px) * (by - py) >= (bx - px) * (ay - py)
+            && (bx - px) * (cy - py) >= (cx - px) * (by - py);
+}
+
+// Checks whether the diagonal a-b is locally inside the polygon.
+template <typename V>
+inline bool LocallyInside(const V* a, const V* b)
+{
+    return Area(a->prev, a, a->next) < 0
+            ? Area(a, b, a->next) >= 0 && Area(a, a->prev, b) >= 0
+            : Area(a, b, a->prev) < 0 || Area(a, a->next, b) < 0;
+}
+
+// Checks whether the sector in vertex m contains the sector in vertex p in the same coordinates.
+template <typename V>
+inline bool SectorContainsSector(const V* m, const V* p)
+{
+    return Area(m->prev, m, p->prev) < 0 && Area(p->next, m, m->next) < 0;
+}
+
+}  // namespace
+
+void Triangulator::Triangulate(const Point<float>* points, uint32_t count,
+                               const std::vector<uint32_t>& hole_starts,
+                               uint32_t index_base, std::vector<uint32_t>& out_triangles)
+{
+    vertices_.clear();
+    triangles_ = &out_triangles;
+    index_base_ = index_base;
+    hashed_ = false;
+
+    uint32_t outer_count = hole_starts.empty() ? count : hole_starts[0];
+    Vertex* outer_node = LinkedList(points, 0, outer_count, true);
+    if (!outer_node || outer_node->next == outer_node->prev) {
+        return;
+    }
+
+    if (!hole_starts.empty()) {
+        outer_node = EliminateHoles(points, count, hole_starts, outer_node);
+    }
+
+    // If the shape is not too simple, use a z-order curve hash for the ear tests.
+    if (count > 80) {
+        Coord max_x = points[0].x;
+        Coord max_y = points[0].y;
+        min_x_ = max_x;
+        min_y_ = max_y;
+        for (uint32_t i = 1; i < outer_count; ++i) {
+            min_x_ = std::min(min_x_, points[i].x);
+            min_y_ = std::min(min_y_, points[i].y);
+            max_x = std::max(max_x, points[i].x);
+            max_y = std::max(max_y, points[i].y);
+        }
+        inv_size_ = std::max(max_x - min_x_, max_y - min_y_);
+        inv_size_ = inv_size_ != 0 ? 32767 / inv_size_ : 0;
+        hashed_ = inv_size_ != 0;
+    }
+
+    EarcutLinked(outer_node, 0);
+    vertices_.clear();
+}
+
+// Creates a circular doubly linked list from the points in the specified winding order.
+Triangulator::Vertex* Triangulator::LinkedList(const Point<float>* points, uint32_t start, uint32_t end, bool clockwise)
+{
+    double signed_area = 0;
+    for (uint32_t i = start, j = end - 1; i < end; j = i++) {
+        signed_area += (static_cast<double>(points[j].x) - points[i].x) * (static_cast<double>(points[i].y) + points[j].y);
+    }
+
+    Vertex* last = nullptr;
+    if (clockwise == (signed_area > 0)) {
+        for (uint32_t i = start; i < end; ++i) {
+            last = InsertVertex(i, points[i].x, points[i].y, last);
+        }
+    } else {
+        for (uint32_t i = end; i-- > start;) {
+            last = InsertVertex(i, points[i].x, points[i].y, last);
+        }
+    }
+
+    if (last && Equals(last, last->next)) {
+        RemoveVertex(last);
+        last = last->next;
+    }
+    return last;
+}
+
+// Removes duplicate and collinear vertices.
+Triangulator::Vertex* Triangulator::FilterPoints(Vertex* start, Vertex* end)
+{
+    if (!start) {
+        return start;
+    }
+    if (!end) {
+        end = start;
+    }
+
+    Vertex* p = start;
+    bool again;
+    do {
+        again = false;
+        if (!p->steiner && (Equals(p, p->next) || Area(p->prev, p, p->next) == 0)) {
+            RemoveVertex(p);
+            p = end = p->prev;
+            if (p == p->next) {
+                break;
+            }
+            again = true;
+        } else {
+            p = p->next;
+        }
+    } while (again || p != end);
+
+    return end;
+}
+
+// The main ear slicing loop, which triangulates the polygon given as a linked list.
+void Triangulator::EarcutLinked(Vertex* ear, int pass)
+{
+    if (!ear) {
+        return;
+    }
+
+    if (pass == 0 && hashed_) {
+        IndexCurve(ear);
+    }
+
+    Vertex* stop = ear;
+    while (ear->prev != ear->next) {
+        Vertex* prev = ear->prev;
+        Vertex* next = ear->next;
+
+        if (hashed_ ? IsEarHashed(ear) : IsEar(ear)) {
+            AddTriangle(prev, ear, next);
+            RemoveVertex(ear);
+            // Skipping the next vertex leads to less sliver triangles.
+            ear = next->next;
+            stop = next->next;
+            continue;
+        }
+
+        ear = next;
+
+        // If the whole polygon was looped through without finding an ear...
+        if (ear == stop) {
+            if (pass == 0) {
+                // ...try filtering the points and slicing again,
+                EarcutLinked(FilterPoints(ear), 1);
+            } else if (pass == 1) {
+                // ...then cure small local self-intersections,
+                ear = CureLocalIntersections(FilterPoints(ear));
+                EarcutLinked(ear, 2);
+            } else if (pass == 2) {
+                // ...and as a last resort split the polygon into two.
+                SplitEarcut(ear);
+            }
+            break;
+        }
+    }
+}
+
+// Checks whether a polygon vertex forms a valid ear with its neighbours.
+bool Triangulator::IsEar(Vertex* ear)
+{
+    const Vertex* a = ear->prev;
+    const Vertex* b = ear;
+    const Vertex* c = ear->next;
+
+    if (Area(a, b, c) >= 0) {
+        return false;  // Reflex, can't be an ear.
+    }
+
+    Coord x0 = std::min(a->x, std::min(b->x, c->x));
+    Coord y0 = std::min(a->y, std::min(b->y, c->y));
+    Coord x1 = std::max(a->x, std::max(b->x, c->x));
+    Coord y1 = std::max(a->y, std::max(b->y, c->y));
+
+    // Make sure that no other vertex is inside the potential ear.
+    const Vertex* p = c->next;
+    while (p != a) {
+        if (p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1
+                && PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y)
+                && Area(p->prev, p, p->next) >= 0) {
+            return false;
+        }
+        p = p->next;
+    }
+    return true;
+}
+
+bool Triangulator::IsEarHashed(Vertex* ear)
+{
+    const Vertex* a = ear->prev;
+    const Vertex* b = ear;
+    const Vertex* c = ear->next;
+
+    if (Area(a, b, c) >= 0) {
+        return false;
+    }
+
+    Coord x0 = std::min(a->x, std::min(b->x, c->x));
+    Coord y0 = std::min(a->y, std::min(b->y, c->y));
+    Coord x1 = std::max(a->x, std::max(b->x, c->x));
+    Coord y1 = std::max(a->y, std::max(b->y, c->y));
+
+    // Only the vertices within the z-order range of the triangle's bbox need to be checked.
+    int32_t min_z = ZOrder(x0, y0);
+    int32_t max_z = ZOrder(x1, y1);
+
+    auto inside = [&](const Vertex* p) {
+        return p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 && p != a && p != c
+                && PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y)
+                && Area(p->prev, p, p->next) >= 0;
+    };
+
+    // Look for points inside the triangle in both directions.
+    const Vertex* p = ear->prev_z;
+    const Vertex* n = ear->next_z;
+    while (p && p->z >= min_z && n && n->z <= max_z) {
+        if (inside(p)) return false;
+        p = p->prev_z;
+        if (inside(n)) return false;
+        n = n->next_z;
+    }
+    while (p && p->z >= min_z) {
+        if (inside(p)) return false;
+        p = p->prev_z;
+    }
+    while (n && n->z <= max_z) {
+        if (inside(n)) return false;
+        n = n->next_z;
+    }
+    return true;
+}
+
+// Goes through all polygon vertices and cures small local self-intersections.
+Triangulator::Vertex* Triangulator::CureLocalIntersections(Vertex* start)
+{
+    Vertex* p = start;
+    do {
+        Vertex* a = p->prev;
+        Vertex* b = p->next->next;
+
+        if (!Equals(a, b) && Intersects(a, p, p->next, b) && LocallyInside(a, b) && LocallyInside(b, a)) {
+            AddTriangle(a, p, b);
+            // Remove the two vertices involved.
+            RemoveVertex(p);
+            RemoveVertex(p->next);
+            p = start = b;
+        }
+        p = p->next;
+    } while (p != start);
+
+    return FilterPoints(p);
+}
+
+// Tries to split the polygon into two, and triangulates them independently.
+void Triangulator::SplitEarcut(Vertex* start)
+{
+    Vertex* a = start;
+    do {
+        Vertex* b = a->next->next;
+        while (b != a->prev) {
+            if (a->i != b->i && IsValidDiagonal(a, b)) {
+                Vertex* c = SplitPolygon(a, b);
+                a = FilterPoints(a, a->next);
+                c = FilterPoints(c, c->next);
+                EarcutLinked(a, 0);
+                EarcutLinked(c, 0);
+                return;
+            }
+            b = b->next;
+        }
+        a = a->next;
+    } while (a != start);
+}
+
+// Links every hole into the outer ring, producing a single ring polygon without holes.
+Triangulator::Vertex* Triangulator::EliminateHoles(const Point<float>* points, uint32_t count,
+                                                   const std::vector<uint32_t>& hole_starts, Vertex* outer_node)
+{
+    std::vector<Vertex*> queue;
+    queue.reserve(hole_starts.size());
+    for (size_t i = 0; i < hole_starts.size(); ++i) {
+        uint32_t start = hole_starts[i];
+        uint32_t end = i + 1 < hole_starts.size() ? hole_starts[i + 1] : count;
+        if (end <= start) {
+            continue;
+        }
+        Vertex* list = LinkedList(points, start, end, false);
+        if (!list) {
+            continue;
+        }
+        if (list == list->next) {
+            list->steiner = true;
+        }
+        // Find the leftmost vertex of the hole.
+        Vertex* p = list;
+        Vertex* leftmost = list;
+        do {
+            if (p->x < leftmost->x || (p->x == leftmost->x && p->y < leftmost->y)) {
+                leftmost = p;
+            }
+            p = p->next;
+        } while (p != list);
+        queue.push_back(leftmost);
+    }
+
+    std::sort(queue.begin(), queue.end(), [](const Vertex* a, const Vertex* b) { return a->x < b->x; });
+
+    // Process the holes from left to right.
+    for (auto it = queue.begin(); it != queue.end(); ++it) {
+        outer_node = EliminateHole(*it, outer_node);
+    }
+    return outer_node;
+}
+
+Triangulator::Vertex* Triangulator::EliminateHole(Vertex* hole, Vertex* outer_node)
+{
+    Vertex* bridge = FindHoleBridge(hole, outer_node);
+    if (!bridge) {
+        return outer_node;
+    }
+
+    Vertex* bridge_reverse = SplitPolygon(bridge, hole);
+
+    // Filter the collinear points around the cuts.
+    FilterPoints(bridge_reverse, bridge_reverse->next);
+    return FilterPoints(bridge, bridge->next);
+}
+
+// David Eberly's algorithm for finding a bridge between a hole and the outer polygon.
+Triangulator::Vertex* Triangulator::FindHoleBridge(Vertex* hole, Vertex* outer_node)
+{
+    Vertex* p = outer_node;
+    Coord hx = hole->x;
+    Coord hy = hole->y;
+    Coord qx = -std::numeric_limits<Coord>::infinity();
+    Vertex* m = nullptr;
+
+    // Find a segment intersected by a ray from the hole's leftmost point to the left;
+    // the segment's endpoint with the lesser x will be a potential connection point.
+    do {
+        if (hy <= p->y && hy >= p->next->y && p->next->y != p->y) {
+            Coord x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+            if (x <= hx && x > qx) {
+                qx = x;
+                m = p->x < p->next->x ? p : p->next;
+                if (x == hx) {
+                    return m;  // The hole touches the outer segment; pick the leftmost endpoint.
+                }
+            }
+        }
+        p = p->next;
+    } while (p != outer_node);
+
+    if (!m) {
+        return nullptr;
+    }
+
+    // Look for points inside the triangle of hole point, segment intersection and endpoint;
+    // if there are no points found, we have a valid connection. Otherwise choose the point
+    // of the minimum angle with the ray as the connection point.
+    Vertex* stop = m;
+    Coord mx = m->x;
+    Coord my = m->y;
+    Coord tan_min = std::numeric_limits<Coord>::infinity();
+
+    p = m;
+    do {
+        if (hx >= p->x && p->x >= mx && hx != p->x
+                && PointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y)) {
+            Coord tan = std::abs(hy - p->y) / (hx - p->x);
+            if (LocallyInside(p, hole)
+                    && (tan < tan_min || (tan == tan_min && (p->x > m->x || (p->x == m->x && SectorContainsSector(m, p)))))) {
+                m = p;
+                tan_min = tan;
+            }
+        }
+        p = p->next;
+    } while (p != stop);
+
+    return m;
+}
+
+// Interlinks the polygon vertices in z-order.
+void Triangulator::IndexCurve(Vertex* start)
+{
+    Vertex* p = start;
+    do {
+        if (p->z == 0) {
+            p->z = ZOrder(p->x, p->y);
+        }
+        p->prev_z = p->prev;
+        p->next_z = p->next;
+        p = p->next;
+    } while (p != start);
+
+    p->prev_z->next_z = nullptr;
+    p->prev_z = nullptr;
+
+    SortLinked(p);
+}
+
+// Simon Tatham's linked list merge sort algorithm.
+Triangulator::Vertex* Triangulator::SortLinked(Vertex* list)
+{
+    int in_size = 1;
+    int num_merges;
+    do {
+        Vertex* p = list;
+        Vertex* tail = nullptr;
+        list = nullptr;
+        num_merges = 0;
+
+        while (p) {
+            ++num_merges;
+            Vertex* q = p;
+            int p_size = 0;
+            for (int i = 0; i < in_size; ++i) {
+                ++p_size;
+                q = q->next_z;
+                if (!q) {
+                    break;
+                }
+            }
+            int q_size = in_size;
+
+            while (p_size > 0 || (q_size > 0 && q)) {
+                Vertex* e;
+                if (p_size != 0 && (q_size == 0 || !q || p->z <= q->z)) {
+                    e = p;
+                    p = p->next_z;
+                    --p_size;
+                } else {
+                    e = q;
+                    q = q->next_z;
+                    --q_size;
+                }
+
+                if (tail) {
+                    tail->next_z = e;
+                } else {
+                    list = e;
+                }
+                e->prev_z = tail;
+                tail = e;
+            }
+            p = q;
+        }
+
+        tail->next_z = nullptr;
+        in_size *= 2;
+    } while (num_merges > 1);
+
+    return list;
+}
+
+// The z-order of a point given its coordinates and the bbox of the polygon.
+int32_t Triangulator::ZOrder(float x, float y) const
+{
+    // Coordinates are transformed into a non-negative 15 bit integer range.
+    uint32_t ix = static_cast<uint32_t>((x - min_x_) * inv_size_);
+    uint32_t iy = static_cast<uint32_t>((y - min_y_) * inv_size_);
+
+    ix = (ix | (ix << 8)) & 0x00FF00FF;
+    ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+    ix = (ix | (ix << 2)) & 0x33333333;
+    ix = (ix | (ix << 1)) & 0x55555555;
+
+    iy = (iy | (iy << 8)) & 0x00FF00FF;
+    iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+    iy = (iy | (iy << 2)) & 0x33333333;
+    iy = (iy | (iy << 1)) & 0x55555555;
+
+    return static_cast<int32_t>(ix | (iy << 1));
+}
+
+// Checks whether a diagonal between two polygon vertices is valid (lies in polygon interior).
+bool Triangulator::IsValidDiagonal(Vertex* a, Vertex* b)
+{
+    // Doesn't intersect other edges...
+    return a->next->i != b->i && a->prev->i != b->i && !IntersectsPolygon(a, b)
+            // ...and is locally visible, and doesn't create opposite-facing sectors...
+            && ((LocallyInside(a, b) && LocallyInside(b, a) && MiddleInside(a, b)
+                 && (Area(a->prev, a, b->prev) != 0 || Area(a, b->prev, b) != 0))
+                // ...or is a special zero-length case.
+                || (Equals(a, b) && Area(a->prev, a, a->next) > 0 && Area(b->prev, b, b->next) > 0));
+}
+
+// Checks whether a polygon diagonal intersects any polygon segments.
+bool Triangulator::IntersectsPolygon(Vertex* a, Vertex* b)
+{
+    const Vertex* p = a;
+    do {
+        if (p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i
+                && Intersects(p, p->next, a, b)) {
+            return true;
+        }
+        p = p->next;
+    } while (p != a);
+    return false;
+}
+
+// Checks whether the middle point of a polygon diagonal is inside the polygon.
+bool Triangulator::MiddleInside(Vertex* a, Vertex* b)
+{
+    const Vertex* p = a;
+    bool inside = false;
+    Coord px = (a->x + b->x) / 2;
+    Coord py = (a->y + b->y) / 2;
+    do {
+        if (((p->y > py) != (p->next->y > py)) && p->next->y != p->y
+                && (px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x)) {
+            inside = !inside;
+        }
+        p = p->next;
+    } while (p != a);
+    return inside;
+}
+
+// Links two polygon vertices with a bridge. If the vertices belong to the same ring, the polygon
+// is split into two; if one belongs to the outer ring and the other to a hole, they are merged.
+Triangulator::Vertex* Triangulator::SplitPolygon(Vertex* a, Vertex* b)
+{
+    Vertex* a2 = NewVertex(a->i, a->x, a->y);
+    Vertex* b2 = NewVertex(b->i, b->x, b->y);
+    Vertex* an = a->next;
+    Vertex* bp = b->prev;
+
+    a->next = b;
+    b->prev = a;
+
+    a2->next = an;
+    an->prev = a2;
+
+    b2->next = a2;
+    a2->prev = b2;
+
+    bp->next = b2;
+    b2->prev = bp;
+
+    return b2;
+}
+
+Triangulator::Vertex* Triangulator::NewVertex(uint32_t i, float x, float y)
+{
+    vertices_.push_back({i, x, y, nullptr, nullptr, 0, nullptr, nullptr, false});
+    return &vertices_.back();
+}
+
+Triangulator::Vertex* Triangulator::InsertVertex(uint32_t i, float x, float y, Vertex* last)
+{
+    Vertex* p = NewVertex(i, x, y);
+
+    if (!last) {
+        p->prev = p;
+        p->next = p;
+    } else {
+        p->next = last->next;
+        p->prev = last;
+        last->next->prev = p;
+        last->next = p;
+    }
+    return p;
+}
+
+void Triangulator::RemoveVertex(Vertex* p)
+{
+    p->next->prev = p->prev;
+    p->prev->next = p->next;
+
+    if (p->prev_z) {
+        p->prev_z->next_z = p->next_z;
+    }
+    if (p->next_z) {
+        p->next_z->prev_z = p->prev_z;
+    }
+}
+
+void Triangulator::AddTriangle(const Vertex* a, const Vertex* b, const Vertex* c)
+{
+    triangles_->push_back(index_base_ + a->i);
+    triangles_->push_back(index_base_ + b->i);
+    triangles_->push_back(index_base_ + c->i);
+}
+
+}  // namespace osm
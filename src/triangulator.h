@@ -0,0 +1,79 @@
+#ifndef TRIANGULATOR_H
+#define TRIANGULATOR_H
+
+#include "types.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace osm
+{
+
+// Ear clipping triangulation of polygons with holes (a port of the "earcut" algorithm).
+// Holes are bridged into the outer ring first; for bigger polygons the ear tests are
+// sped up with a z-order curve index. Degenerate and self-intersecting input does not
+// fail, but may leave parts of the polygon uncovered.
+class Triangulator
+{
+public:
+    explicit Triangulator() = default;
+
+    // Triangulates the polygon with the points [points, points + count). The outer ring comes first,
+    // each hole starts at one of the (ascending) indices in hole_starts. The orientation of the rings
+    // doesn't matter, and a closing point equal to the first one is ignored.
+    // Appends three indices per triangle (relative to points, plus index_base) to out_triangles.
+    void Triangulate(const Point<float>* points, uint32_t count,
+                     const std::vector<uint32_t>& hole_starts,
+                     uint32_t index_base, std::vector<uint32_t>& out_triangles);
+
+private:
+    struct Vertex
+    {
+        uint32_t i;
+        float x;
+        float y;
+        Vertex* prev;
+        Vertex* next;
+        int32_t z;
+        Vertex* prev_z;
+        Vertex* next_z;
+        bool steiner;
+    };
+
+    Vertex* LinkedList(const Point<float>* points, uint32_t start, uint32_t end, bool clockwise);
+    Vertex* FilterPoints(Vertex* start, Vertex* end = nullptr);
+    void EarcutLinked(Vertex* ear, int pass);
+    bool IsEar(Vertex* ear);
+    bool IsEarHashed(Vertex* ear);
+    Vertex* CureLocalIntersections(Vertex* start);
+    void SplitEarcut(Vertex* start);
+    Vertex* EliminateHoles(const Point<float>* points, uint32_t count,
+                           const std::vector<uint32_t>& hole_starts, Vertex* outer_node);
+    Vertex* EliminateHole(Vertex* hole, Vertex* outer_node);
+    Vertex* FindHoleBridge(Vertex* hole, Vertex* outer_node);
+    void IndexCurve(Vertex* start);
+    Vertex* SortLinked(Vertex* list);
+    int32_t ZOrder(float x, float y) const;
+    bool IsValidDiagonal(Vertex* a, Vertex* b);
+    bool IntersectsPolygon(Vertex* a, Vertex* b);
+    bool MiddleInside(Vertex* a, Vertex* b);
+    Vertex* SplitPolygon(Vertex* a, Vertex* b);
+    Vertex* NewVertex(uint32_t i, float x, float y);
+    Vertex* InsertVertex(uint32_t i, float x, float y, Vertex* last);
+    void RemoveVertex(Vertex* p);
+    void AddTriangle(const Vertex* a, const Vertex* b, const Vertex* c);
+
+    // Vertices are created while splitting, so they must not move in memory.
+    std::deque<Vertex> vertices_;
+    std::vector<uint32_t>* triangles_;
+    uint32_t index_base_;
+    bool hashed_;
+    float min_x_;
+    float min_y_;
+    float inv_size_;
+};
+
+}  // namespace osm
+
+#endif // TRIANGULATOR_H
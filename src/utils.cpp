@@ -2,6 +2,7 @@
 
 #include "types.h"
 
+#include <algorithm>
 #include <iomanip>
 #include <cmath>
 #include <ctime>
@@ -199,5 +200,69 @@ double HaversineKm(double lat1, double long1, double lat2, double long2)
     return d;
 }
 
+uint64_t HilbertIndex(uint32_t x, uint32_t y, int order)
+{
+    uint64_t d = 0;
+    for (uint32_t s = 1u << (order - 1); s > 0; s >>= 1) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant, so that the curve keeps being continuous.
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+uint64_t WayHilbertIndex(const osm::Way* way, const osm::BoundingBox& bbox, int order)
+{
+    float min_lat = bbox.max_lat;
+    float max_lat = bbox.min_lat;
+    float min_lon = bbox.max_lon;
+    float max_lon = bbox.min_lon;
+    for (auto it = way->nodes.begin(); it != way->nodes.end(); ++it) {
+        if (*it == nullptr) {
+            continue;
+        }
+        min_lat = std::min(min_lat, (*it)->lat);
+        max_lat = std::max(max_lat, (*it)->lat);
+        min_lon = std::min(min_lon, (*it)->lon);
+        max_lon = std::max(max_lon, (*it)->lon);
+    }
+
+    // Normalize the centroid to [0, 1] and clamp it, since ways may reach beyond the bbox.
+    float d_lat = bbox.max_lat - bbox.min_lat;
+    float d_lon = bbox.max_lon - bbox.min_lon;
+    float r_lat = d_lat > 0 ? ((min_lat + max_lat) / 2 - bbox.min_lat) / d_lat : 0;
+    float r_lon = d_lon > 0 ? ((min_lon + max_lon) / 2 - bbox.min_lon) / d_lon : 0;
+    r_lat = std::min(std::max(r_lat, 0.0f), 1.0f);
+    r_lon = std::min(std::max(r_lon, 0.0f), 1.0f);
+
+    uint32_t cells = (1u << order) - 1;
+    return HilbertIndex(static_cast<uint32_t>(r_lon * cells), static_cast<uint32_t>(r_lat * cells), order);
+}
+
+void SortWaysByHilbertIndex(std::vector<osm::Way*>& ways, const osm::BoundingBox& bbox)
+{
+    // The indices are computed once per way, not once per comparison.
+    std::vector<std::pair<uint64_t, osm::Way*>> keyed_ways;
+    keyed_ways.reserve(ways.size());
+    for (auto it = ways.begin(); it != ways.end(); ++it) {
+        keyed_ways.push_back({WayHilbertIndex(*it, bbox), *it});
+    }
+    std::stable_sort(keyed_ways.begin(), keyed_ways.end(),
+                     [](const std::pair<uint64_t, osm::Way*>& a, const std::pair<uint64_t, osm::Way*>& b) {
+        return a.first < b.first;
+    });
+    for (size_t i = 0; i < keyed_ways.size(); ++i) {
+        ways[i] = keyed_ways[i].second;
+    }
+}
+
 }  // namespace utils
 }  // namespace osm
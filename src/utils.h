@@ -3,6 +3,7 @@
 
 #include "types.h"
 
+#include <cstdint>
 #include <math.h>
 #include <string>
 #include <vector>
@@ -36,6 +37,15 @@ std::vector<osm::Point<float>> CreatePoints(osm::Way* way, int width, int height
 
 double HaversineKm(double lat1, double long1, double lat2, double long2);
 
+// Returns the position of the cell (x, y) along a Hilbert curve which covers a grid
+// of 2^order x 2^order cells. Cells that are close on the curve are close in space.
+uint64_t HilbertIndex(uint32_t x, uint32_t y, int order = 16);
+// Returns the Hilbert index of the centroid of the way's bounding box, relative to the given bbox.
+uint64_t WayHilbertIndex(const osm::Way* way, const osm::BoundingBox& bbox, int order = 16);
+// Sorts the ways by WayHilbertIndex(), so that ways which are close in space are close in memory.
+// Ways with the same index keep their order.
+void SortWaysByHilbertIndex(std::vector<osm::Way*>& ways, const osm::BoundingBox& bbox);
+
 inline double Mat2x2Det(double a, double b, double c, double d)
 {
     return a*d - b*c;
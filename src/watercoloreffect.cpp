@@ -1,28 +1,47 @@
 #include "watercoloreffect.h"
 
+#include "cpukernels.h"
 #include "objects.h"
 #include "objectsconfiguration.h"
 #include "objectsrepository.h"
+#include "scanlinerasterizer.h"
+#include "texturecache.h"
 
 #include <QDebug>
 #include <QElapsedTimer>
 #include <QFormLayout>
 #include <QObject>
+#include <QPainter>
+#include <QPair>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
 
 namespace effects {
 
 WatercolorEffectConfiguration::WatercolorEffectConfiguration(QString ojects_name, double noise_scale_factor,
                                                              double final_blend_alpha, double threshold_combiner_alpha,
-                                                             double threshold_combiner_threshold, QImage effect_texture)
-    : noise_scale_factor_(noise_scale_factor), threshold_combiner_alpha_(threshold_combiner_alpha),
+                                                             double threshold_combiner_threshold, QString effect_texture)
+    : noise_scale_factor_(noise_scale_factor), noise_seed_(static_cast<int>(qHash(ojects_name) & 0x7FFFFFFF)),
+      noise_octaves_(1), threshold_combiner_alpha_(threshold_combiner_alpha),
       threshold_combiner_threshold_(threshold_combiner_threshold), final_blend_alpha_(final_blend_alpha),
-      effect_texture_(effect_texture), ojects_name_(ojects_name) {
+      blur_sigma_(0), effect_texture_(effect_texture), ojects_name_(ojects_name) {
     widget_ = new QWidget();
     QFormLayout* layout = new QFormLayout(widget_);
     ui_noise_scale_factor_ = new QDoubleSpinBox;
     ui_noise_scale_factor_->setDecimals(2);
     ui_noise_scale_factor_->setMaximum(300);
     ui_noise_scale_factor_->setValue(noise_scale_factor);
+    ui_noise_seed_ = new QSpinBox;
+    ui_noise_seed_->setMaximum(std::numeric_limits<int>::max());
+    ui_noise_seed_->setValue(noise_seed_);
+    ui_noise_octaves_ = new QSpinBox;
+    ui_noise_octaves_->setRange(1, 8);
+    ui_noise_octaves_->setValue(noise_octaves_);
     ui_final_blend_alpha_ = new QDoubleSpinBox;
     ui_final_blend_alpha_->setDecimals(2);
     ui_final_blend_alpha_->setValue(final_blend_alpha);
@@ -32,16 +51,31 @@ WatercolorEffectConfiguration::WatercolorEffectConfiguration(QString ojects_name
     ui_threshold_combiner_threshold_ = new QDoubleSpinBox;
     ui_threshold_combiner_threshold_->setDecimals(2);
     ui_threshold_combiner_threshold_->setValue(threshold_combiner_threshold);
+    ui_blur_sigma_ = new QDoubleSpinBox;
+    ui_blur_sigma_->setDecimals(2);
+    ui_blur_sigma_->setMaximum(100);
+    ui_blur_sigma_->setValue(blur_sigma_);
     layout->addRow("Noise Scale", ui_noise_scale_factor_);
+    layout->addRow("Noise Seed", ui_noise_seed_);
+    layout->addRow("Noise Octaves", ui_noise_octaves_);
     layout->addRow("Final Blend Alpha", ui_final_blend_alpha_);
     layout->addRow("Threshold Combiner Alpha", ui_threshold_combiner_alpha_);
     layout->addRow("Threshold Combiner Threshold", ui_threshold_combiner_threshold_);
+    layout->addRow("Blur Sigma (1/1000 Width, CPU)", ui_blur_sigma_);
     widget_->setLayout(layout);
 
     QObject::connect<void(QDoubleSpinBox::*)(double)>(ui_noise_scale_factor_, &QDoubleSpinBox::valueChanged, this, [this](double value) {
         this->noise_scale_factor_ = value;
         emit Updated(this);
     });
+    QObject::connect<void(QSpinBox::*)(int)>(ui_noise_seed_, &QSpinBox::valueChanged, this, [this](int value) {
+        this->noise_seed_ = value;
+        emit Updated(this);
+    });
+    QObject::connect<void(QSpinBox::*)(int)>(ui_noise_octaves_, &QSpinBox::valueChanged, this, [this](int value) {
+        this->noise_octaves_ = value;
+        emit Updated(this);
+    });
     QObject::connect<void(QDoubleSpinBox::*)(double)>(ui_final_blend_alpha_, &QDoubleSpinBox::valueChanged, this, [this](double value) {
         this->final_blend_alpha_ = value;
         emit Updated(this);
@@ -54,6 +88,10 @@ WatercolorEffectConfiguration::WatercolorEffectConfiguration(QString ojects_name
         this->threshold_combiner_threshold_ = value;
         emit Updated(this);
     });
+    QObject::connect<void(QDoubleSpinBox::*)(double)>(ui_blur_sigma_, &QDoubleSpinBox::valueChanged, this, [this](double value) {
+        this->blur_sigma_ = value;
+        emit Updated(this);
+    });
 }
 
 WatercolorEffectConfiguration::~WatercolorEffectConfiguration()
@@ -62,7 +100,23 @@ WatercolorEffectConfiguration::~WatercolorEffectConfiguration()
     //delete ui_noise_scale_factor_;
 }
 
-WatercolorEffect::WatercolorEffect(QHash<QString, WatercolorEffectConfiguration*> config) : config_(config)
+WatercolorParameters WatercolorEffectConfiguration::Parameters() const
+{
+    WatercolorParameters parameters;
+    parameters.noise_scale_factor = noise_scale_factor_;
+    parameters.noise_seed = noise_seed_;
+    parameters.noise_octaves = noise_octaves_;
+    parameters.threshold_combiner_alpha = threshold_combiner_alpha_;
+    parameters.threshold_combiner_threshold = threshold_combiner_threshold_;
+    parameters.final_blend_alpha = final_blend_alpha_;
+    parameters.blur_sigma = blur_sigma_;
+    parameters.effect_texture = effect_texture_;
+    parameters.name = ojects_name_;
+    return parameters;
+}
+
+WatercolorEffect::WatercolorEffect(QHash<QString, WatercolorEffectConfiguration*> config)
+    : config_(config), backend_(RenderPass::BACKEND_GL), tile_size_(0)
 {
 }
 
@@ -74,57 +128,130 @@ WatercolorEffect::~WatercolorEffect()
     config_.clear();*/
 }
 
-QImage WatercolorEffect::Apply(osm::Canvas* canvas, bool offscreen)
+QHash<QString, WatercolorParameters> WatercolorEffect::ParametersSnapshot() const
 {
-    QImage source_image;
-    QHash<QString, QImage> processed_images;
-    QList<QImage> combination_order;
+    QHash<QString, WatercolorParameters> parameters;
+    for (auto it = config_.begin(); it != config_.end(); ++it) {
+        if (it.value() != nullptr) {
+            parameters[it.key()] = it.value()->Parameters();
+        }
+    }
+    return parameters;
+}
 
-    // Store the previous "enabled" state of each objects.
-    QHash<QString, bool> enabled_objects;
-    for (auto it = canvas->ObjectsRepository()->OrderedObjectsNames()->begin(); it != canvas->ObjectsRepository()->OrderedObjectsNames()->end(); ++it) {
-        auto config = canvas->ObjectsRepository()->ObjectsConfiguration(*it);
-        if (config != nullptr) {
-            enabled_objects[*it] = config->Enabled();
-            config->Enabled(false);
+QList<QImage> WatercolorEffect::ProcessLayersCpu(osm::Canvas* canvas, const osm::RenderSnapshot& snapshot,
+                                                 const QHash<QString, WatercolorParameters>& parameters) const
+{
+    QStringList names;
+    for (auto it = snapshot.Layers().rbegin(); it != snapshot.Layers().rend(); ++it) {
+        if (!it->style.enabled || !parameters.contains(it->name)) {
+            continue;
         }
+        // Exceptions can't leave the worker threads, so the passes are checked here. The texture
+        // is decoded by the first render, and then taken from the cache.
+        if (TextureCache::Instance().Texture(parameters[it->name].effect_texture).isNull()) {
+            throw std::logic_error("Effect texture can't be read.");
+        }
+        names.append(it->name);
+    }
+    if (names.isEmpty()) {
+        return QList<QImage>();
     }
 
+    const int width = canvas->width();
+    const int height = canvas->height();
+    const QRect world(0, 0, width, height);
+    const int tile_size = tile_size_ > 0 ? tile_size_ : std::max(width, height);
+    QList<QRect> tiles;
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            tiles.append(QRect(x, y, tile_size, tile_size) & world);
+        }
+    }
+    QList<QPair<QString, QRect>> tasks;
+    for (const QString& name : names) {
+        for (const QRect& tile : tiles) {
+            tasks.append(qMakePair(name, tile));
+        }
+    }
+    // The tasks share the cores, instead of each pass starting a thread per core.
+    const int threads_per_task = std::max(1, QThread::idealThreadCount() / tasks.size());
+    // The ways of a layer are projected once, and its tiles take the shapes near them from the
+    // same rasterizer (nullptr: the tiles are painted with QPainter).
+    using Rasterizer = std::shared_ptr<const osm::ScanlineRasterizer>;
+    QHash<QString, Rasterizer> rasterizers;
+    if (tiles.size() > 1) {
+        std::function<Rasterizer(const QString&)> rasterize = [&](const QString& name) {
+            return canvas->MaskRasterizer(snapshot.Solo(name, Qt::black));
+        };
+        const QList<Rasterizer> layers = QtConcurrent::blockingMapped<QList<Rasterizer>>(names, rasterize);
+        for (int i = 0; i < names.size(); ++i) {
+            rasterizers.insert(names[i], layers[i]);
+        }
+    }
+
+    std::function<QImage(const QPair<QString, QRect>&)> process = [&](const QPair<QString, QRect>& task) {
+        cpu::ThreadsLimit threads_limit(threads_per_task);
+        const osm::RenderSnapshot solo = snapshot.Solo(task.first, Qt::black);
+        WatercolorPass pass;
+        pass.Backend(RenderPass::BACKEND_CPU);
+        pass.Parameters(parameters[task.first]);
+        // The CPU passes work on the 8 bit coverage of the layer.
+        if (task.second == world) {
+            return pass.Process(/*input_image=*/canvas->RenderToMask(solo, width, height));
+        }
+        pass.World(world.size(), task.second);
+        const int margin = pass.Margin();
+        return pass.Process(/*input_image=*/canvas->RenderToMask(solo, task.second.adjusted(-margin, -margin, margin, margin),
+                                                                 rasterizers.value(task.first).get()));
+    };
+    // The results are in the order of the tasks, whichever finishes first.
+    const QList<QImage> results = QtConcurrent::blockingMapped<QList<QImage>>(tasks, process);
+    if (tiles.size() == 1) {
+        return results;
+    }
+    QList<QImage> layers;
+    for (int i = 0; i < results.size(); i += tiles.size()) {
+        QImage layer(width, height, results[i].format());
+        QPainter painter(&layer);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        for (int j = 0; j < tiles.size(); ++j) {
+            painter.drawImage(tiles[j].topLeft(), results[i + j]);
+        }
+        painter.end();
+        layers.append(layer);
+    }
+    return layers;
+}
+
+QImage WatercolorEffect::Apply(osm::Canvas* canvas, const osm::RenderSnapshot& snapshot, bool /*offscreen*/)
+{
+    QHash<QString, WatercolorParameters> parameters = ParametersSnapshot();
+    QList<QImage> combination_order;
+
     //QElapsedTimer timer;
     WatercolorPass pass;
-    for (auto it = canvas->ObjectsRepository()->OrderedObjectsNames()->rbegin(); it != canvas->ObjectsRepository()->OrderedObjectsNames()->rend(); ++it) {
-        qDebug() << "Processing objects" << *it;
-        //timer.start();
-        auto canvas_config = canvas->ObjectsRepository()->ObjectsConfiguration(*it);
-        auto watercolor_config = config_[*it];
-        bool previously_enabled = enabled_objects[*it];
-        if (canvas_config && watercolor_config && previously_enabled) {
-            canvas_config->Enabled(true);
-            QColor fill_col = canvas_config->FillColor();
-            QColor outline_col = canvas_config->OutlineColor();
-            canvas_config->FillColor(Qt::black);
-            canvas_config->OutlineColor(Qt::black);
-            QImage src = canvas->RenderToImage(canvas->width(), canvas->height(), offscreen);
+    pass.Backend(backend_);
+    if (backend_ == RenderPass::BACKEND_CPU) {
+        combination_order = ProcessLayersCpu(canvas, snapshot, parameters);
+    } else {
+        // The GL passes share the context of this thread, so the layers are processed in turn.
+        for (auto it = snapshot.Layers().rbegin(); it != snapshot.Layers().rend(); ++it) {
+            if (!it->style.enabled || !parameters.contains(it->name)) {
+                continue;
+            }
+            qDebug() << "Processing objects" << it->name;
+            //timer.start();
+            // The layer is rasterized on the CPU (see Canvas::RenderToMask()), so there is no
+            // multisampled framebuffer to render and read back.
+            QImage src = canvas->RenderToMask(snapshot.Solo(it->name, Qt::black), canvas->width(), canvas->height());
             //qDebug() << "---Rendering canvas to image..." << timer.elapsed() << "ms\n";
-            QImage* texture = new QImage(watercolor_config->EffectsTexture());
-            //qDebug() << "---Loading texture..." << timer.elapsed() << "ms\n";
-            // TODO: Instead of passing single values, pass the configuration object instead!
-            pass.EffectTexture(texture);
-            pass.NoiseScaleFactor(watercolor_config->NoiseScaleFactor());
-            pass.FinalBlendAlpha(watercolor_config->FinalBlendAlpha());
-            pass.ThresholdCombinerAlpha(watercolor_config->ThresholdCombinerAlpha());
-            pass.ThresholdCombinerThreshold(watercolor_config->ThresholdCombinerThreshold());
-            pass.Name(watercolor_config->ObjectsName());
+            pass.Parameters(parameters[it->name]);
             QImage processed = pass.Process(/*input_image=*/src);
             //qDebug() << "---Post processing..." << timer.elapsed() << "ms\n";
-            processed_images[*it] = processed;
             combination_order.push_back(processed);
-            canvas_config->Enabled(false);
-            canvas_config->FillColor(fill_col);
-            canvas_config->OutlineColor(outline_col);
-            delete texture;
+            //qDebug() << "Done -> took " << timer.elapsed() << "ms\n";
         }
-        //qDebug() << "Done -> took " << timer.elapsed() << "ms\n";
     }
 
     //qDebug() << "Combine results.";
@@ -140,14 +267,6 @@ QImage WatercolorEffect::Apply(osm::Canvas* canvas, bool offscreen)
 
     //qDebug() << "Done -> took " << timer.elapsed() << "ms\n";
 
-    // Enable all previously enabled objects.
-    for (auto it = canvas->ObjectsRepository()->OrderedObjectsNames()->begin(); it != canvas->ObjectsRepository()->OrderedObjectsNames()->end(); ++it) {
-        auto config = canvas->ObjectsRepository()->ObjectsConfiguration(*it);
-        if (config) {
-            config->Enabled(enabled_objects[*it]);
-        }
-    }
-
     return combined;
 }
 
@@ -9,6 +9,7 @@
 #include <QImage>
 #include <QObject>
 #include <QDoubleSpinBox>
+#include <QSpinBox>
 #include <QWidget>
 
 namespace effects {
@@ -19,20 +20,30 @@ class WatercolorEffectConfiguration : public QObject
 public:
     explicit WatercolorEffectConfiguration(QString ojects_name, double noise_scale_factor,
                                            double final_blend_alpha, double threshold_combiner_alpha,
-                                           double threshold_combiner_threshold, QImage effect_texture);
+                                           double threshold_combiner_threshold, QString effect_texture);
     virtual ~WatercolorEffectConfiguration();
 
     double NoiseScaleFactor() { return noise_scale_factor_; }
     void NoiseScaleFactor(double value) { noise_scale_factor_ = value; }
+    // By default, the seed is derived from the objects name, so that every layer has its own noise.
+    int NoiseSeed() { return noise_seed_; }
+    void NoiseSeed(int seed) { noise_seed_ = seed; }
+    int NoiseOctaves() { return noise_octaves_; }
+    void NoiseOctaves(int octaves) { noise_octaves_ = octaves; }
     double ThresholdCombinerAlpha() { return threshold_combiner_alpha_; }
     void ThresholdCombinerAlpha(double alpha) { threshold_combiner_alpha_ = alpha; }
     double ThresholdCombinerThreshold() { return threshold_combiner_threshold_; }
     void ThresholdCombinerThreshold(double threshold) { threshold_combiner_threshold_ = threshold; }
     double FinalBlendAlpha() { return final_blend_alpha_; }
     void FinalBlendAlpha(double alpha) { final_blend_alpha_ = alpha; }
-    QImage EffectsTexture() { return effect_texture_; }
-    void EffectsTexture(QImage texture) { effect_texture_ = texture; }
+    double BlurSigma() { return blur_sigma_; }
+    void BlurSigma(double sigma) { blur_sigma_ = sigma; }
+    // The file of the texture, which is only decoded when it is used (see TextureCache).
+    QString EffectsTexture() { return effect_texture_; }
+    void EffectsTexture(QString texture) { effect_texture_ = texture; }
     QString ObjectsName() { return ojects_name_; }
+    // A copy of the current values for a pass.
+    WatercolorParameters Parameters() const;
     QWidget* Widget() { return widget_; }
 
 signals:
@@ -40,16 +51,22 @@ signals:
 
 private:
     double noise_scale_factor_;
+    int noise_seed_;
+    int noise_octaves_;
     double threshold_combiner_alpha_;
     double threshold_combiner_threshold_;
     double final_blend_alpha_;
-    QImage effect_texture_;
+    double blur_sigma_;
+    QString effect_texture_;
     QString ojects_name_;
     QWidget* widget_;
     QDoubleSpinBox* ui_noise_scale_factor_;
+    QSpinBox* ui_noise_seed_;
+    QSpinBox* ui_noise_octaves_;
     QDoubleSpinBox* ui_threshold_combiner_threshold_;
     QDoubleSpinBox* ui_threshold_combiner_alpha_;
     QDoubleSpinBox* ui_final_blend_alpha_;
+    QDoubleSpinBox* ui_blur_sigma_;
 };
 
 class WatercolorEffect : public Effect
@@ -58,10 +75,26 @@ public:
     explicit WatercolorEffect(QHash<QString, WatercolorEffectConfiguration*> config);
     virtual ~WatercolorEffect();
 
-    virtual QImage Apply(osm::Canvas* canvas, bool offscreen);
+    virtual QImage Apply(osm::Canvas* canvas, const osm::RenderSnapshot& snapshot, bool offscreen) override;
+    // The backend of the watercolor passes (GL by default).
+    void Backend(RenderPass::BACKEND backend) { backend_ = backend; }
+    RenderPass::BACKEND Backend() const { return backend_; }
+    // The CPU backend processes the layers in square tiles of this size (0: one tile), which
+    // give the same image as the whole canvas (see WatercolorPass::World()).
+    void TileSize(int size) { tile_size_ = size; }
+    int TileSize() const { return tile_size_; }
 
 private:
+    // Copies the parameters of all configurations, so that GUI edits don't affect a running render.
+    QHash<QString, WatercolorParameters> ParametersSnapshot() const;
+    // The CPU backend: renders and processes the tiles of the enabled layers concurrently (one
+    // pass per tile), and returns the layers in the order of the sequential loop of Apply().
+    QList<QImage> ProcessLayersCpu(osm::Canvas* canvas, const osm::RenderSnapshot& snapshot,
+                                   const QHash<QString, WatercolorParameters>& parameters) const;
+
     QHash<QString, WatercolorEffectConfiguration*> config_;
+    RenderPass::BACKEND backend_;
+    int tile_size_;
 };
 
 }  // namespace effects
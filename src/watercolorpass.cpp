@@ -1,5 +1,9 @@
 #include "watercolorpass.h"
+#include "cpukernels.h"
+#include "cpupostprocess.h"
+#include "noisecache.h"
 #include "qnoise.h"
+#include "texturecache.h"
 
 #include <QDebug>
 #include <QElapsedTimer>
@@ -9,54 +13,48 @@
 
 namespace effects {
 
-WatercolorPass::WatercolorPass() : noise_scale_factor_(0.5), threshold_combiner_alpha_(0.5), threshold_combiner_threshold_(0.7),
-    final_blend_alpha_(0.8), effect_texture_(nullptr), noise_image_(nullptr)
+WatercolorPass::WatercolorPass()
 {
+    parameters_.noise_scale_factor = 0.5;
+    parameters_.noise_seed = QNoise::kDefaultSeed;
+    parameters_.noise_octaves = 1;
+    parameters_.threshold_combiner_alpha = 0.5;
+    parameters_.threshold_combiner_threshold = 0.7;
+    parameters_.final_blend_alpha = 0.8;
+    parameters_.blur_sigma = 0;
 }
 
 WatercolorPass::~WatercolorPass()
 {
-    if (noise_image_ != nullptr) {
-        delete noise_image_;
-    }
-}
-
-void WatercolorPass::NoiseScaleFactor(double factor)
-{
-    noise_scale_factor_ = factor;
-}
-
-void WatercolorPass::ThresholdCombinerAlpha(double alpha)
-{
-    threshold_combiner_alpha_ = alpha;
-}
-
-void WatercolorPass::ThresholdCombinerThreshold(double threshold)
-{
-    threshold_combiner_threshold_ = threshold;
 }
 
-void WatercolorPass::FinalBlendAlpha(double alpha)
+void WatercolorPass::Parameters(const WatercolorParameters& parameters)
 {
-    final_blend_alpha_ = alpha;
+    parameters_ = parameters;
 }
 
-void WatercolorPass::EffectTexture(QImage* texture)
+QImage WatercolorPass::Process(const QImage& input_image)
 {
-    effect_texture_ = texture;
+    if (parameters_.effect_texture.isEmpty()) {
+        throw std::logic_error("Effect texture is not set (empty file name).");
+    }
+    return ProcessStep(input_image, parameters_.effect_texture, parameters_.noise_scale_factor);
 }
 
-void WatercolorPass::Name(const QString& name)
+void WatercolorPass::World(const QSize& world_size, const QRect& region)
 {
-    name_ = name;
+    world_size_ = world_size;
+    region_ = region;
 }
 
-QImage WatercolorPass::Process(const QImage& input_image)
+int WatercolorPass::Margin() const
 {
-    if (effect_texture_ == nullptr) {
-        throw std::logic_error("Effect texture is not set (nullptr).");
+    if (world_size_.isEmpty() || region_ == QRect(QPoint(0, 0), world_size_)) {
+        return 0;
     }
-    return ProcessStep(input_image, *effect_texture_, noise_scale_factor_);
+    const float blur_sigma = parameters_.blur_sigma * world_size_.width() / 1000;
+    const int blur_radius = blur_sigma > 0 ? cpu::GaussianBlurRadius(blur_sigma) : cpu::kBlur13Radius;
+    return blur_radius + cpu::EdgeGradientRadius(blur_sigma > 0 ? blur_sigma : cpu::kBlurSigma);
 }
 
 /*
@@ -68,27 +66,35 @@ QImage WatercolorPass::Process(const QImage& input_image)
  * 5) Invert 3) with invert.frag
  * 6) Blur 5) with blur.frag and size = 13
  * 7) Mask 5) and 6) with mask.frag (to just get the blurred outlines)
- * 8) Blend 4) and 7) with alpha = 0.8f to get the final image
+ * 8) Darken 4) with 7) by alpha = 0.8f to get the final image (darken.frag)
  * */
-QImage WatercolorPass::ProcessStep(const QImage& input_image, const QImage& texture, const double& noise_scale_factor)
+QImage WatercolorPass::ProcessStep(const QImage& input_image, const QString& texture, const double& noise_scale_factor)
 {
     int width = input_image.width();
     int height = input_image.height();
+    const QSize world_size = world_size_.isEmpty() ? input_image.size() : world_size_;
+    const QRect region = world_size_.isEmpty() ? input_image.rect() : region_;
+    if (backend_ == BACKEND_CPU) {
+        return ProcessStepCpu(input_image, texture, noise_scale_factor, world_size, region);
+    }
+    if (region != QRect(QPoint(0, 0), world_size) || input_image.size() != world_size) {
+        throw std::logic_error("Regions of the world are only supported by the CPU backend.");
+    }
 
-    if (noise_image_ == nullptr) {
-        noise_image_ = new QImage(QNoise::create_noise_image(width, height, noise_scale_factor));
+    // Generated once per region, scale, seed and octaves, and shared by all passes.
+    const QImage noise_image = NoiseCache::Instance().Noise(region, world_size.width(), noise_scale_factor,
+                                                            parameters_.noise_seed, parameters_.noise_octaves);
 #ifdef QT_DEBUG
-        noise_image_->save("noise.png", "PNG", 100);
-        QElapsedTimer timer;
-        timer.start();
+    noise_image.save(parameters_.name + "_2_noise.png", "PNG", 100);
+    QElapsedTimer timer;
+    timer.start();
 #endif
-    }
 
     // 1) Blur
     QImage processed_img = Blur(input_image, QVector2D(1.0, 0.0), BLURSIZE_13);
     processed_img = Blur(processed_img, QVector2D(0.0, 1.0), BLURSIZE_13);
 #ifdef QT_DEBUG
-    processed_img.save(name_ + "_1_blur.png", "PNG", 100);
+    processed_img.save(parameters_.name + "_1_blur.png", "PNG", 100);
     qint64 t = timer.elapsed();
     qDebug() << "------Blur (2x) pass..." << t << "\u0394ms\n";
 #endif
@@ -96,31 +102,40 @@ QImage WatercolorPass::ProcessStep(const QImage& input_image, const QImage& text
     // 2) Create noise
     QImage noise_img = QNoise::create_noise_image(width, height, noise_scale_factor);
 #ifdef QT_DEBUG
-    noise_img.save(name_ + "_2_noise.png", "PNG", 100);
+    noise_img.save(parameters_.name + "_2_noise.png", "PNG", 100);
 #endif
     qDebug() << "------Noise pass..." << (timer.elapsed() - t) << "\u0394ms\n";
     t = timer.elapsed();
 */
     // 3) Combine 1) and 2) with threshold_combiner.frag
-    QImage noised_processed_img = PostProcess({processed_img, *noise_image_},
+    QImage noised_processed_img = PostProcess({processed_img, noise_image},
                                                width, height,
                                                ":/shaders/default.vert", ":/shaders/threshold_combiner.frag",
                                               [this](QOpenGLShaderProgram* program) {
-            program->setUniformValue("alpha", (GLfloat) this->threshold_combiner_alpha_);
-            program->setUniformValue("threshold", (GLfloat) this->threshold_combiner_threshold_);
+            program->setUniformValue("alpha", (GLfloat) this->parameters_.threshold_combiner_alpha);
+            program->setUniformValue("threshold", (GLfloat) this->parameters_.threshold_combiner_threshold);
     });
 #ifdef QT_DEBUG
-    noised_processed_img.save(name_ + "_3_noised_processed.png", "PNG", 100);
+    noised_processed_img.save(parameters_.name + "_3_noised_processed.png", "PNG", 100);
     qDebug() << "------Threshold Combiner pass..." << (timer.elapsed() - t) << "\u0394ms\n";
     t = timer.elapsed();
 #endif
 
     // 4) Combine 3) and texture with color_combiner.frag
-    QImage textured_processed_img = PostProcess({noised_processed_img, texture},
+    // The texture is scaled to the width of the image, and mirrored below its height.
+    const QImage paper_texture = TextureCache::Instance().Texture(texture, width);
+    if (paper_texture.isNull()) {
+        throw std::logic_error("Effect texture can't be read.");
+    }
+    const GLfloat texture_scale = static_cast<GLfloat>(height) / paper_texture.height();
+    QImage textured_processed_img = PostProcess({noised_processed_img, paper_texture},
                                                  width, height,
-                                                 ":/shaders/default.vert", ":/shaders/color_combiner.frag");
+                                                 ":/shaders/default.vert", ":/shaders/color_combiner.frag",
+                                                [texture_scale](QOpenGLShaderProgram* program) {
+            program->setUniformValue("texture_scale", QVector2D(1.0, texture_scale));
+    });
 #ifdef QT_DEBUG
-    textured_processed_img.save(name_ + "_4_textured_processed.png", "PNG", 100);
+    textured_processed_img.save(parameters_.name + "_4_textured_processed.png", "PNG", 100);
     qDebug() << "------Color Combiner pass..." << (timer.elapsed() - t) << "\u0394ms\n";
     t = timer.elapsed();
 #endif
@@ -130,7 +145,7 @@ QImage WatercolorPass::ProcessStep(const QImage& input_image, const QImage& text
                                                         width, height,
                                                         ":/shaders/default.vert", ":/shaders/invert.frag");
 #ifdef QT_DEBUG
-    inverted_noised_processed_img.save(name_ + "_5_inverted_noised_processed.png", "PNG", 100);
+    inverted_noised_processed_img.save(parameters_.name + "_5_inverted_noised_processed.png", "PNG", 100);
     qDebug() << "------Invertpass..." << (timer.elapsed() - t) << "\u0394ms\n";
     t = timer.elapsed();
 #endif
@@ -139,7 +154,7 @@ QImage WatercolorPass::ProcessStep(const QImage& input_image, const QImage& text
     QImage blurred_inverted_noised_processed_img = Blur(inverted_noised_processed_img, QVector2D(1.0, 0.0), BLURSIZE_13);
     blurred_inverted_noised_processed_img = Blur(blurred_inverted_noised_processed_img, QVector2D(0.0, 1.0), BLURSIZE_13);
 #ifdef QT_DEBUG
-    blurred_inverted_noised_processed_img.save(name_ + "_6_blurred_inverted_noised_processed.png", "PNG", 100);
+    blurred_inverted_noised_processed_img.save(parameters_.name + "_6_blurred_inverted_noised_processed.png", "PNG", 100);
     qDebug() << "------Blur (2x) pass..." << (timer.elapsed() - t) << "\u0394ms\n";
     t = timer.elapsed();
 #endif
@@ -149,19 +164,86 @@ QImage WatercolorPass::ProcessStep(const QImage& input_image, const QImage& text
                                  width, height,
                                  ":/shaders/default.vert", ":/shaders/mask.frag");
 #ifdef QT_DEBUG
-    masked.save(name_ + "_7_masked.png", "PNG", 100);
+    masked.save(parameters_.name + "_7_masked.png", "PNG", 100);
     qDebug() << "------Mask pass..." << (timer.elapsed() - t) << "\u0394ms\n";
     t = timer.elapsed();
 #endif
 
-    // 8) Blend 4) and 7) with alpha = 0.8f to get the final image
-    //QImage final = Blend(textured_processed_img, masked, width, height, final_blend_alpha_);
-    QImage final = Blend(masked, textured_processed_img, width, height, final_blend_alpha_);
+    // 8) Darken 4) with 7) by alpha = 0.8f to get the final image
+    QImage final = Darken(textured_processed_img, masked, width, height, parameters_.final_blend_alpha);
 #ifdef QT_DEBUG
-    final.save(name_ + "_8_final.png", "PNG", 100);
+    final.save(parameters_.name + "_8_final.png", "PNG", 100);
     qDebug() << "------Blend pass..." << (timer.elapsed() - t) << "\u0394ms\n";
 #endif
     return final;
 }
 
+QImage WatercolorPass::ProcessStepCpu(const QImage& input_image, const QString& texture, const double& noise_scale_factor,
+                                      const QSize& world_size, const QRect& region)
+{
+#ifdef QT_DEBUG
+    QElapsedTimer timer;
+    timer.start();
+#endif
+    const int margin = (input_image.width() - region.width()) / 2;
+    const QRect halo = region.adjusted(-margin, -margin, margin, margin);
+    if (input_image.size() != halo.size()) {
+        throw std::logic_error("The input image doesn't cover the region and its margin.");
+    }
+    // The passes but Blur() treat the edges of the image as those of the world, so they are
+    // applied to the part of the input within the world. Near the other edges of the input,
+    // the results are wrong, but the margin is wide enough to crop them.
+    const QRect rect = halo & QRect(QPoint(0, 0), world_size);
+    const QRect rect_in_input = rect.translated(-halo.topLeft());
+    const bool cropped = rect != halo;
+
+    const int world_width = world_size.width();
+    const float blur_sigma = parameters_.blur_sigma * world_width / 1000;
+
+    // The texture scaled to the width of the world.
+    const PlanarImage paper_texture = TextureCache::Instance().Planes(texture, world_width);
+    if (paper_texture.IsNull()) {
+        throw std::logic_error("Effect texture can't be read.");
+    }
+
+    PlanarImage input = PlanarImage::FromImage(input_image);
+    // 1) Blur
+    PlanarImage processed;
+    if (blur_sigma > 0) {
+        processed = cpu::GaussianBlur(cropped ? cpu::Crop(input, rect_in_input) : input, blur_sigma);
+    } else {
+        // Wraps around the edges of the input, which wraps around the edges of the world.
+        processed = cpu::Blur(input);
+        if (cropped) {
+            processed = cpu::Crop(processed, rect_in_input);
+        }
+    }
+    // 2) The noise of the rect, generated once and shared by all passes and renders.
+    const PlanarImage noise = NoiseCache::Instance().Planes(rect, world_width, noise_scale_factor,
+                                                            parameters_.noise_seed, parameters_.noise_octaves);
+    // 3) Combine 1) and the noise (threshold_combiner.frag)
+    PlanarImage noised_processed = cpu::ThresholdCombine(processed, noise,
+                                                         parameters_.threshold_combiner_alpha,
+                                                         parameters_.threshold_combiner_threshold);
+    // 4) Combine 3) and texture (color_combiner.frag)
+    PlanarImage textured_processed = cpu::ColorCombine(noised_processed,
+                                                       cpu::Mirrored(paper_texture, rect));
+    // 5) - 7) The blurred outlines, from the distance to the edges of 3)
+    PlanarImage masked = cpu::EdgeGradient(noised_processed, blur_sigma > 0 ? blur_sigma : cpu::kBlurSigma);
+    // 8) Darken 4) towards the edges with 7)
+    PlanarImage blended = cpu::Darken(textured_processed, masked, parameters_.final_blend_alpha);
+    if (rect != region) {
+        blended = cpu::Crop(blended, region.translated(-rect.topLeft()));
+    }
+    QImage final = blended.ToImage();
+#ifdef QT_DEBUG
+    // The tiles of a layer are processed at the same time, so each saves its own file.
+    const QString suffix = region.size() == world_size
+            ? QString() : QString("_%1_%2").arg(region.x()).arg(region.y());
+    final.save(parameters_.name + "_8_final" + suffix + ".png", "PNG", 100);
+    qDebug() << "------CPU passes..." << timer.elapsed() << "ms\n";
+#endif
+    return final;
+}
+
 }  // namespace effects
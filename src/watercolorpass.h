@@ -1,38 +1,66 @@
 #ifndef WATERCOLORPASS_H
 #define WATERCOLORPASS_H
 
+#include "planarimage.h"
 #include "renderpass.h"
 
 namespace effects {
 
+// The parameters of one watercolor pass (a copy of a WatercolorEffectConfiguration,
+// so that the configuration can change while the pass is running).
+struct WatercolorParameters
+{
+    // The noise scale factor for the noise image used by the watercolor effect.
+    double noise_scale_factor;
+    // The seed and the fBm octaves of the noise (see NoiseCache).
+    int64_t noise_seed;
+    int noise_octaves;
+    double threshold_combiner_alpha;
+    double threshold_combiner_threshold;
+    // How much the shapes are darkened towards their edges (0: not at all, 1: to half).
+    double final_blend_alpha;
+    // The standard deviation of the blurs of the CPU backend, in 1/1000 of the image width, so
+    // that the look doesn't depend on the resolution. 0 uses the 13 tap blur of the shaders.
+    double blur_sigma;
+    // The file of the watercolor texture to be used for the effect (see TextureCache).
+    QString effect_texture;
+    // The name of the objects - used for storing debugging images.
+    QString name;
+};
+
 class WatercolorPass : public RenderPass
 {
 public:
     WatercolorPass();
     ~WatercolorPass();
 
-    // Sets the noise scale factor for the noise image used by the watercolor effect (default it 5).
-    void NoiseScaleFactor(double factor);
-    void ThresholdCombinerAlpha(double alpha);
-    void ThresholdCombinerThreshold(double threshold);
-    void FinalBlendAlpha(double alpha);
-    // Sets the watercolor texture to be used for the effect.
-    void EffectTexture(QImage* texture);
-    // Sets the name of this effect - used for storing debugging images.
-    void Name(const QString& name);
+    // Sets the parameters for the next call of Process().
+    void Parameters(const WatercolorParameters& parameters);
+    const WatercolorParameters& Parameters() const { return parameters_; }
     // Adds a watercolor effect to the given image.
     virtual QImage Process(const QImage& input_image) override;
 
+    // The part of the world (i.e. the whole map) which the next calls of Process() render. The
+    // noise and the paper texture are laid out in the world at the scale of its width, and the
+    // texture is mirrored at its edges instead of stretched, so that regions (tiles) rendered on
+    // their own fit together into the image of the whole world. The input image of a region
+    // covers the region and Margin() pixels on every side (wrapping around the edges of the
+    // world, like the GL textures of the passes), and the result covers the region. Regions
+    // are only supported by the CPU backend. By default (an empty world), the input image is
+    // the whole world.
+    void World(const QSize& world_size, const QRect& region);
+    // The margin of the input of a region (for the parameters and the world).
+    int Margin() const;
+
 private:
-    QImage ProcessStep(const QImage& input_image, const QImage& texture, const double& noise_scale_factor);
-    double noise_scale_factor_;
-    double threshold_combiner_alpha_;
-    double threshold_combiner_threshold_;
-    double final_blend_alpha_;
+    QImage ProcessStep(const QImage& input_image, const QString& texture, const double& noise_scale_factor);
+    // The same steps with the CPU backend.
+    QImage ProcessStepCpu(const QImage& input_image, const QString& texture, const double& noise_scale_factor,
+                          const QSize& world_size, const QRect& region);
+    WatercolorParameters parameters_;
     BLURSIZE blur_size_;
-    QImage* effect_texture_;
-    QString name_;
-    QImage* noise_image_;
+    QSize world_size_;
+    QRect region_;
 };
 
 }  // namespace effects